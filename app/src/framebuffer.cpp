@@ -1,4 +1,4 @@
-//#include <algorithm>
+#include <common/trace.hpp>
 
 #include "framebuffer.hpp"
 
@@ -12,7 +12,7 @@ Framebuffer::Framebuffer(int width, int height)
     glBindTexture(GL_TEXTURE_2D, colorTexture);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_FLOAT, nullptr);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
 }
 
 Framebuffer::~Framebuffer()
@@ -20,33 +20,22 @@ Framebuffer::~Framebuffer()
     glDeleteTextures(1, &colorTexture);
 }
 
-void Framebuffer::clear()
+rdrFramebufferDesc Framebuffer::getDesc()
 {
-    // Sadly too slow...
-    //std::fill(colorBuffer.begin(), colorBuffer.end(), clearColor);
-    //std::fill(depthBuffer.begin(), depthBuffer.end(), 0.f);
-
-    // Clear color buffer
-    {
-        float4* colors = colorBuffer.data();
-
-        // Fill the first line with the clear color
-        for (size_t i = 0; i < width; ++i)
-            memcpy(&colors[i], &clearColor, sizeof(float4));
-
-        // Copy the first line onto every line
-        for (size_t i = 1; i < height; ++i)
-            memcpy(&colors[i * width], &colors[0], width * sizeof(float4));
-    }
-
-    // Clear depth buffer
-    {
-        memset(depthBuffer.data(), 0, depthBuffer.size() * sizeof(depthBuffer[0]));
-    }
+    rdrFramebufferDesc desc = {};
+    desc.colorBuffer = getColorBuffer();
+    desc.depthBuffer = getDepthBuffer();
+    desc.width = width;
+    desc.height = height;
+    desc.colorFormat = colorFormat;
+    desc.depthFormat = depthFormat;
+    return desc;
 }
 
 void Framebuffer::updateTexture()
 {
+    TRACE_SCOPE("Texture Upload");
+
     glBindTexture(GL_TEXTURE_2D, colorTexture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, colorBuffer.data());
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, colorBuffer.data());
 }
@@ -4,6 +4,8 @@
 
 #include <glad/glad.h>
 
+#include <rdr/renderer.h>
+
 #include <common/types.hpp>
 
 struct Framebuffer
@@ -11,24 +13,26 @@ struct Framebuffer
     Framebuffer(int width, int height);
     ~Framebuffer();
 
-    void clear();
     void updateTexture();
 
-    float* getColorBuffer() { return reinterpret_cast<float*>(colorBuffer.data()); }
-    float* getDepthBuffer() { return depthBuffer.data(); }
+    void* getColorBuffer() { return colorBuffer.data(); }
+    void* getDepthBuffer() { return depthBuffer.data(); }
     int getWidth()  const   { return width; }
     int getHeight() const   { return height; }
+    rdrFramebufferDesc getDesc();
 
     GLuint getColorTexture() const { return colorTexture; }
 
-    float4 clearColor = { 0.f, 0.f, 0.f, 1.f };
+    // Formats the renderer writes, 8 bytes per pixel
+    static const rdrColorFormat colorFormat = RDR_COLOR_FORMAT_RGBA8;
+    static const rdrDepthFormat depthFormat = RDR_DEPTH_FORMAT_D24;
 private:
     int width = 0;
     int height = 0;
 
     // In-RAM buffers
-    std::vector<float4> colorBuffer;
-    std::vector<float> depthBuffer;
+    std::vector<unsigned int> colorBuffer;
+    std::vector<unsigned int> depthBuffer;
 
     // OpenGL texture (in VRAM)
     GLuint colorTexture = 0;
@@ -14,8 +14,10 @@
 
 #include <common/maths.hpp>
 #include <common/camera.hpp>
+#include <common/trace.hpp>
 
 #include "framebuffer.hpp"
+#include "render_thread.hpp"
 
 // Set to 0 to disable high perf GPU
 #if 1
@@ -114,29 +116,36 @@ static void endFrame(GLFWwindow* window)
 
 int main(int argc, char* argv[])
 {
+    TRACE_THREAD_NAME("Main");
+
     // Init window
     GLFWwindow* window = initWindow(1920, 1080, "Software renderer tester");
     if (window == nullptr)
         return -1;
 
-    // Create renderer framebuffer (color+depth+opengl texture)
+    // Create the ring of renderer framebuffers (color+depth+opengl texture)
     // We need an OpenGL texture to display the result of the renderer to the screen
-    Framebuffer framebuffer(1280, 720);
-    //Framebuffer framebuffer(320, 180);
+    // Triple buffered: one frame presented, one waiting to be, one being rendered
+    RenderThread renderThread(1280, 720, 3);
+    //RenderThread renderThread(320, 180, 3);
+    int width = renderThread.getFramebuffer(0).getWidth();
+    int height = renderThread.getFramebuffer(0).getHeight();
 
     // Init renderer
-    rdrImpl* renderer = rdrInit(
-        framebuffer.getColorBuffer(),
-        framebuffer.getDepthBuffer(),
-        framebuffer.getWidth(), framebuffer.getHeight());
+    rdrFramebufferDesc framebufferDesc = renderThread.getFramebuffer(0).getDesc();
+    rdrImpl* renderer = rdrInitEx(&framebufferDesc);
 
     rdrSetImGuiContext(renderer, ImGui::GetCurrentContext());
 
     scnImpl* scene = scnCreate();
     scnSetImGuiContext(scene, ImGui::GetCurrentContext());
 
+    // Rendering happens on its own thread from now on
+    renderThread.start(renderer, scene);
+
     CameraInputs inputs;
-    Camera camera(framebuffer.getWidth(), framebuffer.getHeight());
+    Camera camera(width, height);
+    float4 clearColor = { 0.f, 0.f, 0.f, 1.f };
 
     bool mouseCaptured = false;
     double mouseX = 0.0;
@@ -176,46 +185,42 @@ int main(int argc, char* argv[])
             camera.update(ImGui::GetIO().DeltaTime, inputs);
         }
 
-        // Clear buffers
-        framebuffer.clear();
-
-        // Setup matrices
-        mat4x4 projection = camera.getProjection();
-        mat4x4 view       = camera.getViewMatrix();
-        rdrSetProjection(renderer, projection.e);
-        rdrSetView(renderer, view.e);
-
-        // Pass BG Info to Renderer
-        rdrSetBackground(renderer, (float*)&framebuffer.clearColor);
-
-        // Render scene
-        scnUpdate(scene, ImGui::GetIO().DeltaTime, renderer);
-
-        // Upload texture
-        framebuffer.updateTexture();
+        // Next frames are rendered with the current camera
+        FrameParams frameParams;
+        frameParams.projection = camera.getProjection();
+        frameParams.view       = camera.getViewMatrix();
+        frameParams.clearColor = clearColor;
+        renderThread.setFrameParams(frameParams);
 
         // Display debug controls
         if (ImGui::Begin("Config"))
         {
             if (ImGui::CollapsingHeader("Framebuffer", ImGuiTreeNodeFlags_DefaultOpen))
             {
-                ImGui::ColorEdit4("clearColor", framebuffer.clearColor.e);
+                ImGui::ColorEdit4("clearColor", clearColor.e);
+                renderThread.showImGuiControls();
             }
             if (ImGui::CollapsingHeader("Camera", ImGuiTreeNodeFlags_DefaultOpen))
             {
                 camera.showImGuiControls();
             }
+            // Copies of the settings, they never wait for the frame being rendered
             if (ImGui::CollapsingHeader("renderer.dll", ImGuiTreeNodeFlags_DefaultOpen))
             {
-                rdrShowImGuiControls(renderer);
+                rdrShowImGuiControlsDeferred(renderThread.getRendererControls());
             }
             if (ImGui::CollapsingHeader("scene.dll", ImGuiTreeNodeFlags_DefaultOpen))
             {
-                scnShowImGuiControls(scene);
+                scnShowImGuiControlsDeferred(renderThread.getSceneControls());
             }
         }
         ImGui::End();
 
+        // Upload texture, if a new frame was finished
+        if (Framebuffer* frame = renderThread.acquireFrame())
+            frame->updateTexture();
+        Framebuffer& framebuffer = renderThread.getPresentedFrame();
+
         ImGui::Begin("Framebuffer");
         ImGui::Text("(Right click to capture mouse, Esc to un-capture)");
         // Display framebuffer (renderer output)
@@ -232,6 +237,7 @@ int main(int argc, char* argv[])
         endFrame(window);
     }
 
+    renderThread.stop();
     scnDestroy(scene);
     rdrShutdown(renderer);
 
@@ -0,0 +1,192 @@
+#include <chrono>
+#include <cstdio>
+
+#include <imgui.h>
+
+#include <common/trace.hpp>
+
+#include "render_thread.hpp"
+
+RenderThread::RenderThread(int width, int height, int ringSize)
+    : slots(ringSize < 2 ? 2 : ringSize, SlotState::FREE)
+    , slotFrames(slots.size(), 0)
+    , maxFramesAhead((int)slots.size() - 1)
+{
+    for (size_t i = 0; i < slots.size(); ++i)
+        framebuffers.emplace_back(new Framebuffer(width, height));
+
+    // Shown until the first frame is finished
+    slots[presentedSlot] = SlotState::PRESENTED;
+}
+
+RenderThread::~RenderThread()
+{
+    stop();
+}
+
+void RenderThread::start(rdrImpl* renderer, scnImpl* scene)
+{
+    this->renderer = renderer;
+    this->scene = scene;
+    rendererControls = rdrCreateImGuiControls(renderer);
+    sceneControls = scnCreateImGuiControls(scene);
+    quit = false;
+    thread = std::thread(&RenderThread::renderLoop, this);
+}
+
+void RenderThread::stop()
+{
+    if (!thread.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    wakeUp.notify_all();
+    thread.join();
+
+    rdrDestroyImGuiControls(rendererControls);
+    scnDestroyImGuiControls(sceneControls);
+    rendererControls = nullptr;
+    sceneControls = nullptr;
+}
+
+void RenderThread::setFrameParams(const FrameParams& params)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->params = params;
+        hasParams = true;
+    }
+    wakeUp.notify_all();
+}
+
+Framebuffer* RenderThread::acquireFrame()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+
+    int newest = -1;
+    for (int i = 0; i < (int)slots.size(); ++i)
+    {
+        if (slots[i] == SlotState::READY && (newest == -1 || slotFrames[i] > slotFrames[newest]))
+            newest = i;
+    }
+    if (newest == -1)
+        return nullptr;
+
+    // Older finished frames are dropped, they would only add latency
+    for (SlotState& slot : slots)
+    {
+        if (slot == SlotState::READY || slot == SlotState::PRESENTED)
+            slot = SlotState::FREE;
+    }
+    slots[newest] = SlotState::PRESENTED;
+    presentedSlot = newest;
+    readyCount = 0;
+
+    lock.unlock();
+    wakeUp.notify_all();
+    return framebuffers[newest].get();
+}
+
+bool RenderThread::canStartFrame() const
+{
+    if (!hasParams || readyCount >= maxFramesAhead)
+        return false;
+
+    for (SlotState slot : slots)
+    {
+        if (slot == SlotState::FREE)
+            return true;
+    }
+    return false;
+}
+
+void RenderThread::renderLoop()
+{
+    TRACE_THREAD_NAME("Render");
+
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point lastFrameStart = Clock::now();
+
+    for (;;)
+    {
+        int slot = 0;
+        FrameParams frameParams;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wakeUp.wait(lock, [&] { return quit || canStartFrame(); });
+            if (quit)
+                return;
+
+            while (slots[slot] != SlotState::FREE)
+                slot++;
+            slots[slot] = SlotState::RENDERING;
+            frameParams = params;
+        }
+
+        // The scene is animated with the time between the frames it renders
+        Clock::time_point frameStart = Clock::now();
+        float deltaTime = std::chrono::duration<float>(frameStart - lastFrameStart).count();
+        lastFrameStart = frameStart;
+
+        renderFrame(*framebuffers[slot], frameParams, deltaTime);
+
+        // The controls show the counters of this frame, their edits apply from the next one
+        rdrSyncImGuiControls(renderer, rendererControls);
+        scnSyncImGuiControls(scene, sceneControls);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        slots[slot] = SlotState::READY;
+        slotFrames[slot] = ++frameCount;
+        readyCount++;
+    }
+}
+
+void RenderThread::renderFrame(Framebuffer& framebuffer, const FrameParams& params, float deltaTime)
+{
+    rdrFramebufferDesc desc = framebuffer.getDesc();
+    rdrSetFramebuffer(renderer, &desc);
+
+    // Clear buffers, only the parts of them left untouched by this frame are actually written
+    rdrClear(renderer, params.clearColor.e);
+    rdrBeginFrame(renderer);
+
+    // Setup matrices
+    rdrSetProjection(renderer, (float*)params.projection.e);
+    rdrSetView(renderer, (float*)params.view.e);
+
+    // Pass BG Info to Renderer
+    rdrSetBackground(renderer, (float*)params.clearColor.e);
+
+    // Render scene, objects out of the view are culled
+    scnSetCamera(scene, params.projection.e, params.view.e);
+    scnUpdate(scene, deltaTime, renderer);
+    rdrEndFrame(renderer);
+}
+
+void RenderThread::showImGuiControls()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    ImGui::Text("Ring of %d framebuffers", (int)slots.size());
+    if (ImGui::SliderInt("Frames Ahead", &maxFramesAhead, 1, (int)slots.size() - 1))
+        wakeUp.notify_all();
+
+#ifdef RDR_TRACE
+    // The last finished frames, as many as the buffers of the busiest thread usually hold
+    static int traceFrameCount = 30;
+    ImGui::SliderInt("Trace Frames", &traceFrameCount, 1, 120);
+    if (ImGui::Button("Write trace.json"))
+    {
+        unsigned long long lastFrame = rdrTraceGetFrame();
+        if (lastFrame > 0)
+        {
+            unsigned long long firstFrame = lastFrame > (unsigned long long)traceFrameCount ? lastFrame - traceFrameCount : 0;
+            if (!rdrTraceWrite("trace.json", firstFrame, lastFrame - 1))
+                printf("Cannot write trace.json\n");
+        }
+    }
+#endif
+}
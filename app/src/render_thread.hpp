@@ -0,0 +1,86 @@
+#pragma once
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <rdr/renderer.h>
+#include <scn/scene.h>
+
+#include <common/types.hpp>
+
+#include "framebuffer.hpp"
+
+// What the main thread hands to the render thread, the latest one is used for each new frame
+struct FrameParams
+{
+    mat4x4 projection;
+    mat4x4 view;
+    float4 clearColor;
+};
+
+// Renders the scene on its own thread, into a ring of framebuffers
+// While the main thread uploads and presents the last finished frame, the next ones are rendered
+// The renderer gets at most maxFramesAhead finished frames ahead of the main thread, then waits for them to be presented
+struct RenderThread
+{
+    // ringSize is at least 2: one frame presented while another is rendered
+    RenderThread(int width, int height, int ringSize);
+    ~RenderThread();
+
+    // The framebuffer to init the renderer with, the render thread then cycles through the whole ring
+    Framebuffer& getFramebuffer(int slot) { return *framebuffers[slot]; }
+
+    // Frames are rendered from the first call to setFrameParams() until stop()
+    void start(rdrImpl* renderer, scnImpl* scene);
+    void stop();
+
+    void setFrameParams(const FrameParams& params);
+
+    // Newest finished frame, presented until the next call: it is not rendered to in the meantime
+    // Returns nullptr if no frame was finished since the last call
+    Framebuffer* acquireFrame();
+    Framebuffer& getPresentedFrame() { return *framebuffers[presentedSlot]; }
+
+    // ImGui controls of the renderer and of the scene, for the main thread, applied between the frames
+    rdrImGuiControls* getRendererControls() { return rendererControls; }
+    scnImGuiControls* getSceneControls() { return sceneControls; }
+
+    void showImGuiControls();
+
+private:
+    enum class SlotState
+    {
+        FREE,
+        RENDERING,
+        READY,
+        PRESENTED,
+    };
+
+    void renderLoop();
+    bool canStartFrame() const;
+    void renderFrame(Framebuffer& framebuffer, const FrameParams& params, float deltaTime);
+
+    rdrImpl* renderer = nullptr;
+    scnImpl* scene = nullptr;
+    rdrImGuiControls* rendererControls = nullptr;
+    scnImGuiControls* sceneControls = nullptr;
+
+    std::vector<std::unique_ptr<Framebuffer>> framebuffers;
+    std::vector<SlotState> slots;
+    std::vector<unsigned long long> slotFrames; // Index of the frame last rendered in each slot
+    int presentedSlot = 0;
+    int readyCount = 0;
+
+    int maxFramesAhead;
+    FrameParams params = {};
+    bool hasParams = false;
+    unsigned long long frameCount = 0;
+    bool quit = false;
+
+    std::mutex mutex; // Guards everything above
+    std::condition_variable wakeUp;
+    std::thread thread;
+};
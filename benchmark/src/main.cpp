@@ -0,0 +1,456 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#define chdir _chdir
+#define getcwd _getcwd
+#else
+#include <unistd.h>
+#endif
+
+#include <rdr/renderer.h>
+#include <scn/scene.h>
+
+#include <common/maths.hpp>
+#include <common/camera.hpp>
+
+// Renders each bundled asset along the same camera path under several render configurations,
+// and writes the frame times and throughputs to a JSON file, to compare builds and machines
+struct Options
+{
+    const char* output = "benchmark.json";
+    const char* workDir = nullptr;
+    int frames = 120;
+    int warmupFrames = 10;
+    int width = 1280;
+    int height = 720;
+    int threadCount = 0;
+    int tileSize = 0;
+    std::vector<std::string> assets;  // All of them when empty
+    std::vector<std::string> configs;
+};
+
+// Render options set before each run, everything else keeps the renderer defaults
+struct Config
+{
+    const char* name;
+    bool wireframe;
+    bool phong;
+    bool deferred;
+    bool depthTest;
+    bool alphaBlending;
+    float alpha;
+};
+
+static const Config configs[] = {
+    //  name             wireframe  phong  deferred  depth test  blending  alpha
+    { "wireframe",       true,      true,  false,    true,       false,    1.f },
+    { "gouraud",         false,     false, false,    true,       false,    1.f },
+    { "phong",           false,     true,  false,    true,       false,    1.f },
+    { "deferred",        false,     true,  true,     true,       false,    1.f },
+    { "no_depth_test",   false,     true,  false,    false,      false,    1.f },
+    { "alpha",           false,     true,  false,    true,       true,     0.5f },
+};
+
+struct FrameTimes
+{
+    double mean;
+    double min;
+    double p50;
+    double p90;
+    double p95;
+    double p99;
+    double max;
+};
+
+struct Result
+{
+    std::string asset;
+    const Config* config;
+    FrameTimes times;
+    double trianglesPerFrame;
+    double shadedPixelsPerFrame;
+    double trianglesPerSecond;
+    double shadedPixelsPerSecond;
+};
+
+struct AssetLoad
+{
+    std::string name;
+    bool loaded;
+    double loadTime; // In ms
+};
+
+static void printUsage(const char* program)
+{
+    printf("Usage: %s [options]\n", program);
+    printf("  -o, --output FILE      JSON results (default benchmark.json)\n");
+    printf("  -n, --frames N         Measured frames per asset and configuration (default 120)\n");
+    printf("  --warmup N             Frames rendered before measuring (default 10)\n");
+    printf("  --size WxH             Framebuffer size (default 1280x720)\n");
+    printf("  --threads N            Render threads, 0 is one per core (default 0)\n");
+    printf("  --tile-size N          Tile size of the tiled backend, in pixels\n");
+    printf("  --assets A,B,...       Assets to run (default: all of them)\n");
+    printf("  --configs A,B,...      Configurations to run (default: all of them)\n");
+    printf("  -C, --workdir DIR      Directory the assets are loaded from, e.g. app (default: current)\n");
+
+    printf("Assets:");
+    for (int i = 0; i < scnGetAssetCount(); ++i)
+        printf(" %s", scnGetAssetName(i));
+    printf("\nConfigurations:");
+    for (const Config& config : configs)
+        printf(" %s", config.name);
+    printf("\n");
+}
+
+static std::vector<std::string> splitList(const char* text)
+{
+    std::vector<std::string> items;
+    std::string item;
+    for (const char* c = text; ; ++c)
+    {
+        if (*c == ',' || *c == '\0')
+        {
+            if (!item.empty())
+                items.push_back(item);
+            item.clear();
+            if (*c == '\0')
+                break;
+        }
+        else
+        {
+            item += *c;
+        }
+    }
+    return items;
+}
+
+static bool parseOptions(int argc, char* argv[], Options& options)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        const char* arg = argv[i];
+        if (strcmp(arg, "--help") == 0)
+            return false;
+
+        if (i + 1 >= argc)
+        {
+            fprintf(stderr, "Unknown option or missing value: %s\n", arg);
+            return false;
+        }
+        const char* value = argv[++i];
+
+        bool valid = true;
+        if (strcmp(arg, "-o") == 0 || strcmp(arg, "--output") == 0)
+        {
+            options.output = value;
+        }
+        else if (strcmp(arg, "-C") == 0 || strcmp(arg, "--workdir") == 0)
+        {
+            options.workDir = value;
+        }
+        else if (strcmp(arg, "-n") == 0 || strcmp(arg, "--frames") == 0)
+        {
+            options.frames = atoi(value);
+            valid = options.frames > 0;
+        }
+        else if (strcmp(arg, "--warmup") == 0)
+        {
+            options.warmupFrames = atoi(value);
+            valid = options.warmupFrames >= 0;
+        }
+        else if (strcmp(arg, "--size") == 0)
+        {
+            valid = sscanf(value, "%dx%d", &options.width, &options.height) == 2 && options.width > 0 && options.height > 0;
+        }
+        else if (strcmp(arg, "--threads") == 0)
+        {
+            options.threadCount = atoi(value);
+        }
+        else if (strcmp(arg, "--tile-size") == 0)
+        {
+            options.tileSize = atoi(value);
+        }
+        else if (strcmp(arg, "--assets") == 0)
+        {
+            options.assets = splitList(value);
+            for (const std::string& asset : options.assets)
+            {
+                bool found = false;
+                for (int j = 0; j < scnGetAssetCount(); ++j)
+                    found |= asset == scnGetAssetName(j);
+                valid &= found;
+            }
+        }
+        else if (strcmp(arg, "--configs") == 0)
+        {
+            options.configs = splitList(value);
+            for (const std::string& name : options.configs)
+            {
+                bool found = false;
+                for (const Config& config : configs)
+                    found |= name == config.name;
+                valid &= found;
+            }
+        }
+        else
+        {
+            fprintf(stderr, "Unknown option: %s\n", arg);
+            return false;
+        }
+
+        if (!valid)
+        {
+            fprintf(stderr, "Invalid value for %s: %s\n", arg, value);
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool isSelected(const std::vector<std::string>& selection, const char* name)
+{
+    return selection.empty() || std::find(selection.begin(), selection.end(), name) != selection.end();
+}
+
+// One turn around the origin, at the height of the default app camera, moving closer and away twice
+// Only depends on the frame index, so every run sees the same frames
+static void setCameraPath(Camera& camera, int frame, int frameCount)
+{
+    float angle = maths::TAU * (float)frame / (float)frameCount;
+    float distance = 1.8f + 0.6f * maths::cos(2.f * angle);
+    camera.setTransform({ distance * maths::sin(angle), 0.474f, distance * maths::cos(angle) }, 0.f, -angle);
+}
+
+static void applyConfig(rdrImpl* renderer, const Config& config)
+{
+    rdrSetRenderOption(renderer, RDR_OPTION_WIREFRAME, config.wireframe);
+    rdrSetRenderOption(renderer, RDR_OPTION_PHONG, config.phong);
+    rdrSetRenderOption(renderer, RDR_OPTION_DEFERRED, config.deferred);
+    rdrSetRenderOption(renderer, RDR_OPTION_DEPTH_TEST, config.depthTest);
+    rdrSetRenderOption(renderer, RDR_OPTION_ALPHA_BLENDING, config.alphaBlending);
+    rdrSetAlpha(renderer, config.alpha);
+}
+
+// Nearest rank, on sorted times
+static double getPercentile(const std::vector<double>& sortedTimes, double percentile)
+{
+    size_t rank = (size_t)std::ceil(percentile / 100.0 * sortedTimes.size());
+    return sortedTimes[rank > 0 ? rank - 1 : 0];
+}
+
+static FrameTimes getFrameTimes(std::vector<double> times)
+{
+    std::sort(times.begin(), times.end());
+
+    FrameTimes result;
+    double total = 0.0;
+    for (double time : times)
+        total += time;
+    result.mean = total / times.size();
+    result.min = times.front();
+    result.p50 = getPercentile(times, 50.0);
+    result.p90 = getPercentile(times, 90.0);
+    result.p95 = getPercentile(times, 95.0);
+    result.p99 = getPercentile(times, 99.0);
+    result.max = times.back();
+    return result;
+}
+
+static Result runBenchmark(rdrImpl* renderer, scnImpl* scene, const Options& options, const char* assetName, const Config& config)
+{
+    applyConfig(renderer, config);
+
+    Camera camera(options.width, options.height);
+    camera.setPerspective(maths::toRadians(60.f), 0.01f, 10.f);
+    float4 clearColor = { 0.f, 0.f, 0.f, 1.f };
+
+    std::vector<double> times;
+    times.reserve(options.frames);
+    unsigned long long triangles = 0;
+    unsigned long long shadedPixels = 0;
+    for (int frame = -options.warmupFrames; frame < options.frames; ++frame)
+    {
+        // Warmup frames follow the end of the path, so the measured frames start from the same state
+        setCameraPath(camera, frame < 0 ? frame + options.frames : frame, options.frames);
+        mat4x4 projection = camera.getProjection();
+        mat4x4 view = camera.getViewMatrix();
+
+        auto start = std::chrono::steady_clock::now();
+
+        rdrClear(renderer, clearColor.e);
+        rdrBeginFrame(renderer);
+        rdrSetProjection(renderer, projection.e);
+        rdrSetView(renderer, view.e);
+        rdrSetBackground(renderer, clearColor.e);
+
+        // The scene is not animated, only the camera moves
+        scnSetCamera(scene, projection.e, view.e);
+        scnUpdate(scene, 0.f, renderer);
+        rdrEndFrame(renderer);
+
+        double time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (frame < 0)
+            continue;
+
+        rdrStats stats;
+        rdrGetStats(renderer, &stats);
+        times.push_back(time);
+        triangles += stats.trianglesSubmitted;
+        shadedPixels += stats.pixelsShaded;
+    }
+
+    Result result;
+    result.asset = assetName;
+    result.config = &config;
+    result.times = getFrameTimes(times);
+
+    double totalSeconds = result.times.mean * options.frames / 1000.0;
+    result.trianglesPerFrame = (double)triangles / options.frames;
+    result.shadedPixelsPerFrame = (double)shadedPixels / options.frames;
+    result.trianglesPerSecond = totalSeconds > 0.0 ? triangles / totalSeconds : 0.0;
+    result.shadedPixelsPerSecond = totalSeconds > 0.0 ? shadedPixels / totalSeconds : 0.0;
+    return result;
+}
+
+// Names are only made of letters, digits and underscores, they don't need any escaping
+static bool writeJson(const char* filename, const Options& options, int threadCount, const std::vector<AssetLoad>& loads, const std::vector<Result>& results)
+{
+    FILE* file = fopen(filename, "w");
+    if (file == nullptr)
+        return false;
+
+    fprintf(file, "{\n");
+    fprintf(file, "  \"version\": 1,\n");
+    fprintf(file, "  \"width\": %d,\n", options.width);
+    fprintf(file, "  \"height\": %d,\n", options.height);
+    fprintf(file, "  \"frames\": %d,\n", options.frames);
+    fprintf(file, "  \"warmupFrames\": %d,\n", options.warmupFrames);
+    fprintf(file, "  \"threads\": %d,\n", threadCount);
+    fprintf(file, "  \"tileSize\": %d,\n", options.tileSize); // 0 for the renderer default
+
+    fprintf(file, "  \"assets\": [\n");
+    for (size_t i = 0; i < loads.size(); ++i)
+    {
+        const AssetLoad& load = loads[i];
+        fprintf(file, "    { \"name\": \"%s\", \"loaded\": %s, \"loadMs\": %.3f }%s\n",
+            load.name.c_str(), load.loaded ? "true" : "false", load.loadTime, i + 1 < loads.size() ? "," : "");
+    }
+    fprintf(file, "  ],\n");
+
+    fprintf(file, "  \"results\": [\n");
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const Result& result = results[i];
+        const FrameTimes& times = result.times;
+        fprintf(file, "    {\n");
+        fprintf(file, "      \"asset\": \"%s\",\n", result.asset.c_str());
+        fprintf(file, "      \"config\": \"%s\",\n", result.config->name);
+        fprintf(file, "      \"msPerFrame\": { \"mean\": %.4f, \"min\": %.4f, \"p50\": %.4f, \"p90\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f },\n",
+            times.mean, times.min, times.p50, times.p90, times.p95, times.p99, times.max);
+        fprintf(file, "      \"trianglesPerFrame\": %.1f,\n", result.trianglesPerFrame);
+        fprintf(file, "      \"shadedPixelsPerFrame\": %.1f,\n", result.shadedPixelsPerFrame);
+        fprintf(file, "      \"trianglesPerSecond\": %.1f,\n", result.trianglesPerSecond);
+        fprintf(file, "      \"shadedPixelsPerSecond\": %.1f\n", result.shadedPixelsPerSecond);
+        fprintf(file, "    }%s\n", i + 1 < results.size() ? "," : "");
+    }
+    fprintf(file, "  ]\n");
+    fprintf(file, "}\n");
+
+    bool written = !ferror(file);
+    return fclose(file) == 0 && written;
+}
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    if (!parseOptions(argc, argv, options))
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    size_t pixelCount = (size_t)options.width * options.height;
+    std::vector<float4> colorBuffer(pixelCount);
+    std::vector<float> depthBuffer(pixelCount);
+
+    rdrImpl* renderer = rdrInit(colorBuffer[0].e, depthBuffer.data(), options.width, options.height);
+    rdrSetThreadCount(renderer, options.threadCount);
+    if (options.tileSize > 0)
+        rdrSetTileSize(renderer, options.tileSize);
+
+    char currentDir[4096];
+    if (options.workDir && getcwd(currentDir, sizeof(currentDir)) == nullptr)
+    {
+        fprintf(stderr, "Cannot get the current directory\n");
+        rdrShutdown(renderer);
+        return 1;
+    }
+
+    std::vector<AssetLoad> loads;
+    std::vector<Result> results;
+    printf("%-14s %-14s %9s %9s %9s %9s %12s %14s\n", "asset", "config", "mean ms", "p50 ms", "p90 ms", "p99 ms", "Mtris/s", "Mpixels/s");
+    for (int i = 0; i < scnGetAssetCount(); ++i)
+    {
+        const char* assetName = scnGetAssetName(i);
+        if (!isSelected(options.assets, assetName))
+            continue;
+
+        // Assets paths are relative, the output stays relative to the current directory
+        auto start = std::chrono::steady_clock::now();
+        scnImpl* scene = nullptr;
+        if (options.workDir == nullptr || chdir(options.workDir) == 0)
+        {
+            scene = scnCreateWithAsset(assetName);
+            if (options.workDir && chdir(currentDir) != 0)
+            {
+                fprintf(stderr, "Cannot change directory back to %s\n", currentDir);
+                scnDestroy(scene);
+                rdrShutdown(renderer);
+                return 1;
+            }
+        }
+        double loadTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        loads.push_back({ assetName, scene != nullptr, loadTime });
+
+        if (scene == nullptr)
+        {
+            printf("%-14s skipped, cannot be loaded\n", assetName);
+            continue;
+        }
+
+        for (const Config& config : configs)
+        {
+            if (!isSelected(options.configs, config.name))
+                continue;
+
+            Result result = runBenchmark(renderer, scene, options, assetName, config);
+            printf("%-14s %-14s %9.2f %9.2f %9.2f %9.2f %12.2f %14.2f\n", assetName, config.name,
+                result.times.mean, result.times.p50, result.times.p90, result.times.p99,
+                result.trianglesPerSecond / 1e6, result.shadedPixelsPerSecond / 1e6);
+            results.push_back(result);
+        }
+
+        scnDestroy(scene);
+    }
+
+    // Same fallback as the renderer for 0
+    int threadCount = options.threadCount;
+    if (threadCount <= 0)
+        threadCount = (int)std::max(std::thread::hardware_concurrency(), 1u);
+
+    bool success = writeJson(options.output, options, threadCount, loads, results);
+    if (!success)
+        fprintf(stderr, "Cannot write %s\n", options.output);
+
+    rdrShutdown(renderer);
+    return success ? 0 : 1;
+}
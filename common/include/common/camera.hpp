@@ -19,6 +19,10 @@ struct Camera
     Camera(int width, int height);
 
     void update(float deltaTime, const CameraInputs& inputs);
+
+    // Angles in radians
+    void setTransform(const float3& position, float pitch, float yaw);
+    void setPerspective(float fovY, float near, float far);
     mat4x4 getViewMatrix();
     mat4x4 getProjection();
 
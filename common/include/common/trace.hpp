@@ -0,0 +1,52 @@
+#pragma once
+
+// Scoped timers, recorded by the renderer for rdrTraceWrite()
+// They only exist when RDR_TRACE is defined in every project (make TRACE=1), and compile to nothing otherwise
+//
+//   void drawThings()
+//   {
+//       TRACE_SCOPE("Draw Things"); // Name must be a string literal, only its address is stored
+//       ...
+//   }
+
+#ifdef RDR_TRACE
+
+#include <chrono>
+
+#include <rdr/renderer.h>
+
+struct TraceScope
+{
+    explicit TraceScope(const char* name)
+        : name(name)
+        , start(getTraceTime())
+    {
+    }
+
+    ~TraceScope()
+    {
+        rdrTraceRecord(name, start, getTraceTime());
+    }
+
+    // Nanoseconds, the same clock in every module
+    static unsigned long long getTraceTime()
+    {
+        return (unsigned long long)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+private:
+    const char* name;
+    unsigned long long start;
+};
+
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+#define TRACE_THREAD_NAME(name) rdrTraceSetThreadName(name)
+
+#else
+
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_THREAD_NAME(name) ((void)0)
+
+#endif
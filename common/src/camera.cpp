@@ -49,6 +49,20 @@ void Camera::update(float deltaTime, const CameraInputs& inputs)
     position.y += verticalMovement;
 }
 
+void Camera::setTransform(const float3& position, float pitch, float yaw)
+{
+    this->position = position;
+    this->pitch = pitch;
+    this->yaw = yaw;
+}
+
+void Camera::setPerspective(float fovY, float near, float far)
+{
+    this->fovY = fovY;
+    this->near = near;
+    this->far = far;
+}
+
 mat4x4 Camera::getViewMatrix()
 {
     return mat4::rotateX(pitch) * mat4::rotateY(yaw) * mat4::translate(-position);
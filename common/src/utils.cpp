@@ -1,5 +1,3 @@
-#pragma once
-
 #include <cassert>
 #include <iostream>
 #include <fstream>
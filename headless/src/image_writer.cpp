@@ -0,0 +1,262 @@
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "image_writer.hpp"
+
+static float halfToFloat(unsigned short half)
+{
+    int exponent = (half >> 10) & 0x1f;
+    int mantissa = half & 0x3ff;
+    float magnitude;
+    if (exponent == 0)
+        magnitude = ldexpf((float)mantissa, -24);
+    else if (exponent == 31)
+        magnitude = mantissa ? NAN : INFINITY;
+    else
+        magnitude = ldexpf((float)(mantissa | 0x400), exponent - 25);
+    return (half & 0x8000) ? -magnitude : magnitude;
+}
+
+void readColorBuffer(Image& image, const void* colorBuffer, int width, int height, rdrColorFormat format)
+{
+    image.width = width;
+    image.height = height;
+    image.pixels.resize((size_t)width * height * 4);
+
+    size_t count = image.pixels.size();
+    switch (format)
+    {
+    case RDR_COLOR_FORMAT_RGBA8:
+        for (size_t i = 0; i < count; ++i)
+            image.pixels[i] = static_cast<const unsigned char*>(colorBuffer)[i] / 255.f;
+        break;
+
+    case RDR_COLOR_FORMAT_RGBA16F:
+        for (size_t i = 0; i < count; ++i)
+            image.pixels[i] = halfToFloat(static_cast<const unsigned short*>(colorBuffer)[i]);
+        break;
+
+    default:
+        memcpy(image.pixels.data(), colorBuffer, count * sizeof(float));
+        break;
+    }
+}
+
+static unsigned char toByte(float value)
+{
+    // Same rounding as the RGBA8 color format, so 8 bits buffers are written back unchanged
+    return (unsigned char)((value < 0.f ? 0.f : value > 1.f ? 1.f : value) * 255.f + 0.5f);
+}
+
+static bool writeFile(const char* filename, const std::vector<unsigned char>& data)
+{
+    FILE* file = fopen(filename, "wb");
+    if (file == nullptr)
+        return false;
+
+    bool written = fwrite(data.data(), 1, data.size(), file) == data.size();
+    return fclose(file) == 0 && written;
+}
+
+static void append(std::vector<unsigned char>& data, const void* bytes, size_t size)
+{
+    data.insert(data.end(), static_cast<const unsigned char*>(bytes), static_cast<const unsigned char*>(bytes) + size);
+}
+
+bool writePpm(const Image& image, const char* filename)
+{
+    std::vector<unsigned char> data;
+    char header[64];
+    int headerSize = snprintf(header, sizeof(header), "P6\n%d %d\n255\n", image.width, image.height);
+    append(data, header, headerSize);
+
+    for (size_t i = 0; i < image.pixels.size(); i += 4)
+        for (int c = 0; c < 3; ++c)
+            data.push_back(toByte(image.pixels[i + c]));
+
+    return writeFile(filename, data);
+}
+
+// PNG
+
+static unsigned int crc32(const unsigned char* bytes, size_t size, unsigned int crc = 0)
+{
+    static unsigned int table[256];
+    if (table[1] == 0)
+    {
+        for (unsigned int i = 0; i < 256; ++i)
+        {
+            unsigned int value = i;
+            for (int k = 0; k < 8; ++k)
+                value = (value & 1) ? 0xedb88320u ^ (value >> 1) : value >> 1;
+            table[i] = value;
+        }
+    }
+
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i)
+        crc = table[(crc ^ bytes[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+static void appendBigEndian(std::vector<unsigned char>& data, unsigned int value)
+{
+    unsigned char bytes[4] = { (unsigned char)(value >> 24), (unsigned char)(value >> 16), (unsigned char)(value >> 8), (unsigned char)value };
+    append(data, bytes, 4);
+}
+
+static void appendPngChunk(std::vector<unsigned char>& data, const char* type, const std::vector<unsigned char>& content)
+{
+    appendBigEndian(data, (unsigned int)content.size());
+    size_t typeOffset = data.size();
+    append(data, type, 4);
+    append(data, content.data(), content.size());
+    appendBigEndian(data, crc32(&data[typeOffset], data.size() - typeOffset));
+}
+
+// The image data is stored without compression, in a valid zlib stream, so no zlib is needed
+bool writePng(const Image& image, const char* filename)
+{
+    std::vector<unsigned char> data;
+    static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    append(data, signature, sizeof(signature));
+
+    std::vector<unsigned char> header;
+    appendBigEndian(header, (unsigned int)image.width);
+    appendBigEndian(header, (unsigned int)image.height);
+    static const unsigned char format[5] = { 8, 2, 0, 0, 0 }; // 8 bits RGB, default compression and filter, no interlacing
+    append(header, format, sizeof(format));
+    appendPngChunk(data, "IHDR", header);
+
+    // Each row starts with its filter type, 0 is none
+    std::vector<unsigned char> rows;
+    rows.reserve((size_t)image.height * (image.width * 3 + 1));
+    for (int y = 0; y < image.height; ++y)
+    {
+        rows.push_back(0);
+        const float* row = &image.pixels[(size_t)y * image.width * 4];
+        for (int x = 0; x < image.width; ++x)
+            for (int c = 0; c < 3; ++c)
+                rows.push_back(toByte(row[x * 4 + c]));
+    }
+
+    std::vector<unsigned char> stream = { 0x78, 0x01 };
+    unsigned int adlerA = 1;
+    unsigned int adlerB = 0;
+    for (size_t offset = 0; offset < rows.size(); offset += 0xffff)
+    {
+        size_t size = rows.size() - offset < 0xffff ? rows.size() - offset : 0xffff;
+        bool last = offset + size == rows.size();
+        unsigned char blockHeader[5] = {
+            (unsigned char)(last ? 1 : 0),
+            (unsigned char)size, (unsigned char)(size >> 8),
+            (unsigned char)~size, (unsigned char)(~size >> 8)
+        };
+        append(stream, blockHeader, sizeof(blockHeader));
+        append(stream, &rows[offset], size);
+
+        for (size_t i = offset; i < offset + size; ++i)
+        {
+            adlerA = (adlerA + rows[i]) % 65521;
+            adlerB = (adlerB + adlerA) % 65521;
+        }
+    }
+    appendBigEndian(stream, (adlerB << 16) | adlerA);
+    appendPngChunk(data, "IDAT", stream);
+
+    appendPngChunk(data, "IEND", {});
+    return writeFile(filename, data);
+}
+
+// EXR
+
+static void appendExrAttribute(std::vector<unsigned char>& data, const char* name, const char* type, const void* value, int size)
+{
+    append(data, name, strlen(name) + 1);
+    append(data, type, strlen(type) + 1);
+    append(data, &size, 4);
+    append(data, value, size);
+}
+
+// Single part scanline file, without compression, channels are stored in alphabetical order
+// Values are written as they are in memory, so only little endian hosts are supported
+bool writeExr(const Image& image, const char* filename)
+{
+    std::vector<unsigned char> data;
+    static const unsigned char magic[8] = { 0x76, 0x2f, 0x31, 0x01, 2, 0, 0, 0 };
+    append(data, magic, sizeof(magic));
+
+    static const char* channelNames[4] = { "A", "B", "G", "R" };
+    static const int channelIndices[4] = { 3, 2, 1, 0 };
+    std::vector<unsigned char> channels;
+    for (const char* name : channelNames)
+    {
+        append(channels, name, strlen(name) + 1);
+        int pixelType = 2; // FLOAT
+        unsigned char linear[4] = {};
+        int sampling[2] = { 1, 1 };
+        append(channels, &pixelType, 4);
+        append(channels, linear, 4);
+        append(channels, sampling, 8);
+    }
+    channels.push_back(0);
+    appendExrAttribute(data, "channels", "chlist", channels.data(), (int)channels.size());
+
+    unsigned char compression = 0;
+    appendExrAttribute(data, "compression", "compression", &compression, 1);
+    int window[4] = { 0, 0, image.width - 1, image.height - 1 };
+    appendExrAttribute(data, "dataWindow", "box2i", window, sizeof(window));
+    appendExrAttribute(data, "displayWindow", "box2i", window, sizeof(window));
+    unsigned char lineOrder = 0; // Increasing y
+    appendExrAttribute(data, "lineOrder", "lineOrder", &lineOrder, 1);
+    float pixelAspectRatio = 1.f;
+    appendExrAttribute(data, "pixelAspectRatio", "float", &pixelAspectRatio, 4);
+    float screenWindowCenter[2] = { 0.f, 0.f };
+    appendExrAttribute(data, "screenWindowCenter", "v2f", screenWindowCenter, sizeof(screenWindowCenter));
+    float screenWindowWidth = 1.f;
+    appendExrAttribute(data, "screenWindowWidth", "float", &screenWindowWidth, 4);
+    data.push_back(0);
+
+    // One line per block, the offset table comes first
+    int lineSize = image.width * 4 * (int)sizeof(float);
+    unsigned long long offset = data.size() + (size_t)image.height * 8;
+    for (int y = 0; y < image.height; ++y)
+    {
+        append(data, &offset, 8);
+        offset += 8 + lineSize;
+    }
+
+    for (int y = 0; y < image.height; ++y)
+    {
+        append(data, &y, 4);
+        append(data, &lineSize, 4);
+        const float* row = &image.pixels[(size_t)y * image.width * 4];
+        for (int channel : channelIndices)
+            for (int x = 0; x < image.width; ++x)
+                append(data, &row[x * 4 + channel], 4);
+    }
+
+    return writeFile(filename, data);
+}
+
+bool writeImage(const Image& image, const char* filename)
+{
+    std::string name = filename;
+    size_t dot = name.find_last_of('.');
+    std::string extension = dot == std::string::npos ? "" : name.substr(dot + 1);
+    for (char& c : extension)
+        c = (char)tolower((unsigned char)c);
+
+    if (extension == "png")
+        return writePng(image, filename);
+    if (extension == "ppm")
+        return writePpm(image, filename);
+    if (extension == "exr")
+        return writeExr(image, filename);
+
+    fprintf(stderr, "Unknown image format '%s', expected .png, .ppm or .exr\n", filename);
+    return false;
+}
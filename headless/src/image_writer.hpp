@@ -0,0 +1,24 @@
+#pragma once
+
+#include <vector>
+
+#include <rdr/renderer.h>
+
+// Linear RGBA pixels, rows from top to bottom
+struct Image
+{
+    int width = 0;
+    int height = 0;
+    std::vector<float> pixels;
+};
+
+// Decodes a color buffer written by the renderer
+void readColorBuffer(Image& image, const void* colorBuffer, int width, int height, rdrColorFormat format);
+
+// PNG and PPM store 8 bits RGB, clamped to [0, 1]; EXR stores 32 bits float RGBA
+// The format is picked from the extension of filename, returns false on unknown extension or I/O error
+bool writeImage(const Image& image, const char* filename);
+
+bool writePpm(const Image& image, const char* filename);
+bool writePng(const Image& image, const char* filename);
+bool writeExr(const Image& image, const char* filename);
@@ -0,0 +1,337 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#define chdir _chdir
+#define getcwd _getcwd
+#else
+#include <unistd.h>
+#endif
+
+#include <rdr/renderer.h>
+#include <scn/scene.h>
+
+#include <common/maths.hpp>
+#include <common/camera.hpp>
+#include <common/trace.hpp>
+
+#include "image_writer.hpp"
+
+// Renders the scene without any window or GL context, into buffers in RAM, and writes the result to image files
+struct Options
+{
+    const char* output = "out.png";
+    const char* workDir = nullptr;
+    int frames = 1;
+    int width = 1280;
+    int height = 720;
+    float deltaTime = 1.f / 60.f;
+    int threadCount = 0;
+    int tileSize = 0;
+    int gridSize = 1;
+    rdrColorFormat colorFormat = RDR_COLOR_FORMAT_RGBA32F;
+    rdrDepthFormat depthFormat = RDR_DEPTH_FORMAT_D32F;
+    rdrDebugOutput debugOutput = RDR_DEBUG_OUTPUT_NONE;
+    const char* traceFile = nullptr;
+    int traceFirstFrame = 0;
+    int traceLastFrame = -1; // Up to the last frame
+
+    // Same defaults as the app camera
+    float3 position = { 0.175f, 0.474f, 1.773f };
+    float pitch = 0.f; // In degrees
+    float yaw = 0.f;
+    float fovY = 60.f;
+    float near = 0.01f;
+    float far = 10.f;
+    float4 clearColor = { 0.f, 0.f, 0.f, 1.f };
+};
+
+static void printUsage(const char* program)
+{
+    printf("Usage: %s [options]\n", program);
+    printf("  -o, --output FILE        .png, .ppm or .exr, a %%d in the name writes every frame,\n"
+           "                           replaced by the frame index on 4 digits (default out.png)\n");
+    printf("  -n, --frames N           Frames to render, the scene is animated between them (default 1)\n");
+    printf("  --size WxH               Framebuffer size (default 1280x720)\n");
+    printf("  --dt SECONDS             Scene time step per frame (default 1/60)\n");
+    printf("  --camera X,Y,Z,PITCH,YAW Camera position and angles in degrees\n");
+    printf("  --fov DEGREES            Vertical field of view (default 60)\n");
+    printf("  --clip NEAR,FAR          Clip planes distances (default 0.01,10)\n");
+    printf("  --clear R,G,B,A          Clear color (default 0,0,0,1)\n");
+    printf("  --threads N              Render threads, 0 is one per core (default 0)\n");
+    printf("  --tile-size N            Tile size of the tiled backend, in pixels\n");
+    printf("  --grid N                 Draws the asset N x N times, objects out of the view are culled (default 1)\n");
+    printf("  --color-format F         rgba32f, rgba16f or rgba8 (default rgba32f)\n");
+    printf("  --depth-format F         d32f, d16 or d24 (default d32f)\n");
+    printf("  --debug-output F         none or overdraw, a heatmap of how many times each pixel was written (default none)\n");
+    printf("  --trace FILE             Writes a Chrome trace of the pipeline stages, needs a build with RDR_TRACE (make TRACE=1)\n");
+    printf("  --trace-frames FIRST,LAST Frames written to the trace (default all)\n");
+    printf("  -C, --workdir DIR        Directory the scene assets are loaded from, e.g. app (default: current)\n");
+}
+
+// Parses count comma separated floats
+static bool parseFloats(const char* text, float* values, int count)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        char* end;
+        values[i] = strtof(text, &end);
+        if (end == text || *end != (i == count - 1 ? '\0' : ','))
+            return false;
+        text = end + 1;
+    }
+    return true;
+}
+
+static bool parseOptions(int argc, char* argv[], Options& options)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        const char* arg = argv[i];
+        if (strcmp(arg, "--help") == 0)
+            return false;
+
+        if (i + 1 >= argc)
+        {
+            fprintf(stderr, "Unknown option or missing value: %s\n", arg);
+            return false;
+        }
+        const char* value = argv[++i];
+
+        bool valid = true;
+        if (strcmp(arg, "-o") == 0 || strcmp(arg, "--output") == 0)
+        {
+            options.output = value;
+        }
+        else if (strcmp(arg, "-C") == 0 || strcmp(arg, "--workdir") == 0)
+        {
+            options.workDir = value;
+        }
+        else if (strcmp(arg, "-n") == 0 || strcmp(arg, "--frames") == 0)
+        {
+            options.frames = atoi(value);
+            valid = options.frames > 0;
+        }
+        else if (strcmp(arg, "--size") == 0)
+        {
+            valid = sscanf(value, "%dx%d", &options.width, &options.height) == 2 && options.width > 0 && options.height > 0;
+        }
+        else if (strcmp(arg, "--dt") == 0)
+        {
+            valid = parseFloats(value, &options.deltaTime, 1);
+        }
+        else if (strcmp(arg, "--camera") == 0)
+        {
+            float camera[5];
+            valid = parseFloats(value, camera, 5);
+            options.position = { camera[0], camera[1], camera[2] };
+            options.pitch = camera[3];
+            options.yaw = camera[4];
+        }
+        else if (strcmp(arg, "--fov") == 0)
+        {
+            valid = parseFloats(value, &options.fovY, 1);
+        }
+        else if (strcmp(arg, "--clip") == 0)
+        {
+            float clip[2];
+            valid = parseFloats(value, clip, 2);
+            options.near = clip[0];
+            options.far = clip[1];
+        }
+        else if (strcmp(arg, "--clear") == 0)
+        {
+            valid = parseFloats(value, options.clearColor.e, 4);
+        }
+        else if (strcmp(arg, "--threads") == 0)
+        {
+            options.threadCount = atoi(value);
+        }
+        else if (strcmp(arg, "--tile-size") == 0)
+        {
+            options.tileSize = atoi(value);
+        }
+        else if (strcmp(arg, "--grid") == 0)
+        {
+            options.gridSize = atoi(value);
+            valid = options.gridSize > 0;
+        }
+        else if (strcmp(arg, "--color-format") == 0)
+        {
+            if (strcmp(value, "rgba32f") == 0)      options.colorFormat = RDR_COLOR_FORMAT_RGBA32F;
+            else if (strcmp(value, "rgba16f") == 0) options.colorFormat = RDR_COLOR_FORMAT_RGBA16F;
+            else if (strcmp(value, "rgba8") == 0)   options.colorFormat = RDR_COLOR_FORMAT_RGBA8;
+            else valid = false;
+        }
+        else if (strcmp(arg, "--depth-format") == 0)
+        {
+            if (strcmp(value, "d32f") == 0)     options.depthFormat = RDR_DEPTH_FORMAT_D32F;
+            else if (strcmp(value, "d16") == 0) options.depthFormat = RDR_DEPTH_FORMAT_D16;
+            else if (strcmp(value, "d24") == 0) options.depthFormat = RDR_DEPTH_FORMAT_D24;
+            else valid = false;
+        }
+        else if (strcmp(arg, "--debug-output") == 0)
+        {
+            if (strcmp(value, "none") == 0)          options.debugOutput = RDR_DEBUG_OUTPUT_NONE;
+            else if (strcmp(value, "overdraw") == 0) options.debugOutput = RDR_DEBUG_OUTPUT_OVERDRAW;
+            else valid = false;
+        }
+        else if (strcmp(arg, "--trace") == 0)
+        {
+            options.traceFile = value;
+        }
+        else if (strcmp(arg, "--trace-frames") == 0)
+        {
+            valid = sscanf(value, "%d,%d", &options.traceFirstFrame, &options.traceLastFrame) == 2
+                && options.traceFirstFrame >= 0 && options.traceLastFrame >= options.traceFirstFrame;
+        }
+        else
+        {
+            fprintf(stderr, "Unknown option: %s\n", arg);
+            return false;
+        }
+
+        if (!valid)
+        {
+            fprintf(stderr, "Invalid value for %s: %s\n", arg, value);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Replaces the %d of the output name by the frame index
+static std::string getFrameFilename(const char* output, int frame)
+{
+    std::string filename = output;
+    size_t pattern = filename.find("%d");
+    if (pattern != std::string::npos)
+    {
+        char index[16];
+        snprintf(index, sizeof(index), "%04d", frame);
+        filename.replace(pattern, 2, index);
+    }
+    return filename;
+}
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    if (!parseOptions(argc, argv, options))
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+    TRACE_THREAD_NAME("Main");
+
+    // In-RAM buffers, sized for the largest formats
+    size_t pixelCount = (size_t)options.width * options.height;
+    std::vector<float4> colorBuffer(pixelCount);
+    std::vector<float> depthBuffer(pixelCount);
+
+    rdrFramebufferDesc framebufferDesc = {};
+    framebufferDesc.colorBuffer = colorBuffer.data();
+    framebufferDesc.depthBuffer = depthBuffer.data();
+    framebufferDesc.width = options.width;
+    framebufferDesc.height = options.height;
+    framebufferDesc.colorFormat = options.colorFormat;
+    framebufferDesc.depthFormat = options.depthFormat;
+    rdrImpl* renderer = rdrInitEx(&framebufferDesc);
+
+    rdrSetThreadCount(renderer, options.threadCount);
+    if (options.tileSize > 0)
+        rdrSetTileSize(renderer, options.tileSize);
+    rdrSetDebugOutput(renderer, options.debugOutput);
+
+    // Assets paths are relative, outputs stay relative to the current directory
+    char currentDir[4096];
+    if (options.workDir && (getcwd(currentDir, sizeof(currentDir)) == nullptr || chdir(options.workDir) != 0))
+    {
+        fprintf(stderr, "Cannot change directory to %s\n", options.workDir);
+        rdrShutdown(renderer);
+        return 1;
+    }
+    scnImpl* scene = scnCreate();
+    if (options.workDir && chdir(currentDir) != 0)
+    {
+        fprintf(stderr, "Cannot change directory back to %s\n", currentDir);
+        scnDestroy(scene);
+        rdrShutdown(renderer);
+        return 1;
+    }
+
+    // The first frame shows the whole scene
+    if (scnWaitForLoading(scene) == SCN_LOAD_STATE_FAILED)
+    {
+        fprintf(stderr, "Cannot load the scene\n");
+        scnDestroy(scene);
+        rdrShutdown(renderer);
+        return 1;
+    }
+
+    scnSetGridSize(scene, options.gridSize);
+
+    Camera camera(options.width, options.height);
+    camera.setTransform(options.position, maths::toRadians(options.pitch), maths::toRadians(options.yaw));
+    camera.setPerspective(maths::toRadians(options.fovY), options.near, options.far);
+    mat4x4 projection = camera.getProjection();
+    mat4x4 view = camera.getViewMatrix();
+
+    bool writeEveryFrame = strstr(options.output, "%d") != nullptr;
+    bool success = true;
+    double totalTime = 0.0;
+    Image image;
+    for (int frame = 0; frame < options.frames && success; ++frame)
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        rdrClear(renderer, options.clearColor.e);
+        rdrBeginFrame(renderer);
+        rdrSetProjection(renderer, projection.e);
+        rdrSetView(renderer, view.e);
+        rdrSetBackground(renderer, options.clearColor.e);
+
+        // The first frame shows the scene at time 0
+        scnSetCamera(scene, projection.e, view.e);
+        scnUpdate(scene, frame == 0 ? 0.f : options.deltaTime, renderer);
+        rdrEndFrame(renderer);
+
+        totalTime += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        if (writeEveryFrame || frame == options.frames - 1)
+        {
+            std::string filename = getFrameFilename(options.output, frame);
+            readColorBuffer(image, colorBuffer.data(), options.width, options.height, options.colorFormat);
+            success = writeImage(image, filename.c_str());
+            if (!success)
+                fprintf(stderr, "Cannot write %s\n", filename.c_str());
+        }
+    }
+
+    printf("%d frames of %dx%d in %.2f ms, %.2f ms per frame\n", options.frames, options.width, options.height, totalTime, totalTime / options.frames);
+
+    scnCullStats cullStats;
+    scnGetCullStats(scene, &cullStats);
+    printf("%d objects in the last frame, %d visible, %d culled\n", cullStats.objects, cullStats.visibleObjects, cullStats.culledObjects);
+
+    // Frames are counted by the renderer since the start, asset loading belongs to frame 0
+    if (options.traceFile && success)
+    {
+        int lastFrame = options.traceLastFrame < 0 ? options.frames - 1 : options.traceLastFrame;
+        if (!rdrTraceWrite(options.traceFile, options.traceFirstFrame, lastFrame))
+        {
+            fprintf(stderr, "Cannot write %s, the trace is only recorded by builds with RDR_TRACE\n", options.traceFile);
+            success = false;
+        }
+    }
+
+    scnDestroy(scene);
+    rdrShutdown(renderer);
+
+    return success ? 0 : 1;
+}
@@ -1,10 +1,17 @@
 #pragma once
 
+#if defined(_WIN32)
 #ifdef RDR_EXPORTS
 #define RDR_API __declspec(dllexport)
 #else
 #define RDR_API __declspec(dllimport)
 #endif
+#else
+// Shared libraries are built with hidden visibility, only the API is exported
+#define RDR_API __attribute__((visibility("default")))
+#endif
+
+#include <stddef.h>
 
 #ifdef __cplusplus
 extern "C"
@@ -43,33 +50,213 @@ typedef struct rdrMaterial
     float specular[4];
 } rdrMaterial;
 
+typedef enum rdrColorFormat
+{
+    RDR_COLOR_FORMAT_RGBA32F, // 4 x 32 bits float
+    RDR_COLOR_FORMAT_RGBA16F, // 4 x 16 bits half float
+    RDR_COLOR_FORMAT_RGBA8,   // 4 x 8 bits unorm, red in the first byte, clamped to [0, 1]
+} rdrColorFormat;
+
+// A depth buffer filled with zeros is cleared to the far plane, whatever its format
+typedef enum rdrDepthFormat
+{
+    RDR_DEPTH_FORMAT_D32F, // 32 bits float, from -1 (near) to 0 (far)
+    RDR_DEPTH_FORMAT_D16,  // 16 bits unorm, from 65535 (near) to 0 (far)
+    RDR_DEPTH_FORMAT_D24,  // 24 bits unorm in the low bits of 32 bits words, from 2^24 - 1 (near) to 0 (far)
+} rdrDepthFormat;
+
+typedef struct rdrFramebufferDesc
+{
+    void* colorBuffer;
+    void* depthBuffer;
+    int width;
+    int height;
+    rdrColorFormat colorFormat;
+    rdrDepthFormat depthFormat;
+} rdrFramebufferDesc;
+
 // Init/Shutdown function
 // Color and depth buffer have to be valid until the shutdown of the renderer
-// Color buffer is RGBA, each component is a 32 bits float
-// Depth buffer is a buffer of 32bits floats
+// Colors are converted to the color format when written, the color buffer is never read
+RDR_API rdrImpl* rdrInitEx(const rdrFramebufferDesc* desc);
+
+// Same as rdrInitEx() with RGBA32F color and D32F depth
 RDR_API rdrImpl* rdrInit(float* colorBuffer32Bits, float* depthBuffer, int width, int height);
 RDR_API void rdrShutdown(rdrImpl* renderer);
 
+// Renders the next frames into other buffers, e.g. to cycle through a ring of framebuffers
+// Call between frames, before rdrClear(). The viewport is only reset if the size changes
+// The lazy clear of rdrClear() remembers each buffer of the same size and formats, so they must not be written elsewhere either
+RDR_API void rdrSetFramebuffer(rdrImpl* renderer, const rdrFramebufferDesc* desc);
+
+// Clears the color buffer to color (RGBA) and the depth buffer to the far plane
+// The clear is lazy: each 8x8 block is only written once something is drawn to it, or by rdrEndFrame() if nothing was,
+// and blocks still holding the same clear values are not written again.
+// For this to work, the buffers must only be written by the renderer between two clears
+RDR_API void rdrClear(rdrImpl* renderer, const float* color);
+
+// Call once per frame, after rdrClear() or after the depth buffer has been cleared
+// The renderer keeps a coarse copy of the depth buffer to reject hidden geometry early, it is rebuilt here.
+// Without this call, that early rejection is disabled, unless the frame started with rdrClear()
+RDR_API void rdrBeginFrame(rdrImpl* renderer);
+
+// Call once per frame, after the last draw
+// In deferred mode, this is where the lighting is computed
+RDR_API void rdrEndFrame(rdrImpl* renderer);
+
 // Matrix setup
 RDR_API void rdrSetProjection(rdrImpl* renderer, float* projectionMatrix);
 RDR_API void rdrSetView(rdrImpl* renderer, float* viewMatrix);
 RDR_API void rdrSetModel(rdrImpl* renderer, float* modelMatrix);
 RDR_API void rdrSetViewport(rdrImpl* renderer, int x, int y, int width, int height);
 
+// Lights are indexed from 0 to RDR_MAX_LIGHTS - 1, only light 0 is enabled at init
+// With attenuation, a light stops where it falls below 1/256 of its strength, at minFullAttnDistance * 256.
+// Lights are culled per screen tile with that radius, so many small lights stay cheap
+#define RDR_MAX_LIGHTS 256
 RDR_API void rdrSetUniformLight(rdrImpl* renderer, int index, rdrLight* light);
 
 RDR_API void rdrSetBackground(rdrImpl* renderer, float* bgColor);
 
+// Pipeline options, also shown by rdrShowImGuiControls()
+typedef enum rdrRenderOption
+{
+    RDR_OPTION_WIREFRAME,         // Only the triangle edges are drawn, off by default
+    RDR_OPTION_RGB_INTERPOLATION, // Red, green and blue triangle corners instead of the vertex colors and textures, off
+    RDR_OPTION_DEPTH_TEST,        // On
+    RDR_OPTION_BACKFACE_CULLING,  // On
+    RDR_OPTION_PHONG,             // Lighting per pixel, per vertex (Gouraud) when off, on
+    RDR_OPTION_DEFERRED,          // Phong lighting done once per visible pixel by rdrEndFrame(), off
+    RDR_OPTION_ALPHA_BLENDING,    // Shaded pixels are blended with the background color, see rdrSetAlpha(), on
+} rdrRenderOption;
+
+RDR_API void rdrSetRenderOption(rdrImpl* renderer, rdrRenderOption option, bool enabled);
+
+// Alpha of the shaded pixels, 1 by default
+RDR_API void rdrSetAlpha(rdrImpl* renderer, float alpha);
+
 // Texture setup
-RDR_API void rdrSetTexture(rdrImpl* renderer, float* colors32Bits, int width, int height);
+// Textures are referred to by handles, 0 is never a valid texture
+typedef unsigned int rdrTexture;
+
+// texels are width x height RGBA pixels, 8 bits per component, copied by the renderer
+// Returns 0 if the texture can't be created
+RDR_API rdrTexture rdrCreateTexture(rdrImpl* renderer, const unsigned char* texels, int width, int height);
+RDR_API void rdrDestroyTexture(rdrImpl* renderer, rdrTexture texture);
+
+// Texture data is the renderer own layout of the texels and their mip levels, to be cached instead of decoding the image again
+// It only depends on the size of the texture and on RDR_TEXTURE_DATA_VERSION, changed each time the layout changes
+#define RDR_TEXTURE_DATA_VERSION 1
+
+// Returns the size of the texture data in bytes, 0 if texture is not valid, and copies the data if data is not null
+RDR_API size_t rdrGetTextureData(rdrImpl* renderer, rdrTexture texture, void* data);
+// data was returned by rdrGetTextureData() for a texture of the same size, e.g. read or mapped from a file, 4 bytes aligned
+// It is used in place and has to stay valid until the texture is destroyed
+// Returns 0 if size does not match the texture size
+RDR_API rdrTexture rdrCreateTextureFromData(rdrImpl* renderer, const void* data, size_t size, int width, int height);
+
+// Texture used by the next draws, 0 to draw with the vertex colors
+RDR_API void rdrBindTexture(rdrImpl* renderer, rdrTexture texture);
+
+typedef enum rdrTextureFilter
+{
+    RDR_TEXTURE_FILTER_NEAREST,
+    RDR_TEXTURE_FILTER_BILINEAR,
+    RDR_TEXTURE_FILTER_TRILINEAR, // Bilinear, blended between the two nearest mip levels
+} rdrTextureFilter;
+
+typedef enum rdrTextureWrap
+{
+    RDR_TEXTURE_WRAP_REPEAT,
+    RDR_TEXTURE_WRAP_CLAMP,
+} rdrTextureWrap;
+
+// How the next draws sample the bound texture, trilinear and repeat by default
+// Textures are sampled per pixel, mip levels are built by rdrCreateTexture()
+RDR_API void rdrSetTextureSampling(rdrImpl* renderer, rdrTextureFilter filter, rdrTextureWrap wrap);
 
 // Draw a list of triangles
 RDR_API void rdrDrawTriangles(rdrImpl* renderer, rdrVertex* vertices, int vertexCount);
 
+// Draw a list of indexed triangles, every 3 indices in the vertices array make a triangle
+// Each vertex is transformed and lit once, whatever the number of triangles sharing it
+// Triangles with an index out of [0, vertexCount) are skipped
+RDR_API void rdrDrawIndexed(rdrImpl* renderer, rdrVertex* vertices, int vertexCount, unsigned int* indices, int indexCount);
+
+// Tiled backend setup
+// Triangles are binned into square screen tiles of tileSize pixels, and the tiles are rasterized in parallel
+// The result does not depend on the thread count or the tile size
+// threadCount includes the calling thread, 0 means one thread per hardware core
+RDR_API void rdrSetThreadCount(rdrImpl* renderer, int threadCount);
+RDR_API void rdrSetTileSize(rdrImpl* renderer, int tileSize);
+
+// Early depth rejection counters, since the last rdrBeginFrame()
+typedef struct rdrDepthCullStats
+{
+    unsigned long long trianglesTested;       // Against the tiles covered by the triangle, before binning
+    unsigned long long trianglesRejected;
+    unsigned long long tileTrianglesTested;   // Against each tile, before rasterization
+    unsigned long long tileTrianglesRejected;
+    unsigned long long blocksTested;          // Against each raster block, before any per-pixel work
+    unsigned long long blocksRejected;
+    unsigned long long blocksAccepted;        // Known to pass the depth test, no per-pixel compare needed
+} rdrDepthCullStats;
+
+RDR_API void rdrGetDepthCullStats(rdrImpl* renderer, rdrDepthCullStats* stats);
+
+// Pipeline counters, since the last rdrBeginFrame(), cheap enough to always be counted
+// Pixels of the blocks rejected early (see rdrDepthCullStats) and wireframe lines are not counted
+typedef struct rdrStats
+{
+    unsigned long long trianglesSubmitted;      // By the draw calls, before clipping
+    unsigned long long trianglesBackfaceCulled;
+    unsigned long long trianglesOutside;        // Entirely outside one of the frustum planes
+    unsigned long long pixelsCovered;           // By filled triangles, before the depth test
+    unsigned long long depthTestsPassed;
+    unsigned long long depthTestsFailed;
+    unsigned long long pixelsShaded;            // Lit and written, in deferred mode once per visible pixel by rdrEndFrame()
+} rdrStats;
+
+RDR_API void rdrGetStats(rdrImpl* renderer, rdrStats* stats);
+
+typedef enum rdrDebugOutput
+{
+    RDR_DEBUG_OUTPUT_NONE,
+    RDR_DEBUG_OUTPUT_OVERDRAW, // rdrEndFrame() replaces the colors by a heatmap of how many times each pixel was written since rdrBeginFrame()
+} rdrDebugOutput;
+
+RDR_API void rdrSetDebugOutput(rdrImpl* renderer, rdrDebugOutput output);
+
+// Trace of the pipeline stages, written in the Chrome trace event format (chrome://tracing, Perfetto)
+// Only recorded when every project is built with RDR_TRACE defined, see common/trace.hpp for the scoped timers
+// Each thread keeps its last RDR_TRACE_CAPACITY events
+// Frames are counted from 0 by rdrEndFrame(), over all the renderers
+#define RDR_TRACE_CAPACITY 65536
+
+// name must stay valid until the trace is written, e.g. a string literal; times are in ns
+RDR_API void rdrTraceRecord(const char* name, unsigned long long startNs, unsigned long long endNs);
+// Names the calling thread in the trace
+RDR_API void rdrTraceSetThreadName(const char* name);
+// Index of the frame being recorded, 0 without RDR_TRACE
+RDR_API unsigned long long rdrTraceGetFrame();
+// Writes the events of the frames in [firstFrame, lastFrame] still in the buffers
+// Returns false on I/O error or without RDR_TRACE
+RDR_API bool rdrTraceWrite(const char* filename, unsigned long long firstFrame, unsigned long long lastFrame);
+
 struct ImGuiContext;
 RDR_API void rdrSetImGuiContext(rdrImpl* renderer, struct ImGuiContext* context);
 RDR_API void rdrShowImGuiControls(rdrImpl* renderer);
 
+// Same controls for a renderer used by another thread, e.g. a render thread: they show and edit a copy of the settings,
+// exchanged with the renderer by rdrSyncImGuiControls(), so neither thread waits for the other
+typedef struct rdrImGuiControls rdrImGuiControls;
+RDR_API rdrImGuiControls* rdrCreateImGuiControls(rdrImpl* renderer);
+RDR_API void rdrDestroyImGuiControls(rdrImGuiControls* controls);
+// Call from the thread using the renderer, between frames: applies the edits, then copies the settings and the counters
+RDR_API void rdrSyncImGuiControls(rdrImpl* renderer, rdrImGuiControls* controls);
+// Call from the ImGui thread, the edits are applied by the next rdrSyncImGuiControls()
+RDR_API void rdrShowImGuiControlsDeferred(rdrImGuiControls* controls);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,105 @@
+#include <common/maths.hpp>
+
+#include "renderer_impl.hpp"
+#include "depth_hierarchy.hpp"
+
+void resizeDepthHierarchy(DepthHierarchy& hiZ, int width, int height)
+{
+    hiZ.blockCountX = (width + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    hiZ.blockCountY = (height + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    hiZ.blockMin.resize(hiZ.blockCountX * hiZ.blockCountY);
+    hiZ.blockMax.resize(hiZ.blockCountX * hiZ.blockCountY);
+    hiZ.valid = false;
+}
+
+void updateDepthBlock(DepthHierarchy& hiZ, const Framebuffer& fb, int blockX, int blockY)
+{
+    int x0 = blockX * BLOCK_SIZE;
+    int y0 = blockY * BLOCK_SIZE;
+    int x1 = maths::min(x0 + BLOCK_SIZE, fb.width);
+    int y1 = maths::min(y0 + BLOCK_SIZE, fb.height);
+
+    float nearest, farthest;
+    getDepthRange(fb, x0, y0, x1, y1, nearest, farthest);
+
+    int index = blockY * hiZ.blockCountX + blockX;
+    hiZ.blockMin[index] = nearest;
+    hiZ.blockMax[index] = farthest;
+}
+
+void buildDepthBlocks(DepthHierarchy& hiZ, const Framebuffer& fb, const FastClear& clear, int firstRow, int lastRow)
+{
+    for (int blockY = firstRow; blockY <= lastRow; ++blockY)
+    {
+        for (int blockX = 0; blockX < hiZ.blockCountX; ++blockX)
+        {
+            int index = blockY * hiZ.blockCountX + blockX;
+            if (clear.blocks[index] == BlockClear::DRAWN)
+            {
+                updateDepthBlock(hiZ, fb, blockX, blockY);
+            }
+            else
+            {
+                // A pending block may still hold older depths in memory
+                hiZ.blockMin[index] = 0.f;
+                hiZ.blockMax[index] = 0.f;
+            }
+        }
+    }
+}
+
+void updateDepthTile(DepthHierarchy& hiZ, const TileRect& tile, int tileIndex)
+{
+    int minBlockX = tile.minX / BLOCK_SIZE;
+    int minBlockY = tile.minY / BLOCK_SIZE;
+    int maxBlockX = (tile.maxX - 1) / BLOCK_SIZE;
+    int maxBlockY = (tile.maxY - 1) / BLOCK_SIZE;
+
+    float farthest = hiZ.blockMax[minBlockY * hiZ.blockCountX + minBlockX];
+    for (int y = minBlockY; y <= maxBlockY; ++y)
+        for (int x = minBlockX; x <= maxBlockX; ++x)
+            farthest = maths::max(farthest, hiZ.blockMax[y * hiZ.blockCountX + x]);
+
+    hiZ.tileMax[tileIndex] = farthest;
+}
+
+void setDepthTileGrid(DepthHierarchy& hiZ, int tileSize, int tileCountX, int tileCountY)
+{
+    if (hiZ.tileSize == tileSize && hiZ.tileCountX == tileCountX && hiZ.tileCountY == tileCountY)
+        return;
+
+    hiZ.tileSize = tileSize;
+    hiZ.tileCountX = tileCountX;
+    hiZ.tileCountY = tileCountY;
+    hiZ.tileMax.resize(tileCountX * tileCountY);
+
+    int width = hiZ.blockCountX * BLOCK_SIZE;
+    int height = hiZ.blockCountY * BLOCK_SIZE;
+    for (int y = 0; y < tileCountY; ++y)
+    {
+        for (int x = 0; x < tileCountX; ++x)
+        {
+            TileRect tile = {
+                x * tileSize,
+                y * tileSize,
+                maths::min((x + 1) * tileSize, width),
+                maths::min((y + 1) * tileSize, height)
+            };
+            updateDepthTile(hiZ, tile, y * tileCountX + x);
+        }
+    }
+}
+
+float getDepthTilesMax(const DepthHierarchy& hiZ, int minX, int minY, int maxX, int maxY)
+{
+    int minTileX = maths::max(minX / hiZ.tileSize, 0);
+    int minTileY = maths::max(minY / hiZ.tileSize, 0);
+    int maxTileX = maths::min(maxX / hiZ.tileSize, hiZ.tileCountX - 1);
+    int maxTileY = maths::min(maxY / hiZ.tileSize, hiZ.tileCountY - 1);
+
+    float farthest = hiZ.tileMax[minTileY * hiZ.tileCountX + minTileX];
+    for (int y = minTileY; y <= maxTileY; ++y)
+        for (int x = minTileX; x <= maxTileX; ++x)
+            farthest = maths::max(farthest, hiZ.tileMax[y * hiZ.tileCountX + x]);
+    return farthest;
+}
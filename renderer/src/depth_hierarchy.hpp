@@ -0,0 +1,57 @@
+#pragma once
+
+#include <vector>
+
+struct Framebuffer;
+struct FastClear;
+struct TileRect;
+
+// Coarse copy of the depth buffer, used to reject hidden triangles and blocks before any per-pixel work
+// Level 0 keeps the nearest and farthest depth of each raster block,
+// level 1 keeps the farthest depth of each tile of the tiled backend
+// Farthest values may be larger than the real ones (never smaller), nearest values may be smaller (never larger)
+struct DepthHierarchy
+{
+    bool enabled = true;
+
+    // Only valid once built from the depth buffer, see rdrBeginFrame()
+    bool valid = false;
+
+    int blockCountX = 0;
+    int blockCountY = 0;
+    std::vector<float> blockMin;
+    std::vector<float> blockMax;
+
+    int tileSize = 0;
+    int tileCountX = 0;
+    int tileCountY = 0;
+    std::vector<float> tileMax;
+};
+
+// Counted per thread, then summed when queried
+struct DepthCullCounters
+{
+    unsigned long long trianglesTested;
+    unsigned long long trianglesRejected;
+    unsigned long long tileTrianglesTested;
+    unsigned long long tileTrianglesRejected;
+    unsigned long long blocksTested;
+    unsigned long long blocksRejected;
+    unsigned long long blocksAccepted;
+};
+
+void resizeDepthHierarchy(DepthHierarchy& hiZ, int width, int height);
+
+// Recomputes the block level of the block rows [firstRow, lastRow] from the depth buffer
+// Blocks cleared by rdrClear() are known to be at the far plane and are not read
+void buildDepthBlocks(DepthHierarchy& hiZ, const Framebuffer& fb, const FastClear& clear, int firstRow, int lastRow);
+
+// Recomputes nearest and farthest depth of one block from the depth buffer
+void updateDepthBlock(DepthHierarchy& hiZ, const Framebuffer& fb, int blockX, int blockY);
+
+// Resizes the tile level to the given tile grid and rebuilds it from the block level if needed
+void setDepthTileGrid(DepthHierarchy& hiZ, int tileSize, int tileCountX, int tileCountY);
+void updateDepthTile(DepthHierarchy& hiZ, const TileRect& tile, int tileIndex);
+
+// Farthest depth of the tiles overlapping the pixel rect [minX, maxX] x [minY, maxY]
+float getDepthTilesMax(const DepthHierarchy& hiZ, int minX, int minY, int maxX, int maxY);
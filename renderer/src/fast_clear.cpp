@@ -0,0 +1,141 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define RDR_STREAM_CLEAR
+#endif
+
+#include <common/maths.hpp>
+
+#include "renderer_impl.hpp"
+#include "fast_clear.hpp"
+
+void resizeFastClear(FastClear& clear, int width, int height)
+{
+    clear.blockCountX = (width + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    clear.blockCountY = (height + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+    // Nothing is known about the buffers yet
+    clear.blocks.assign(clear.blockCountX * clear.blockCountY, BlockClear::DRAWN);
+    memset(clear.colorTexel, 0, sizeof(clear.colorTexel));
+    clear.colorBuffer = nullptr;
+    clear.depthBuffer = nullptr;
+    clear.otherBuffers.clear();
+}
+
+void setFastClearBuffers(FastClear& clear, const void* colorBuffer, const void* depthBuffer)
+{
+    if (colorBuffer == clear.colorBuffer && depthBuffer == clear.depthBuffer)
+        return;
+
+    FastClearBuffers current = { clear.colorBuffer, clear.depthBuffer };
+    current.blocks.swap(clear.blocks);
+    memcpy(current.colorTexel, clear.colorTexel, sizeof(current.colorTexel));
+
+    clear.colorBuffer = colorBuffer;
+    clear.depthBuffer = depthBuffer;
+    auto it = std::find_if(clear.otherBuffers.begin(), clear.otherBuffers.end(), [&](const FastClearBuffers& buffers)
+    {
+        return buffers.colorBuffer == colorBuffer && buffers.depthBuffer == depthBuffer;
+    });
+    if (it != clear.otherBuffers.end())
+    {
+        clear.blocks.swap(it->blocks);
+        memcpy(clear.colorTexel, it->colorTexel, sizeof(clear.colorTexel));
+        *it = std::move(current);
+    }
+    else
+    {
+        // Nothing is known about these buffers yet
+        clear.blocks.assign(clear.blockCountX * clear.blockCountY, BlockClear::DRAWN);
+        memset(clear.colorTexel, 0, sizeof(clear.colorTexel));
+        if (current.colorBuffer == nullptr)
+            return;
+
+        // Buffers that stopped being used are dropped first
+        if ((int)clear.otherBuffers.size() >= FAST_CLEAR_MAX_OTHER_BUFFERS)
+            clear.otherBuffers.erase(clear.otherBuffers.begin());
+        clear.otherBuffers.push_back(std::move(current));
+    }
+}
+
+bool setClearColor(FastClear& clear, const Framebuffer& fb, const float* color)
+{
+    unsigned char texel[16] = {};
+    Framebuffer texelBuffer = fb;
+    texelBuffer.colorBuffer = texel;
+    storeColor(texelBuffer, 0, { color[0], color[1], color[2], color[3] });
+
+    if (memcmp(texel, clear.colorTexel, sizeof(texel)) == 0)
+        return false;
+
+    memcpy(clear.colorTexel, texel, sizeof(texel));
+    return true;
+}
+
+void clearBlock(const FastClear& clear, const Framebuffer& fb, int blockX, int blockY)
+{
+    int x0 = blockX * BLOCK_SIZE;
+    int y0 = blockY * BLOCK_SIZE;
+    int x1 = maths::min(x0 + BLOCK_SIZE, fb.width);
+    int y1 = maths::min(y0 + BLOCK_SIZE, fb.height);
+
+    int colorSize = getColorSize(fb.colorFormat);
+    int depthSize = getDepthSize(fb.depthFormat);
+    for (int y = y0; y < y1; ++y)
+    {
+        char* color = static_cast<char*>(fb.colorBuffer) + ((size_t)y * fb.width + x0) * colorSize;
+        for (int x = x0; x < x1; ++x, color += colorSize)
+            memcpy(color, clear.colorTexel, colorSize);
+
+        // The far plane is all zero bits in every depth format
+        memset(getDepthAddress(fb, y * fb.width + x0), 0, (size_t)(x1 - x0) * depthSize);
+    }
+}
+
+// Repeats a 16 byte pattern over [dst, dst + size), byte i of the range getting pattern[i % 16]
+static void fillPattern(void* dst, size_t size, const unsigned char pattern[16])
+{
+    unsigned char* bytes = static_cast<unsigned char*>(dst);
+    size_t i = 0;
+
+#ifdef RDR_STREAM_CLEAR
+    // Streaming stores skip the read for ownership of lines that are about to be entirely overwritten
+    size_t head = (16 - ((uintptr_t)bytes & 15)) & 15;
+    if (size >= head + 16)
+    {
+        for (; i < head; ++i)
+            bytes[i] = pattern[i & 15];
+
+        unsigned char rotated[16];
+        for (int j = 0; j < 16; ++j)
+            rotated[j] = pattern[(head + j) & 15];
+        __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rotated));
+
+        for (; i + 16 <= size; i += 16)
+            _mm_stream_si128(reinterpret_cast<__m128i*>(bytes + i), value);
+        _mm_sfence();
+    }
+#endif
+
+    for (; i < size; ++i)
+        bytes[i] = pattern[i & 15];
+}
+
+void streamClearRows(const FastClear& clear, const Framebuffer& fb, int firstRow, int lastRow)
+{
+    size_t pixelOffset = (size_t)firstRow * fb.width;
+    size_t pixelCount = (size_t)(lastRow - firstRow + 1) * fb.width;
+
+    // Every color size divides 16, so the texel repeats within the pattern
+    int colorSize = getColorSize(fb.colorFormat);
+    unsigned char colorPattern[16];
+    for (int i = 0; i < 16; i += colorSize)
+        memcpy(&colorPattern[i], clear.colorTexel, colorSize);
+
+    static const unsigned char depthPattern[16] = {};
+    fillPattern(static_cast<char*>(fb.colorBuffer) + pixelOffset * colorSize, pixelCount * colorSize, colorPattern);
+    fillPattern(getDepthAddress(fb, (int)pixelOffset), pixelCount * getDepthSize(fb.depthFormat), depthPattern);
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <vector>
+
+struct Framebuffer;
+
+// Clear state of one raster block
+enum class BlockClear : unsigned char
+{
+    DRAWN,   // Drawn to since the last clear
+    PENDING, // Cleared, but its memory still holds older pixels
+    CLEARED, // Its memory holds the clear values
+};
+
+// Framebuffers whose block states are kept while the renderer draws to another one
+const int FAST_CLEAR_MAX_OTHER_BUFFERS = 8;
+
+// Block states of a framebuffer the renderer is not drawing to, restored when it is set again
+struct FastClearBuffers
+{
+    const void* colorBuffer;
+    const void* depthBuffer;
+    std::vector<BlockClear> blocks;
+    unsigned char colorTexel[16];
+};
+
+// rdrClear() only marks the raster blocks, their memory is written when something is first drawn to them,
+// or by rdrEndFrame() for the ones never drawn to
+// Blocks left untouched since the previous clear to the same color are not written at all
+struct FastClear
+{
+    bool lazy = true; // Otherwise both buffers are cleared at once, with streaming stores
+
+    int blockCountX = 0;
+    int blockCountY = 0;
+    std::vector<BlockClear> blocks;
+
+    // Clear color in the format of the color buffer, the depth is always cleared to the far plane (0)
+    unsigned char colorTexel[16];
+
+    // Buffers the blocks belong to, and the other buffers of the same size and formats, e.g. a ring of framebuffers
+    const void* colorBuffer = nullptr;
+    const void* depthBuffer = nullptr;
+    std::vector<FastClearBuffers> otherBuffers;
+};
+
+// Forgets the state of every buffer
+void resizeFastClear(FastClear& clear, int width, int height);
+
+// Switches the blocks to those of other buffers of the same size and formats, their state is kept while they are not used
+void setFastClearBuffers(FastClear& clear, const void* colorBuffer, const void* depthBuffer);
+
+// Returns false if the clear color did not change
+bool setClearColor(FastClear& clear, const Framebuffer& fb, const float* color);
+
+// Writes the clear values to one block
+void clearBlock(const FastClear& clear, const Framebuffer& fb, int blockX, int blockY);
+
+// Call before drawing to a block
+inline void touchBlock(FastClear& clear, const Framebuffer& fb, int blockX, int blockY)
+{
+    BlockClear& block = clear.blocks[blockY * clear.blockCountX + blockX];
+    if (block == BlockClear::PENDING)
+        clearBlock(clear, fb, blockX, blockY);
+    block = BlockClear::DRAWN;
+}
+
+// Clears the rows [firstRow, lastRow] of both buffers, without reading them into the cache
+void streamClearRows(const FastClear& clear, const Framebuffer& fb, int firstRow, int lastRow);
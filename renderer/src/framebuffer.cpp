@@ -0,0 +1,76 @@
+#include <common/maths.hpp>
+
+#include "framebuffer.hpp"
+
+float getDepthScale(rdrDepthFormat format)
+{
+    switch (format)
+    {
+    case RDR_DEPTH_FORMAT_D16: return -65535.f;
+    case RDR_DEPTH_FORMAT_D24: return -16777215.f;
+    default:                   return 1.f;
+    }
+}
+
+int getDepthSize(rdrDepthFormat format)
+{
+    return format == RDR_DEPTH_FORMAT_D16 ? 2 : 4;
+}
+
+int getColorSize(rdrColorFormat format)
+{
+    switch (format)
+    {
+    case RDR_COLOR_FORMAT_RGBA8:   return 4;
+    case RDR_COLOR_FORMAT_RGBA16F: return 8;
+    default:                       return 16;
+    }
+}
+
+template <typename T>
+static void getRawDepthRange(const T* depthBuffer, int width, int x0, int y0, int x1, int y1, T& minValue, T& maxValue)
+{
+    minValue = maxValue = depthBuffer[y0 * width + x0];
+    for (int y = y0; y < y1; ++y)
+    {
+        const T* row = &depthBuffer[y * width];
+        for (int x = x0; x < x1; ++x)
+        {
+            minValue = row[x] < minValue ? row[x] : minValue;
+            maxValue = row[x] > maxValue ? row[x] : maxValue;
+        }
+    }
+}
+
+void getDepthRange(const Framebuffer& fb, int x0, int y0, int x1, int y1, float& nearest, float& farthest)
+{
+    switch (fb.depthFormat)
+    {
+    case RDR_DEPTH_FORMAT_D16:
+    case RDR_DEPTH_FORMAT_D24:
+    {
+        // Unorm depth grows toward the near plane
+        unsigned int minValue, maxValue;
+        if (fb.depthFormat == RDR_DEPTH_FORMAT_D16)
+        {
+            unsigned short minValue16, maxValue16;
+            getRawDepthRange(static_cast<const unsigned short*>(fb.depthBuffer), fb.width, x0, y0, x1, y1, minValue16, maxValue16);
+            minValue = minValue16;
+            maxValue = maxValue16;
+        }
+        else
+        {
+            getRawDepthRange(static_cast<const unsigned int*>(fb.depthBuffer), fb.width, x0, y0, x1, y1, minValue, maxValue);
+        }
+
+        float scale = getDepthScale(fb.depthFormat);
+        nearest = (float)maxValue / scale;
+        farthest = (float)minValue / scale;
+        break;
+    }
+
+    default:
+        getRawDepthRange(static_cast<const float*>(fb.depthBuffer), fb.width, x0, y0, x1, y1, nearest, farthest);
+        break;
+    }
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cmath>
+#include <cstring>
+
+#include <rdr/renderer.h>
+
+#include <common/types.hpp>
+
+// Color and depth buffers given to rdrInitEx(), written in their own formats
+// The color buffer is never read back, so colors are only converted on output
+struct Framebuffer
+{
+    int width;
+    int height;
+    void* colorBuffer;
+    void* depthBuffer;
+    rdrColorFormat colorFormat;
+    rdrDepthFormat depthFormat;
+};
+
+// The raster kernels work on depths in the units of the depth buffer:
+// z itself for float buffers, -z * (2^bits - 1) for unorm ones, so 0 is the far plane in every format
+float getDepthScale(rdrDepthFormat format);
+int getDepthSize(rdrDepthFormat format);
+int getColorSize(rdrColorFormat format);
+
+inline void* getDepthAddress(const Framebuffer& fb, int index)
+{
+    return static_cast<char*>(fb.depthBuffer) + (size_t)index * getDepthSize(fb.depthFormat);
+}
+
+// Rounding and clamping shared with the raster kernels, see raster_kernel.cpp
+inline unsigned int toUnormDepth(float depth, unsigned int maxValue)
+{
+    long value = lrintf(depth);
+    return value < 0 ? 0 : value > (long)maxValue ? maxValue : (unsigned int)value;
+}
+
+// depth is in buffer units
+inline void storeDepth(const Framebuffer& fb, int index, float depth)
+{
+    switch (fb.depthFormat)
+    {
+    case RDR_DEPTH_FORMAT_D16: static_cast<unsigned short*>(fb.depthBuffer)[index] = (unsigned short)toUnormDepth(depth, 0xffff); break;
+    case RDR_DEPTH_FORMAT_D24: static_cast<unsigned int*>(fb.depthBuffer)[index] = toUnormDepth(depth, 0xffffff); break;
+    default:                   static_cast<float*>(fb.depthBuffer)[index] = depth; break;
+    }
+}
+
+// Nearest and farthest z of the pixels in [x0, x1) x [y0, y1), back from buffer units
+void getDepthRange(const Framebuffer& fb, int x0, int y0, int x1, int y1, float& nearest, float& farthest);
+
+// Round to nearest even, overflows to infinity
+inline unsigned short floatToHalf(float value)
+{
+    unsigned int bits;
+    memcpy(&bits, &value, sizeof(bits));
+    unsigned int sign = (bits >> 16) & 0x8000;
+    unsigned int magnitude = bits & 0x7fffffff;
+
+    // NaN stays NaN
+    if (magnitude > 0x7f800000)
+        return (unsigned short)(sign | 0x7e00);
+
+    // Rounds to a value past the largest half
+    if (magnitude >= 0x477ff000)
+        return (unsigned short)(sign | 0x7c00);
+
+    // Too small for a normal half
+    if (magnitude < 0x38800000)
+    {
+        int shift = 126 - (int)(magnitude >> 23);
+        if (shift > 24)
+            return (unsigned short)sign;
+
+        unsigned int mantissa = (magnitude & 0x7fffff) | 0x800000;
+        unsigned int half = mantissa >> shift;
+        unsigned int remainder = mantissa & ((1u << shift) - 1);
+        unsigned int halfway = 1u << (shift - 1);
+        if (remainder > halfway || (remainder == halfway && (half & 1)))
+            half++;
+        return (unsigned short)(sign | half);
+    }
+
+    // Rebias the exponent from 127 to 15, a carry out of the mantissa correctly bumps the exponent
+    unsigned int half = (magnitude - 0x38000000) >> 13;
+    unsigned int remainder = magnitude & 0x1fff;
+    if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1)))
+        half++;
+    return (unsigned short)(sign | half);
+}
+
+inline unsigned int toUnormColor(float value)
+{
+    return (unsigned int)((value < 0.f ? 0.f : value > 1.f ? 1.f : value) * 255.f + 0.5f);
+}
+
+inline void storeColor(const Framebuffer& fb, int index, const float4& color)
+{
+    switch (fb.colorFormat)
+    {
+    case RDR_COLOR_FORMAT_RGBA8:
+        static_cast<unsigned int*>(fb.colorBuffer)[index] =
+            toUnormColor(color.r) | (toUnormColor(color.g) << 8) | (toUnormColor(color.b) << 16) | (toUnormColor(color.a) << 24);
+        break;
+
+    case RDR_COLOR_FORMAT_RGBA16F:
+    {
+        unsigned short* texel = &static_cast<unsigned short*>(fb.colorBuffer)[index * 4];
+        for (int i = 0; i < 4; ++i)
+            texel[i] = floatToHalf(color.e[i]);
+        break;
+    }
+
+    default:
+        static_cast<float4*>(fb.colorBuffer)[index] = color;
+        break;
+    }
+}
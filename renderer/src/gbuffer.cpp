@@ -0,0 +1,85 @@
+#include <cmath>
+#include <cstring>
+
+#include <common/maths.hpp>
+
+#include "gbuffer.hpp"
+
+void resizeGBuffer(GBuffer& gBuffer, int width, int height)
+{
+    gBuffer.width = width;
+    gBuffer.height = height;
+    gBuffer.albedo.resize(width * height);
+    gBuffer.normal.resize(width * height);
+    gBuffer.worldCoords.resize(width * height);
+    gBuffer.used = false;
+}
+
+void clearGBufferRows(GBuffer& gBuffer, int firstRow, int lastRow)
+{
+    // Only the coverage (albedo alpha) has to be reset
+    int count = (lastRow - firstRow + 1) * gBuffer.width;
+    memset(&gBuffer.albedo[firstRow * gBuffer.width], 0, count * sizeof(unsigned int));
+}
+
+static unsigned int toUnorm8(float value)
+{
+    return (unsigned int)(maths::clamp(0.f, 1.f, value) * 255.f + 0.5f);
+}
+
+unsigned int packAlbedo(float3 color)
+{
+    return toUnorm8(color.r) | (toUnorm8(color.g) << 8) | (toUnorm8(color.b) << 16) | (0xffu << 24);
+}
+
+float3 unpackAlbedo(unsigned int packed)
+{
+    return {
+        (packed & 0xff) / 255.f,
+        ((packed >> 8) & 0xff) / 255.f,
+        ((packed >> 16) & 0xff) / 255.f
+    };
+}
+
+static float signNotZero(float value)
+{
+    return value >= 0.f ? 1.f : -1.f;
+}
+
+// Octahedral normal encoding: the unit sphere is projected on an octahedron, then unfolded on a square
+unsigned int packNormal(float3 normal)
+{
+    float l1 = fabsf(normal.x) + fabsf(normal.y) + fabsf(normal.z);
+    if (l1 == 0.f)
+        return 0;
+
+    float2 p = { normal.x / l1, normal.y / l1 };
+    if (normal.z < 0.f)
+    {
+        float2 folded = {
+            (1.f - fabsf(p.y)) * signNotZero(p.x),
+            (1.f - fabsf(p.x)) * signNotZero(p.y)
+        };
+        p = folded;
+    }
+
+    unsigned int x = (unsigned short)(short)lroundf(maths::clamp(-1.f, 1.f, p.x) * 32767.f);
+    unsigned int y = (unsigned short)(short)lroundf(maths::clamp(-1.f, 1.f, p.y) * 32767.f);
+    return x | (y << 16);
+}
+
+float3 unpackNormal(unsigned int packed)
+{
+    float2 p = {
+        (short)(packed & 0xffff) / 32767.f,
+        (short)(packed >> 16) / 32767.f
+    };
+
+    float3 normal = { p.x, p.y, 1.f - fabsf(p.x) - fabsf(p.y) };
+    if (normal.z < 0.f)
+    {
+        normal.x = (1.f - fabsf(p.y)) * signNotZero(p.x);
+        normal.y = (1.f - fabsf(p.x)) * signNotZero(p.y);
+    }
+    return maths::normalize(normal);
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <vector>
+
+#include <common/types.hpp>
+
+// Compact G-buffer written by the raster pass in deferred mode, 20 bytes per pixel
+// Lighting is then computed once per visible pixel by a full-screen pass, see rdrEndFrame()
+struct GBuffer
+{
+    int width = 0;
+    int height = 0;
+
+    // Set by the first deferred draw of the frame, the buffers are only cleared then
+    bool used = false;
+
+    std::vector<unsigned int> albedo;   // RGBA8, alpha is 0 for pixels not written this frame
+    std::vector<unsigned int> normal;   // Octahedral encoding, 2 x 16 bits snorm
+    std::vector<float3> worldCoords;
+};
+
+void resizeGBuffer(GBuffer& gBuffer, int width, int height);
+void clearGBufferRows(GBuffer& gBuffer, int firstRow, int lastRow);
+
+unsigned int packAlbedo(float3 color);
+float3 unpackAlbedo(unsigned int packed);
+
+unsigned int packNormal(float3 normal);
+float3 unpackNormal(unsigned int packed);
+
+inline bool isGBufferPixelWritten(const GBuffer& gBuffer, int index) { return (gBuffer.albedo[index] >> 24) != 0; }
@@ -0,0 +1,166 @@
+#include <cfloat>
+#include <cstring>
+
+#include <common/maths.hpp>
+
+#include "renderer_impl.hpp"
+#include "light_culling.hpp"
+
+static const float LIGHT_ATTENUATION_CUTOFF = 1.f / 256.f;
+
+float getLightRadius(const Light& light)
+{
+    if (!light.attnEnabled)
+        return -1.f;
+
+    float strength = maths::max(maths::max(light.attenuation.x, light.attenuation.y), light.attenuation.z);
+    return light.minFullAttnDistance * strength / LIGHT_ATTENUATION_CUTOFF;
+}
+
+void gatherLights(LightGrid& grid, const Light* lights, int lightCount)
+{
+    bool changed = false;
+    size_t count = 0;
+    for (int i = 0; i < lightCount; ++i)
+    {
+        float4 sphere = { lights[i].position.xyz, getLightRadius(lights[i]) };
+
+        // Lights that can't reach anything are as good as disabled
+        if (!lights[i].enabled || sphere.w == 0.f)
+            continue;
+
+        if (count < grid.lights.size())
+        {
+            changed |= grid.lights[count] != i || memcmp(&grid.spheres[count], &sphere, sizeof(float4)) != 0;
+            grid.lights[count] = i;
+            grid.spheres[count] = sphere;
+        }
+        else
+        {
+            changed = true;
+            grid.lights.push_back(i);
+            grid.spheres.push_back(sphere);
+        }
+        count++;
+    }
+
+    if (count != grid.lights.size())
+    {
+        changed = true;
+        grid.lights.resize(count);
+        grid.spheres.resize(count);
+    }
+
+    if (changed)
+        grid.valid = false;
+}
+
+// Screen rect covered by a light sphere, false when it can't be seen
+// Conservative: the rect of the 8 corners of the box around the sphere
+static bool getLightRect(const float4& sphere, const mat4x4& viewProj, const Viewport& viewport, float rect[4])
+{
+    if (sphere.w < 0.f)
+    {
+        rect[0] = rect[1] = 0.f;
+        rect[2] = (float)viewport.width;
+        rect[3] = (float)viewport.height;
+        return true;
+    }
+
+    bool crossesCamera = false;
+    bool allBehind = true;
+    rect[0] = rect[1] = FLT_MAX;
+    rect[2] = rect[3] = -FLT_MAX;
+    for (int i = 0; i < 8; ++i)
+    {
+        float4 corner = {
+            sphere.x + (i & 1 ? sphere.w : -sphere.w),
+            sphere.y + (i & 2 ? sphere.w : -sphere.w),
+            sphere.z + (i & 4 ? sphere.w : -sphere.w),
+            1.f
+        };
+        float4 clip = viewProj * corner;
+
+        // Corners behind the camera have no meaningful projection
+        if (clip.w <= 0.f)
+        {
+            crossesCamera = true;
+            continue;
+        }
+        allBehind = false;
+
+        float x = ((clip.x / clip.w / 2.f) + 0.5f) * viewport.width;
+        float y = (1.f - ((clip.y / clip.w / 2.f) + 0.5f)) * viewport.height;
+        rect[0] = maths::min(rect[0], x);
+        rect[1] = maths::min(rect[1], y);
+        rect[2] = maths::max(rect[2], x);
+        rect[3] = maths::max(rect[3], y);
+    }
+
+    // w is affine, so a box with all its corners behind the camera is entirely behind it
+    if (allBehind)
+        return false;
+
+    if (crossesCamera)
+    {
+        rect[0] = rect[1] = 0.f;
+        rect[2] = (float)viewport.width;
+        rect[3] = (float)viewport.height;
+    }
+    return true;
+}
+
+void buildLightTiles(LightGrid& grid, const mat4x4& viewProj, const Viewport& viewport, int tileSize, int tileCountX, int tileCountY)
+{
+    if (grid.valid && grid.tileSize == tileSize && grid.tileCountX == tileCountX && grid.tileCountY == tileCountY
+        && grid.width == viewport.width && grid.height == viewport.height && memcmp(grid.viewProj.e, viewProj.e, sizeof(viewProj.e)) == 0)
+        return;
+
+    grid.tileSize = tileSize;
+    grid.tileCountX = tileCountX;
+    grid.tileCountY = tileCountY;
+    grid.width = viewport.width;
+    grid.height = viewport.height;
+    grid.viewProj = viewProj;
+    grid.valid = true;
+
+    grid.tiles.resize(tileCountX * tileCountY);
+    for (std::vector<int>& tile : grid.tiles)
+        tile.clear();
+
+    for (size_t i = 0; i < grid.lights.size(); ++i)
+    {
+        float rect[4];
+        if (!getLightRect(grid.spheres[i], viewProj, viewport, rect))
+            continue;
+
+        float maxX = (float)(tileCountX * tileSize - 1);
+        float maxY = (float)(tileCountY * tileSize - 1);
+        if (rect[2] < 0.f || rect[3] < 0.f || rect[0] > maxX || rect[1] > maxY)
+            continue;
+
+        // Clamped as floats first, far away corners don't fit in an int
+        int minTileX = (int)maths::max(rect[0], 0.f) / tileSize;
+        int minTileY = (int)maths::max(rect[1], 0.f) / tileSize;
+        int maxTileX = (int)maths::min(rect[2], maxX) / tileSize;
+        int maxTileY = (int)maths::min(rect[3], maxY) / tileSize;
+
+        for (int y = minTileY; y <= maxTileY; ++y)
+            for (int x = minTileX; x <= maxTileX; ++x)
+                grid.tiles[y * tileCountX + x].push_back(grid.lights[i]);
+    }
+}
+
+bool sphereTouchesBox(const float4& sphere, const float3& boxMin, const float3& boxMax)
+{
+    if (sphere.w < 0.f)
+        return true;
+
+    float distanceSq = 0.f;
+    for (int i = 0; i < 3; ++i)
+    {
+        float d = maths::max(maths::max(boxMin.e[i] - sphere.e[i], sphere.e[i] - boxMax.e[i]), 0.f);
+        distanceSq += d * d;
+    }
+    return distanceSq <= sphere.w * sphere.w;
+}
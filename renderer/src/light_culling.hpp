@@ -0,0 +1,48 @@
+#pragma once
+
+#include <vector>
+
+#include <common/types.hpp>
+
+struct Light;
+struct Viewport;
+
+// Subset of Uniforms::lights to evaluate
+struct LightList
+{
+    const int* indices;
+    int count;
+};
+
+// Attenuation falls as minFullAttnDistance / distance and never reaches 0,
+// so lights are cut where it drops below 1/256 of their strength, which gives them a radius to be culled with
+// Negative for the lights without attenuation, they reach everything
+float getLightRadius(const Light& light);
+
+// Lights reaching each tile of the tiled backend, found from the screen bounds of their spheres
+// Only rebuilt when the lights, the camera or the tiles change
+struct LightGrid
+{
+    // Enabled lights, as indices in Uniforms::lights, and their world space spheres (center, radius)
+    std::vector<int> lights;
+    std::vector<float4> spheres;
+
+    int tileSize = 0;
+    int tileCountX = 0;
+    int tileCountY = 0;
+    std::vector<std::vector<int>> tiles; // Indices in Uniforms::lights, in increasing order
+
+    // What the tiles were built for
+    bool valid = false;
+    mat4x4 viewProj;
+    int width = 0;
+    int height = 0;
+};
+
+// Collects the enabled lights, and invalidates the tiles if any of them changed
+void gatherLights(LightGrid& grid, const Light* lights, int lightCount);
+
+void buildLightTiles(LightGrid& grid, const mat4x4& viewProj, const Viewport& viewport, int tileSize, int tileCountX, int tileCountY);
+
+// Whether a light sphere reaches the box [boxMin, boxMax]
+bool sphereTouchesBox(const float4& sphere, const float3& boxMin, const float3& boxMax);
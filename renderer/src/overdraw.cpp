@@ -0,0 +1,41 @@
+#include <common/maths.hpp>
+
+#include "framebuffer.hpp"
+#include "overdraw.hpp"
+
+void resetOverdraw(Overdraw& overdraw, int width, int height)
+{
+    overdraw.width = width;
+    overdraw.height = height;
+    overdraw.counts.assign((size_t)width * height, 0);
+    overdraw.counting = true;
+}
+
+// One color per count, a fixed scale so frames can be compared with each other
+static float4 getHeatmapColor(int count)
+{
+    static const float4 colors[OVERDRAW_MAX_COLOR + 1] = {
+        { 0.f, 0.f, 0.f, 1.f },
+        { 0.f, 0.f, 1.f, 1.f },
+        { 0.f, 0.5f, 1.f, 1.f },
+        { 0.f, 1.f, 1.f, 1.f },
+        { 0.f, 1.f, 0.f, 1.f },
+        { 1.f, 1.f, 0.f, 1.f },
+        { 1.f, 0.5f, 0.f, 1.f },
+        { 1.f, 0.f, 0.f, 1.f },
+        { 1.f, 1.f, 1.f, 1.f },
+    };
+    return colors[maths::min(count, OVERDRAW_MAX_COLOR)];
+}
+
+void writeOverdrawRows(const Overdraw& overdraw, const Framebuffer& fb, int firstRow, int lastRow)
+{
+    for (int y = firstRow; y <= lastRow; ++y)
+    {
+        for (int x = 0; x < fb.width; ++x)
+        {
+            int index = y * fb.width + x;
+            storeColor(fb, index, getHeatmapColor(overdraw.counts[index]));
+        }
+    }
+}
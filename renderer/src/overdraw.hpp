@@ -0,0 +1,31 @@
+#pragma once
+
+#include <vector>
+
+struct Framebuffer;
+
+// Number of times each pixel was shaded since rdrBeginFrame(), for the overdraw debug output
+// Only allocated and counted while that output is selected
+struct Overdraw
+{
+    bool counting = false; // Set by rdrBeginFrame(), the counts are only complete for frames started with it
+
+    int width = 0;
+    int height = 0;
+    std::vector<unsigned short> counts;
+};
+
+// Resets the counts, resizing them to the framebuffer if needed
+void resetOverdraw(Overdraw& overdraw, int width, int height);
+
+inline void addOverdraw(Overdraw& overdraw, int index)
+{
+    unsigned short& count = overdraw.counts[index];
+    if (count != 0xffff)
+        count++;
+}
+
+// Replaces the rows [firstRow, lastRow] of the color buffer by the heatmap of the counts:
+// black for pixels never shaded, then from blue through green and yellow to red, and white from OVERDRAW_MAX_COLOR times on
+const int OVERDRAW_MAX_COLOR = 8;
+void writeOverdrawRows(const Overdraw& overdraw, const Framebuffer& fb, int firstRow, int lastRow);
@@ -0,0 +1,342 @@
+#include "raster_kernel.hpp"
+
+#include "framebuffer.hpp"
+#include "simd.hpp"
+
+#ifdef RDR_X86
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+// Float depths pass when nearer, so smaller, unorm depths when larger, see getDepthScale()
+// Unorm depths are rounded to nearest like storeDepth() does
+static bool testDepthScalar(float& stored, float depth)
+{
+    if (!(depth < stored))
+        return false;
+    stored = depth;
+    return true;
+}
+
+static bool testDepthScalar(unsigned short& stored, float depth)
+{
+    unsigned int value = toUnormDepth(depth, 0xffff);
+    if (!(value > stored))
+        return false;
+    stored = (unsigned short)value;
+    return true;
+}
+
+static bool testDepthScalar(unsigned int& stored, float depth)
+{
+    unsigned int value = toUnormDepth(depth, 0xffffff);
+    if (!(value > stored))
+        return false;
+    stored = value;
+    return true;
+}
+
+template <typename T>
+static unsigned int rasterRowScalar(const RasterRow& row, void* depthBuffer, unsigned int& coveredMask)
+{
+    T* depths = static_cast<T*>(depthBuffer);
+    unsigned int mask = 0;
+    coveredMask = 0;
+    for (int i = 0; i < row.count; ++i)
+    {
+        int e0 = row.edges[0] + i * row.edgeSteps[0];
+        int e1 = row.edges[1] + i * row.edgeSteps[1];
+        int e2 = row.edges[2] + i * row.edgeSteps[2];
+        if ((e0 | e1 | e2) < 0)
+            continue;
+
+        coveredMask |= 1u << i;
+        if (depths && !testDepthScalar(depths[i], row.depth + (float)i * row.depthStep))
+            continue;
+        mask |= 1u << i;
+    }
+    return mask;
+}
+
+#ifdef RDR_X86
+
+// Depth buffer access of the SIMD kernels, overloaded for each depth format
+// Lanes hold the float bits for float buffers, and the integer values for unorm ones
+
+RDR_TARGET_SSE41 static __m128i loadDepthsSSE41(const float* depths) { return _mm_castps_si128(_mm_loadu_ps(depths)); }
+RDR_TARGET_SSE41 static __m128i loadDepthsSSE41(const unsigned int* depths) { return _mm_loadu_si128((const __m128i*)depths); }
+RDR_TARGET_SSE41 static __m128i loadDepthsSSE41(const unsigned short* depths) { return _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i*)depths)); }
+
+RDR_TARGET_SSE41 static void storeDepthsSSE41(float* depths, __m128i values) { _mm_storeu_ps(depths, _mm_castsi128_ps(values)); }
+RDR_TARGET_SSE41 static void storeDepthsSSE41(unsigned int* depths, __m128i values) { _mm_storeu_si128((__m128i*)depths, values); }
+RDR_TARGET_SSE41 static void storeDepthsSSE41(unsigned short* depths, __m128i values) { _mm_storel_epi64((__m128i*)depths, _mm_packus_epi32(values, values)); }
+
+// Returns the lanes passing the test, and sets values to the depths to store
+RDR_TARGET_SSE41 static __m128i testDepthsSSE41(const float*, __m128 z, __m128i stored, __m128i& values)
+{
+    values = _mm_castps_si128(z);
+    return _mm_castps_si128(_mm_cmplt_ps(z, _mm_castsi128_ps(stored)));
+}
+
+RDR_TARGET_SSE41 static __m128i toUnormDepthsSSE41(__m128 z, int maxValue)
+{
+    return _mm_min_epi32(_mm_max_epi32(_mm_cvtps_epi32(z), _mm_setzero_si128()), _mm_set1_epi32(maxValue));
+}
+
+RDR_TARGET_SSE41 static __m128i testDepthsSSE41(const unsigned int*, __m128 z, __m128i stored, __m128i& values)
+{
+    values = toUnormDepthsSSE41(z, 0xffffff);
+    return _mm_cmpgt_epi32(values, stored);
+}
+
+RDR_TARGET_SSE41 static __m128i testDepthsSSE41(const unsigned short*, __m128 z, __m128i stored, __m128i& values)
+{
+    values = toUnormDepthsSSE41(z, 0xffff);
+    return _mm_cmpgt_epi32(values, stored);
+}
+
+// 4 pixels starting at pixel 'first' of the row, their coverage is added to coveredMask
+template <typename T>
+RDR_TARGET_SSE41 static unsigned int rasterQuadSSE41(const RasterRow& row, T* depthBuffer, int first, unsigned int& coveredMask)
+{
+    __m128i lane = _mm_setr_epi32(first, first + 1, first + 2, first + 3);
+    __m128i valid = _mm_cmplt_epi32(lane, _mm_set1_epi32(row.count));
+
+    __m128i e0 = _mm_add_epi32(_mm_set1_epi32(row.edges[0]), _mm_mullo_epi32(lane, _mm_set1_epi32(row.edgeSteps[0])));
+    __m128i e1 = _mm_add_epi32(_mm_set1_epi32(row.edges[1]), _mm_mullo_epi32(lane, _mm_set1_epi32(row.edgeSteps[1])));
+    __m128i e2 = _mm_add_epi32(_mm_set1_epi32(row.edges[2]), _mm_mullo_epi32(lane, _mm_set1_epi32(row.edgeSteps[2])));
+    __m128i covered = _mm_cmpgt_epi32(_mm_or_si128(_mm_or_si128(e0, e1), e2), _mm_set1_epi32(-1));
+    __m128i mask = _mm_and_si128(covered, valid);
+    unsigned int quadCovered = (unsigned int)_mm_movemask_ps(_mm_castsi128_ps(mask));
+    coveredMask |= quadCovered << first;
+
+    if (depthBuffer && quadCovered)
+    {
+        __m128 z = _mm_add_ps(_mm_set1_ps(row.depth), _mm_mul_ps(_mm_cvtepi32_ps(lane), _mm_set1_ps(row.depthStep)));
+
+        // Never read past the end of the row, it could be the end of the buffer
+        T tail[4];
+        T* depth = depthBuffer + first;
+        bool partial = row.count - first < 4;
+        if (partial)
+        {
+            for (int i = 0; i < 4; ++i)
+                tail[i] = first + i < row.count ? depth[i] : T(0);
+            depth = tail;
+        }
+
+        __m128i stored = loadDepthsSSE41(depth);
+        __m128i values;
+        mask = _mm_and_si128(mask, testDepthsSSE41(depth, z, stored, values));
+        storeDepthsSSE41(depth, _mm_blendv_epi8(stored, values, mask));
+
+        if (partial)
+        {
+            for (int i = 0; first + i < row.count; ++i)
+                depthBuffer[first + i] = tail[i];
+        }
+    }
+    return (unsigned int)_mm_movemask_ps(_mm_castsi128_ps(mask)) << first;
+}
+
+template <typename T>
+RDR_TARGET_SSE41 static unsigned int rasterRowSSE41(const RasterRow& row, void* depthBuffer, unsigned int& coveredMask)
+{
+    T* depths = static_cast<T*>(depthBuffer);
+    coveredMask = 0;
+    unsigned int mask = rasterQuadSSE41(row, depths, 0, coveredMask);
+    if (row.count > 4)
+        mask |= rasterQuadSSE41(row, depths, 4, coveredMask);
+    return mask;
+}
+
+// Masked loads and stores never touch the pixels past the end of the row
+RDR_TARGET_AVX2 static __m256i loadDepthsAVX2(const float* depths, int count, __m256i valid)
+{
+    return _mm256_castps_si256(_mm256_maskload_ps(depths, valid));
+}
+
+RDR_TARGET_AVX2 static __m256i loadDepthsAVX2(const unsigned int* depths, int count, __m256i valid)
+{
+    return _mm256_maskload_epi32((const int*)depths, valid);
+}
+
+RDR_TARGET_AVX2 static __m256i loadDepthsAVX2(const unsigned short* depths, int count, __m256i valid)
+{
+    // No masked 16 bits load, partial rows go through a copy
+    unsigned short tail[8] = {};
+    if (count < 8)
+    {
+        for (int i = 0; i < count; ++i)
+            tail[i] = depths[i];
+        depths = tail;
+    }
+    return _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)depths));
+}
+
+RDR_TARGET_AVX2 static void storeDepthsAVX2(float* depths, int count, __m256i mask, __m256i stored, __m256i values)
+{
+    _mm256_maskstore_ps(depths, mask, _mm256_castsi256_ps(values));
+}
+
+RDR_TARGET_AVX2 static void storeDepthsAVX2(unsigned int* depths, int count, __m256i mask, __m256i stored, __m256i values)
+{
+    _mm256_maskstore_epi32((int*)depths, mask, values);
+}
+
+RDR_TARGET_AVX2 static void storeDepthsAVX2(unsigned short* depths, int count, __m256i mask, __m256i stored, __m256i values)
+{
+    // Packing works inside each 128 bits half, the two halves are then gathered in the low 128 bits
+    __m256i packed = _mm256_packus_epi32(_mm256_blendv_epi8(stored, values, mask), _mm256_setzero_si256());
+    __m128i result = _mm256_castsi256_si128(_mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0)));
+    if (count == 8)
+    {
+        _mm_storeu_si128((__m128i*)depths, result);
+        return;
+    }
+
+    unsigned short tail[8];
+    _mm_storeu_si128((__m128i*)tail, result);
+    for (int i = 0; i < count; ++i)
+        depths[i] = tail[i];
+}
+
+RDR_TARGET_AVX2 static __m256i testDepthsAVX2(const float*, __m256 z, __m256i stored, __m256i& values)
+{
+    values = _mm256_castps_si256(z);
+    return _mm256_castps_si256(_mm256_cmp_ps(z, _mm256_castsi256_ps(stored), _CMP_LT_OQ));
+}
+
+RDR_TARGET_AVX2 static __m256i toUnormDepthsAVX2(__m256 z, int maxValue)
+{
+    return _mm256_min_epi32(_mm256_max_epi32(_mm256_cvtps_epi32(z), _mm256_setzero_si256()), _mm256_set1_epi32(maxValue));
+}
+
+RDR_TARGET_AVX2 static __m256i testDepthsAVX2(const unsigned int*, __m256 z, __m256i stored, __m256i& values)
+{
+    values = toUnormDepthsAVX2(z, 0xffffff);
+    return _mm256_cmpgt_epi32(values, stored);
+}
+
+RDR_TARGET_AVX2 static __m256i testDepthsAVX2(const unsigned short*, __m256 z, __m256i stored, __m256i& values)
+{
+    values = toUnormDepthsAVX2(z, 0xffff);
+    return _mm256_cmpgt_epi32(values, stored);
+}
+
+template <typename T>
+RDR_TARGET_AVX2 static unsigned int rasterRowAVX2(const RasterRow& row, void* depthBuffer, unsigned int& coveredMask)
+{
+    __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i valid = _mm256_cmpgt_epi32(_mm256_set1_epi32(row.count), lane);
+
+    __m256i e0 = _mm256_add_epi32(_mm256_set1_epi32(row.edges[0]), _mm256_mullo_epi32(lane, _mm256_set1_epi32(row.edgeSteps[0])));
+    __m256i e1 = _mm256_add_epi32(_mm256_set1_epi32(row.edges[1]), _mm256_mullo_epi32(lane, _mm256_set1_epi32(row.edgeSteps[1])));
+    __m256i e2 = _mm256_add_epi32(_mm256_set1_epi32(row.edges[2]), _mm256_mullo_epi32(lane, _mm256_set1_epi32(row.edgeSteps[2])));
+    __m256i covered = _mm256_cmpgt_epi32(_mm256_or_si256(_mm256_or_si256(e0, e1), e2), _mm256_set1_epi32(-1));
+    __m256i mask = _mm256_and_si256(covered, valid);
+    coveredMask = (unsigned int)_mm256_movemask_ps(_mm256_castsi256_ps(mask));
+
+    T* depths = static_cast<T*>(depthBuffer);
+    if (depths && coveredMask)
+    {
+        __m256 z = _mm256_add_ps(_mm256_set1_ps(row.depth), _mm256_mul_ps(_mm256_cvtepi32_ps(lane), _mm256_set1_ps(row.depthStep)));
+
+        __m256i stored = loadDepthsAVX2(depths, row.count, valid);
+        __m256i values;
+        mask = _mm256_and_si256(mask, testDepthsAVX2(depths, z, stored, values));
+        storeDepthsAVX2(depths, row.count, mask, stored, values);
+    }
+    return (unsigned int)_mm256_movemask_ps(_mm256_castsi256_ps(mask));
+}
+
+static void cpuid(int info[4], int leaf)
+{
+#if defined(_MSC_VER)
+    __cpuidex(info, leaf, 0);
+#else
+    __cpuid_count(leaf, 0, info[0], info[1], info[2], info[3]);
+#endif
+}
+
+static unsigned long long xgetbv()
+{
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    unsigned int eax, edx;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return ((unsigned long long)edx << 32) | eax;
+#endif
+}
+
+RasterKernel getBestRasterKernel()
+{
+    int info[4];
+    cpuid(info, 0);
+    int maxLeaf = info[0];
+
+    cpuid(info, 1);
+    bool sse41 = (info[2] & (1 << 19)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+
+    // AVX registers also need to be saved by the OS
+    bool avx2 = false;
+    if (maxLeaf >= 7 && osxsave && avx && (xgetbv() & 6) == 6)
+    {
+        cpuid(info, 7);
+        avx2 = (info[1] & (1 << 5)) != 0;
+    }
+
+    if (avx2)
+        return RasterKernel::AVX2;
+    if (sse41)
+        return RasterKernel::SSE41;
+    return RasterKernel::SCALAR;
+}
+
+#else
+
+RasterKernel getBestRasterKernel()
+{
+    return RasterKernel::SCALAR;
+}
+
+#endif
+
+template <typename T>
+static RasterRowFunc getRasterRowFunc(RasterKernel kernel)
+{
+    switch (kernel)
+    {
+#ifdef RDR_X86
+    case RasterKernel::AVX2:  return rasterRowAVX2<T>;
+    case RasterKernel::SSE41: return rasterRowSSE41<T>;
+#endif
+    default:                  return rasterRowScalar<T>;
+    }
+}
+
+RasterRowFunc getRasterRowFunc(RasterKernel kernel, rdrDepthFormat depthFormat)
+{
+    switch (depthFormat)
+    {
+    case RDR_DEPTH_FORMAT_D16: return getRasterRowFunc<unsigned short>(kernel);
+    case RDR_DEPTH_FORMAT_D24: return getRasterRowFunc<unsigned int>(kernel);
+    default:                   return getRasterRowFunc<float>(kernel);
+    }
+}
+
+const char* getRasterKernelName(RasterKernel kernel)
+{
+    switch (kernel)
+    {
+    case RasterKernel::AVX2:  return "AVX2";
+    case RasterKernel::SSE41: return "SSE4.1";
+    default:                  return "Scalar";
+    }
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <rdr/renderer.h>
+
+// Instruction sets the raster kernel can be compiled for
+enum class RasterKernel
+{
+    SCALAR,
+    SSE41,
+    AVX2,
+};
+
+// One row of at most 8 pixels inside a raster block
+struct RasterRow
+{
+    int edges[3];     // Edge values on the first pixel, 0 for the edges that do not cross the block
+    int edgeSteps[3]; // Edge increments from one pixel to the next, 0 for the edges that do not cross the block
+    float depth;      // Depth on the first pixel, in the units of the depth buffer (see getDepthScale())
+    float depthStep;
+    int count;        // Number of pixels, from 1 to 8
+};
+
+// Returns the mask of the pixels covered by the triangle (bit i for pixel i)
+// When depthBuffer is not null, covered pixels are also tested against it (nearer),
+// and the ones passing get their depth written, only those are in the returned mask
+// coveredMask is set to the pixels covered, before the depth test
+typedef unsigned int (*RasterRowFunc)(const RasterRow& row, void* depthBuffer, unsigned int& coveredMask);
+
+// Number of pixels in a row mask
+inline int countPixels(unsigned int mask)
+{
+    mask = mask - ((mask >> 1) & 0x55);
+    mask = (mask & 0x33) + ((mask >> 2) & 0x33);
+    return (int)((mask + (mask >> 4)) & 0x0f);
+}
+
+// Best kernel supported by the CPU we are running on
+RasterKernel getBestRasterKernel();
+RasterRowFunc getRasterRowFunc(RasterKernel kernel, rdrDepthFormat depthFormat);
+const char* getRasterKernelName(RasterKernel kernel);
@@ -1,52 +1,121 @@
 
+#include <algorithm>
+#include <cfloat>
+#include <cstdint>
 #include <cstdio>
 #include <cstring>
 #include <cassert>
 #include <math.h>
 #include <iostream>
+#include <mutex>
+#include <utility>
 
 #include <imgui.h>
 
 #include <common/maths.hpp>
+#include <common/trace.hpp>
 
 #include "renderer_impl.hpp"
 
-rdrImpl* rdrInit(float* colorBuffer32Bits, float* depthBuffer, int width, int height)
+// Every thread index the pool can pass to a parallelFor has its counters
+// Never shrunk, the counters of the removed threads are still summed until the next rdrBeginFrame()
+static void growThreadCounters(rdrImpl* renderer)
 {
-    rdrImpl* renderer = new rdrImpl();
+    size_t threadCount = (size_t)renderer->backend.threadPool.getThreadCount();
+    if (renderer->depthCullCounters.size() < threadCount)
+        renderer->depthCullCounters.resize(threadCount, DepthCullCounters{});
+    if (renderer->pipelineCounters.size() < threadCount)
+        renderer->pipelineCounters.resize(threadCount, PipelineCounters{});
+}
 
-    renderer->fb.colorBuffer = reinterpret_cast<float4*>(colorBuffer32Bits);
-    renderer->fb.depthBuffer = depthBuffer;
-    renderer->fb.width  = width;
-    renderer->fb.height = height;
+rdrImpl* rdrInitEx(const rdrFramebufferDesc* desc)
+{
+    rdrImpl* renderer = new rdrImpl();
 
-    renderer->viewport = Viewport{ 0, 0, width, height };
+    renderer->fb = Framebuffer{};
+    rdrSetFramebuffer(renderer, desc);
 
     renderer->uniforms.wireframe = false;
     renderer->uniforms.RGBInterpolation = false;
     renderer->uniforms.depthTest = true;
     renderer->uniforms.backfaceCulling = true;
     renderer->uniforms.phong = true;
+    renderer->uniforms.deferred = false;
     renderer->uniforms.alphaBlending = true;
     renderer->uniforms.alpha = 1.f;
     renderer->uniforms.lineColor = { 1.f, 1.f, 1.f, 1.f };
+    renderer->uniforms.texture = 0;
+    renderer->uniforms.textureFilter = RDR_TEXTURE_FILTER_TRILINEAR;
+    renderer->uniforms.textureWrap = RDR_TEXTURE_WRAP_REPEAT;
+
+    for (Light& light : renderer->uniforms.lights)
+    {
+        light.enabled = false;
+        light.attnEnabled = true;
+        light.minFullAttnDistance = 10.f;
+        light.position = { 2.f, 10.f, 4.f, 1.f };
+        light.ambient = { 0.f, 0.f, 0.f, 1.f };
+        light.diffuse = { 0.f, 0.f, 0.f, 1.f };
+        light.specular = { 0.f, 0.f, 0.f, 1.f };
+        light.attenuation = { 1.f, 1.f, 1.f };
+    }
+    renderer->uniforms.lights[0].enabled = true;
 
-    renderer->uniforms.light.enabled = true;
-    renderer->uniforms.light.attnEnabled = true;
-    renderer->uniforms.light.minFullAttnDistance = 10.f;
-    renderer->uniforms.light.position = { 2.f, 10.f, 4.f, 1.f };
-    renderer->uniforms.light.ambient = { 0.f, 0.f, 0.f, 1.f };
-    renderer->uniforms.light.diffuse = { 0.f, 0.f, 0.f, 1.f };
-    renderer->uniforms.light.specular = { 0.f, 0.f, 0.f, 1.f };
-    renderer->uniforms.light.attenuation = { 1.f, 1.f, 1.f };
+    growThreadCounters(renderer);
 
     return renderer;
 }
 
+rdrImpl* rdrInit(float* colorBuffer32Bits, float* depthBuffer, int width, int height)
+{
+    rdrFramebufferDesc desc = {};
+    desc.colorBuffer = colorBuffer32Bits;
+    desc.depthBuffer = depthBuffer;
+    desc.width = width;
+    desc.height = height;
+    desc.colorFormat = RDR_COLOR_FORMAT_RGBA32F;
+    desc.depthFormat = RDR_DEPTH_FORMAT_D32F;
+    return rdrInitEx(&desc);
+}
+
+void rdrSetFramebuffer(rdrImpl* renderer, const rdrFramebufferDesc* desc)
+{
+    Framebuffer& fb = renderer->fb;
+    if (fb.colorBuffer == desc->colorBuffer && fb.depthBuffer == desc->depthBuffer
+        && fb.width == desc->width && fb.height == desc->height
+        && fb.colorFormat == desc->colorFormat && fb.depthFormat == desc->depthFormat)
+        return;
+
+    int width = desc->width;
+    int height = desc->height;
+    bool resized = fb.width != width || fb.height != height;
+    if (resized)
+    {
+        renderer->viewport = Viewport{ 0, 0, width, height };
+        resizeDepthHierarchy(renderer->hiZ, width, height);
+        resizeGBuffer(renderer->gBuffer, width, height);
+    }
+
+    // The blocks of each buffer of a ring keep their state, unless their layout changes
+    if (resized || fb.colorFormat != desc->colorFormat || fb.depthFormat != desc->depthFormat)
+        resizeFastClear(renderer->fastClear, width, height);
+    setFastClearBuffers(renderer->fastClear, desc->colorBuffer, desc->depthBuffer);
+
+    fb.colorBuffer = desc->colorBuffer;
+    fb.depthBuffer = desc->depthBuffer;
+    fb.width  = width;
+    fb.height = height;
+    fb.colorFormat = desc->colorFormat;
+    fb.depthFormat = desc->depthFormat;
+    renderer->backend.rasterRow = getRasterRowFunc(renderer->backend.rasterKernel, desc->depthFormat);
+
+    // Nothing is known about the depth of the new buffers
+    renderer->hiZ.valid = false;
+    renderer->overdraw.counting = false;
+}
+
 void rdrShutdown(rdrImpl* renderer)
 {
-    for (Texture texture : renderer->textures)
-        delete texture.colors;
     delete renderer;
 }
 
@@ -72,7 +141,11 @@ void rdrSetViewport(rdrImpl* renderer, int x, int y, int width, int height)
 
 void rdrSetUniformLight(rdrImpl* renderer, int index, rdrLight* light)
 {
-    memcpy(&renderer->uniforms.light, light, sizeof(light));
+    static_assert(sizeof(Light) == sizeof(rdrLight), "Light must match rdrLight");
+    if (index < 0 || index >= RDR_MAX_LIGHTS)
+        return;
+
+    memcpy(&renderer->uniforms.lights[index], light, sizeof(rdrLight));
 }
 
 void rdrSetBackground(rdrImpl* renderer, float* bgColor)
@@ -80,30 +153,119 @@ void rdrSetBackground(rdrImpl* renderer, float* bgColor)
     memcpy(&renderer->uniforms.bgColor, reinterpret_cast<float4*>(bgColor), sizeof(float4));
 }
 
-void rdrSetTexture(rdrImpl* renderer, float* colors32Bits, int width, int height)
+void rdrSetRenderOption(rdrImpl* renderer, rdrRenderOption option, bool enabled)
 {
-    int size = (int)(colors32Bits)[0] ;
-    renderer->textures.push_back( Texture{ (float*)malloc(size * sizeof(float)), width, height, (int)colors32Bits[1] });
-    size_t index = renderer->textures.size() - 1;
-    memcpy(renderer->textures.at(index).colors, &colors32Bits[2], size * sizeof(float));
+    Uniforms& uniforms = renderer->uniforms;
+    switch (option)
+    {
+    case RDR_OPTION_WIREFRAME:         uniforms.wireframe = enabled; break;
+    case RDR_OPTION_RGB_INTERPOLATION: uniforms.RGBInterpolation = enabled; break;
+    case RDR_OPTION_DEPTH_TEST:        uniforms.depthTest = enabled; break;
+    case RDR_OPTION_BACKFACE_CULLING:  uniforms.backfaceCulling = enabled; break;
+    case RDR_OPTION_PHONG:             uniforms.phong = enabled; break;
+    case RDR_OPTION_DEFERRED:          uniforms.deferred = enabled; break;
+    case RDR_OPTION_ALPHA_BLENDING:    uniforms.alphaBlending = enabled; break;
+    }
 }
 
-void drawPixel(float4* colorBuffer, int width, int height, int x, int y, float4 color)
+void rdrSetAlpha(rdrImpl* renderer, float alpha)
 {
-    // access violation error if I put 'y > height' instead of 'y >= height' when y is equal to height
-    if (x < 0 || x > width || y < 0 || y >= height)
+    renderer->uniforms.alpha = alpha;
+}
+
+static bool isValidTexture(const rdrImpl* renderer, rdrTexture texture)
+{
+    return texture > 0 && texture <= renderer->textures.size() && isTextureValid(renderer->textures[texture - 1]);
+}
+
+// Reuses the slot of a destroyed texture if any
+static rdrTexture allocateTexture(rdrImpl* renderer)
+{
+    rdrTexture texture;
+    if (!renderer->freeTextures.empty())
+    {
+        texture = renderer->freeTextures.back();
+        renderer->freeTextures.pop_back();
+    }
+    else
+    {
+        renderer->textures.emplace_back();
+        texture = (rdrTexture)renderer->textures.size();
+    }
+    return texture;
+}
+
+rdrTexture rdrCreateTexture(rdrImpl* renderer, const unsigned char* texels, int width, int height)
+{
+    if (texels == nullptr || width <= 0 || height <= 0)
+        return 0;
+
+    rdrTexture texture = allocateTexture(renderer);
+    initTexture(renderer->textures[texture - 1], texels, width, height);
+    return texture;
+}
+
+rdrTexture rdrCreateTextureFromData(rdrImpl* renderer, const void* data, size_t size, int width, int height)
+{
+    // Texels are read as 32 bits words
+    if (data == nullptr || width <= 0 || height <= 0 || (uintptr_t)data % alignof(unsigned int) != 0)
+        return 0;
+
+    rdrTexture texture = allocateTexture(renderer);
+    if (!initTextureFromLevels(renderer->textures[texture - 1], (const unsigned int*)data, size, width, height))
+    {
+        renderer->freeTextures.push_back(texture);
+        return 0;
+    }
+    return texture;
+}
+
+size_t rdrGetTextureData(rdrImpl* renderer, rdrTexture texture, void* data)
+{
+    if (!isValidTexture(renderer, texture))
+        return 0;
+
+    const Texture& source = renderer->textures[texture - 1];
+    size_t size = getTextureLevelsSize(source);
+    if (data != nullptr)
+        memcpy(data, source.texels, size);
+    return size;
+}
+
+void rdrDestroyTexture(rdrImpl* renderer, rdrTexture texture)
+{
+    if (!isValidTexture(renderer, texture))
         return;
-    colorBuffer[x + y * width] = color;
+
+    if (renderer->uniforms.texture == texture)
+        renderer->uniforms.texture = 0;
+
+    // Release the memory now, the slot is kept for the next texture
+    releaseTexture(renderer->textures[texture - 1]);
+    renderer->freeTextures.push_back(texture);
+}
+
+void rdrBindTexture(rdrImpl* renderer, rdrTexture texture)
+{
+    renderer->uniforms.texture = isValidTexture(renderer, texture) ? texture : 0;
+}
+
+void rdrSetTextureSampling(rdrImpl* renderer, rdrTextureFilter filter, rdrTextureWrap wrap)
+{
+    renderer->uniforms.textureFilter = filter;
+    renderer->uniforms.textureWrap = wrap;
 }
 
-void drawLine(float4* colorBuffer, int width, int height, int x0, int y0, int x1, int y1, float4 color)
+// Only the pixels inside the clip rect are written, so a line crossing several tiles can be drawn by each tile's thread
+void drawLine(const Framebuffer& fb, const TileRect& clip, int x0, int y0, int x1, int y1, const float4& color)
 {
     int dx = abs(x1 - x0), sx = x0 < x1 ? 1 : -1;
     int dy = abs(y1 - y0), sy = y0 < y1 ? 1 : -1;
     int err = (dx > dy ? dx : -dy) / 2, e2;
 
     for (;;) {
-        drawPixel(colorBuffer, width, height, x0, y0, color);
+        if (x0 >= clip.minX && x0 < clip.maxX && y0 >= clip.minY && y0 < clip.maxY)
+            storeColor(fb, x0 + y0 * fb.width, color);
         if (x0 == x1 && y0 == y1) break;
         e2 = err;
         if (e2 > -dx) { err -= dy; x0 += sx; }
@@ -111,9 +273,9 @@ void drawLine(float4* colorBuffer, int width, int height, int x0, int y0, int x1
     }
 }
 
-void drawLine(const Framebuffer& fb, float2 p0, float2 p1, float4 color)
+void drawLine(const Framebuffer& fb, const TileRect& tile, float2 p0, float2 p1, float4 color)
 {
-    drawLine(fb.colorBuffer, fb.width, fb.height, (int)roundf(p0.x), (int)roundf(p0.y), (int)roundf(p1.x), (int)roundf(p1.y), color);
+    drawLine(fb, tile, (int)roundf(p0.x), (int)roundf(p0.y), (int)roundf(p1.x), (int)roundf(p1.y), color);
 }
 
 float2 remap(float origFrom, float origTo, float targetFrom, float targetTo, float value)
@@ -126,58 +288,62 @@ float3 ndcToScreenCoords(float3 ndc, const Viewport& viewport)
     return { 
         ((ndc.x / 2.f) + 0.5f) * viewport.width, 
         (1.f - ((ndc.y / 2.f) + 0.5f)) * viewport.height,
-        (-(1.f / ndc.z) + 1.f) / 2.f
+        // [-1, 0] from near to far, so depth buffers cleared to 0 are at the far plane
+        // Affine in ndc.z so it can be interpolated linearly in screen space
+        (ndc.z - 1.f) / 2.f
     };
 }
 
-bool isOutside(float4 clipCoord)
+// Signed distance to a clip plane, positive inside
+// guardBand scales the x and y planes, 1 for the view frustum itself
+float getClipDistance(const float4& position, int plane, float2 guardBand)
 {
-    return clipCoord.w < 0.f 
-        || clipCoord.x > clipCoord.w
-        || clipCoord.x < -clipCoord.w
-        || clipCoord.y > clipCoord.w
-        || clipCoord.y < -clipCoord.w
-        || clipCoord.z > clipCoord.w
-        || clipCoord.z < -clipCoord.w;
+    switch (plane)
+    {
+    case CLIP_NEAR:   return position.w + position.z;
+    case CLIP_FAR:    return position.w - position.z;
+    case CLIP_LEFT:   return guardBand.x * position.w + position.x;
+    case CLIP_RIGHT:  return guardBand.x * position.w - position.x;
+    case CLIP_BOTTOM: return guardBand.y * position.w + position.y;
+    default:          return guardBand.y * position.w - position.y;
+    }
 }
 
-
-bool isInsideTriangle(float2 pixelCoord, float3* screenCoords)
+ClipVertex lerpClipVertex(const ClipVertex& a, const ClipVertex& b, float t)
 {
-    float2 p0 = screenCoords[0].xy; float2 p1 = screenCoords[1].xy; float2 p2 = screenCoords[2].xy;
-
-    auto s = p0.y * p2.x - p0.x * p2.y + (p2.y - p0.y) * pixelCoord.x + (p0.x - p2.x) * pixelCoord.y;
-    auto t = p0.x * p1.y - p0.y * p1.x + (p0.y - p1.y) * pixelCoord.x + (p1.x - p0.x) * pixelCoord.y;
-
-    if ((s < 0) != (t < 0))
-        return false;
-
-    auto A = -p1.y * p2.x + p0.y * (p2.x - p1.x) + p0.x * (p1.y - p2.y) + p1.x * p2.y;
-
-    return A < 0 ?
-        (s <= 0 && s + t >= A) :
-        (s >= 0 && s + t <= A);
+    ClipVertex result;
+    for (int i = 0; i < 4; ++i)
+        result.position.e[i] = a.position.e[i] + (b.position.e[i] - a.position.e[i]) * t;
+    result.varyings.color = a.varyings.color + (b.varyings.color - a.varyings.color) * t;
+    result.varyings.worldCoords = a.varyings.worldCoords + (b.varyings.worldCoords - a.varyings.worldCoords) * t;
+    result.varyings.normalWCoords = a.varyings.normalWCoords + (b.varyings.normalWCoords - a.varyings.normalWCoords) * t;
+    for (int i = 0; i < 2; ++i)
+        result.varyings.uv.e[i] = a.varyings.uv.e[i] + (b.varyings.uv.e[i] - a.varyings.uv.e[i]) * t;
+    return result;
 }
 
-// using barycentric coordinates to find weighted average of the 3 screen coordinates in the triangle
-bool getVerticesWeight(float3& w, float2 pixelCoord, float3 screenCoords[3])
+// Sutherland-Hodgman clipping of a convex polygon against one plane
+// Returns the vertex count of the clipped polygon
+int clipPolygon(const ClipVertex* in, int count, ClipVertex* out, int plane, float2 guardBand)
 {
-    w.e[0] = (((screenCoords[1].y - screenCoords[2].y) * (pixelCoord.x - screenCoords[2].x)) +
-        ((screenCoords[2].x - screenCoords[1].x) * (pixelCoord.y - screenCoords[2].y))) /
-        (((screenCoords[1].y - screenCoords[2].y) * (screenCoords[0].x - screenCoords[2].x)) +
-        ((screenCoords[2].x - screenCoords[1].x) * (screenCoords[0].y - screenCoords[2].y)));
-
-    w.e[1] = (((screenCoords[2].y - screenCoords[0].y) * (pixelCoord.x - screenCoords[2].x)) +
-        ((screenCoords[0].x - screenCoords[2].x) * (pixelCoord.y - screenCoords[2].y))) /
-        (((screenCoords[1].y - screenCoords[2].y) * (screenCoords[0].x - screenCoords[2].x)) +
-        ((screenCoords[2].x - screenCoords[1].x) * (screenCoords[0].y - screenCoords[2].y)));
-
-    w.e[2] = 1.f - w.e[0] - w.e[1];
-
-    return (w.e[0] >= 0.f) && 
-        (w.e[1] >= 0.f) && 
-        (w.e[2] >= 0.f) && 
-        isInsideTriangle(pixelCoord, screenCoords);
+    int outCount = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        const ClipVertex& a = in[i];
+        const ClipVertex& b = in[(i + 1) % count];
+        float distA = getClipDistance(a.position, plane, guardBand);
+        float distB = getClipDistance(b.position, plane, guardBand);
+
+        if (distA >= 0.f)
+            out[outCount++] = a;
+
+        // Always interpolated from the inside vertex, so an edge shared by two triangles is cut at the same point
+        if (distA >= 0.f && distB < 0.f)
+            out[outCount++] = lerpClipVertex(a, b, distA / (distA - distB));
+        else if (distA < 0.f && distB >= 0.f)
+            out[outCount++] = lerpClipVertex(b, a, distB / (distB - distA));
+    }
+    return outCount;
 }
 
 
@@ -214,7 +380,13 @@ float3 getShadedColor(const float3& camPos, const Light& light, float3 position,
     if (!light.enabled)
         return { 0.f, 0.f, 0.f };
 
-    float3 lightVec = maths::normalize(light.position.xyz - position);
+    // Cut at the radius the lights are culled with, so culling never changes the result
+    float3 toLight = light.position.xyz - position;
+    float radius = getLightRadius(light);
+    if (radius >= 0.f && maths::dotProduct(toLight, toLight) > radius * radius)
+        return { 0.f, 0.f, 0.f };
+
+    float3 lightVec = maths::normalize(toLight);
 
     float3 diffuseColor = kd * getDiffuse(lightVec, maths::normalize(normal)) * light.diffuse.rgb;
     float3 ambientColor = ka * light.ambient.rgb;
@@ -222,65 +394,52 @@ float3 getShadedColor(const float3& camPos, const Light& light, float3 position,
 
     if (light.attnEnabled)
     {
-        float3 attenuationColor = getAttenuation(light.position.xyz - position, light) * light.attenuation;
+        float3 attenuationColor = getAttenuation(toLight, light) * light.attenuation;
         return attenuationColor * (ambientColor + diffuseColor + specularColor);
     }
     return ambientColor + diffuseColor + specularColor;
-
-    
 }
 
-static void vertexShader(const Uniforms& uniforms, const Texture& texture, const float3& rgb, const rdrVertex& vertex, Varyings& out, 
-    const float4& worldCoord4, const float4& normalWCoord4, const float3& camPos)
+float3 getLighting(const float3& camPos, const Light* lights, const LightList& list, float3 position, float3 normal)
 {
+    float3 color = { 0.f, 0.f, 0.f };
+    for (int i = 0; i < list.count; ++i)
+        color += getShadedColor(camPos, lights[list.indices[i]], position, normal);
+    return color;
+}
 
-    float2 texel = {};
-    if (!uniforms.wireframe)
+// Runs once per vertex of the draw, whatever the number of triangles using it
+static void vertexShader(const DrawState& state, const Light* lights, const LightList& activeLights, Varyings& out, const float4& worldCoord4, const float4& normalWCoord4)
+{
+    out = {};
+    if (state.perPixel)
     {
-        if (uniforms.RGBInterpolation)
-        {
-            out.color = rgb;
-        }
-        else
-        {
-            // mapping colors on texture to pixels on the screen
-            float* texColors = texture.colors;
+        out.worldCoords = worldCoord4.xyz;
+        out.normalWCoords = normalWCoord4.xyz;
+    }
+    else if (state.vertexLighting)
+    {
+        out.color = getLighting(state.transform.camPos, lights, activeLights, worldCoord4.xyz, normalWCoord4.xyz);
+    }
+}
 
-            // Fix for poorly mapped uv textures
-            // rare cases where the u or v is below 0 or greater than 1
-            float u = vertex.u < 0.f ? 0.0001f : vertex.u > 1.f ? 0.9999f : vertex.u;
-            float v = vertex.v < 0.f ? 0.0001f : vertex.v > 1.f ? 0.9999f : vertex.v;
+// Color of the vertex, or the debug color of the triangle corner
+// Textured draws have no base color here, the texture is sampled per pixel
+static float3 getBaseColor(const Uniforms& uniforms, const DrawState& state, const float3& rgb, const rdrVertex& vertex)
+{
+    if (uniforms.RGBInterpolation)
+        return rgb;
 
-            texel = { floorf(u * texture.width), floorf(v * texture.height) };
+    if (state.texture != nullptr)
+        return { 0.f, 0.f, 0.f };
 
-            int index = 4 * ((int)texel.y * texture.width + (int)texel.x);
-            out.color = { static_cast<int>(texColors[index + 0]) / 255.f,
-                static_cast<int>(texColors[index + 1]) / 255.f,
-                static_cast<int>(texColors[index + 2]) / 255.f
-            };
-        }
-        
-        if (uniforms.phong)
-        {
-            out.worldCoords = worldCoord4.xyz;
-            out.normalWCoords = normalWCoord4.xyz;
-        }
-        else
-        {
-            if (uniforms.light.enabled)
-                out.color += getShadedColor(camPos, uniforms.light, worldCoord4.xyz, normalWCoord4.xyz);
-        }
-    }
+    return { vertex.r, vertex.g, vertex.b };
 }
 
-
-static float4 pixelShader(const Uniforms& uniforms, const float2 pixel, const Varyings& in, const float3& camPos)
+static float4 pixelShader(const Uniforms& uniforms, const DrawState& state, const LightList& tileLights, const float2 pixel, const Varyings& in)
 {
-    if (uniforms.phong)
-    {
-        if (uniforms.light.enabled)  
-            return { in.color + getShadedColor(camPos, uniforms.light, in.worldCoords, maths::normalize(in.normalWCoords)), uniforms.alpha };
-    }
+    if (state.pixelLighting)
+        return { in.color + getLighting(state.transform.camPos, uniforms.lights, tileLights, in.worldCoords, maths::normalize(in.normalWCoords)), uniforms.alpha };
 
     return { in.color, uniforms.alpha };
 }
@@ -298,27 +457,13 @@ Varyings interpolateVaryings(const Varyings* varyings, const float3& w)
         r.worldCoords.e[i] = { w.e[0] * varyings[0].worldCoords.e[i] + w.e[1] * varyings[1].worldCoords.e[i] + w.e[2] * varyings[2].worldCoords.e[i] };
         r.normalWCoords.e[i] = { w.e[0] * varyings[0].normalWCoords.e[i] + w.e[1] * varyings[1].normalWCoords.e[i] + w.e[2] * varyings[2].normalWCoords.e[i] };
     }
+    for (int i = 0; i < 2; ++i)
+        r.uv.e[i] = w.e[0] * varyings[0].uv.e[i] + w.e[1] * varyings[1].uv.e[i] + w.e[2] * varyings[2].uv.e[i];
 
     return r;
 }
 
-// determines what pixel to display based on value of pixel in depth buffer
-// versus any new depth value at that same pixel
-bool depthTest(Framebuffer& fb, float2 p, float z )
-{
-    if (p.x < 0.f || p.x >= fb.width || p.y < 0 || p.y >= fb.height)
-        return false;
-
-    int index = p.y * fb.width + p.x;
-    if (z < fb.depthBuffer[index])
-    {
-        fb.depthBuffer[index] = z;
-        return true;
-    }
-    return false;
-}
-
-float getDepth(float3 screenCoords[3], float3 w)
+float getDepth(const float3 screenCoords[3], const float3& w)
 {
     return (w.e[0] * screenCoords[0].z) + (w.e[1] * screenCoords[1].z) + (w.e[2] * screenCoords[2].z);
 }
@@ -337,61 +482,293 @@ float4 alphaBlending(float4 shadedColor, const float4& bg)
     return { color, alpha };
 }
 
-void pixelCalculations(const Varyings* varyings, const float3& w, const Uniforms& uniforms, Framebuffer& fb, float2 pixel, const float3& camPos)
+void pixelCalculations(const TriangleSetup& triangle, const float3& w, const Uniforms& uniforms, const DrawState& state, const LightList& tileLights,
+    Framebuffer& fb, GBuffer& gBuffer, float2 pixel)
 {
-    Varyings pixelVaryings = interpolateVaryings(varyings, w);
-    float4 shadedColor = pixelShader(uniforms, pixel, pixelVaryings, camPos);
+    Varyings pixelVaryings = interpolateVaryings(triangle.varyings, w);
+
+    // Added before shading, so deferred pixels keep the texture in their albedo
+    if (state.texture != nullptr)
+    {
+        // The mip level comes from the derivatives of uv = (uv / w) / (1 / w) at this pixel
+        float invW = w.e[0] * triangle.invW[0] + w.e[1] * triangle.invW[1] + w.e[2] * triangle.invW[2];
+        float2 uv;
+        float2 uvStepX;
+        float2 uvStepY;
+        for (int k = 0; k < 2; ++k)
+        {
+            uv.e[k] = pixelVaryings.uv.e[k] / invW;
+            uvStepX.e[k] = (triangle.uvStepX.e[k] - uv.e[k] * triangle.invWStepX) / invW;
+            uvStepY.e[k] = (triangle.uvStepY.e[k] - uv.e[k] * triangle.invWStepY) / invW;
+        }
+        float lod = getTextureLod(*state.texture, uvStepX, uvStepY);
+        pixelVaryings.color = pixelVaryings.color + sampleTexture(*state.texture, uniforms.textureFilter, uniforms.textureWrap, uv, lod);
+    }
+
+    int index = (int)pixel.y * fb.width + (int)pixel.x;
+    if (state.deferred)
+    {
+        // Shaded later by rdrEndFrame(), once per visible pixel
+        gBuffer.albedo[index] = packAlbedo(pixelVaryings.color);
+        gBuffer.normal[index] = packNormal(pixelVaryings.normalWCoords);
+        gBuffer.worldCoords[index] = pixelVaryings.worldCoords;
+        return;
+    }
+
+    // Forward shaded pixel drawn over a deferred one
+    if (gBuffer.used)
+        gBuffer.albedo[index] = 0;
+
+    float4 shadedColor = pixelShader(uniforms, state, tileLights, pixel, pixelVaryings);
     if (uniforms.alphaBlending)
-        drawPixel(fb.colorBuffer, fb.width, fb.height, (int)pixel.x, (int)pixel.y, alphaBlending(shadedColor, uniforms.bgColor));
+        storeColor(fb, index, alphaBlending(shadedColor, uniforms.bgColor));
     else
-        drawPixel(fb.colorBuffer, fb.width, fb.height, (int)pixel.x, (int)pixel.y, shadedColor);
+        storeColor(fb, index, shadedColor);
+}
+
+long long evaluateEdge(const EdgeFunction& edge, int x, int y)
+{
+    return (long long)edge.a * (x << SUBPIXEL_BITS) + (long long)edge.b * (y << SUBPIXEL_BITS) + edge.c;
 }
 
-void rasterizeTriangle(Framebuffer& fb, const Uniforms& uniforms, float3 screenCoords[3], const Varyings* varyings, const float3& camPos)
+// Computes the edge equations once per triangle, in fixed-point
+// Returns false for degenerate triangles, which cover no pixel
+bool setupEdges(TriangleSetup& triangle)
 {
-    int minX = maths::min(maths::min((int)screenCoords[0].x, (int)screenCoords[1].x), (int)screenCoords[2].x);
-    int maxX = maths::max(maths::max((int)screenCoords[0].x, (int)screenCoords[1].x), (int)screenCoords[2].x);
-    int minY = maths::min(maths::min((int)screenCoords[0].y, (int)screenCoords[1].y), (int)screenCoords[2].y);
-    int maxY = maths::max(maths::max((int)screenCoords[0].y, (int)screenCoords[1].y), (int)screenCoords[2].y);
+    float3* screenCoords = triangle.screenCoords;
 
-    for (int y = minY; y <= maxY; ++y)
+    int x[3];
+    int y[3];
+    for (int i = 0; i < 3; ++i)
     {
-        for (int x = minX; x <= maxX; ++x)
+        x[i] = (int)lroundf(screenCoords[i].x * SUBPIXEL_ONE);
+        y[i] = (int)lroundf(screenCoords[i].y * SUBPIXEL_ONE);
+    }
+
+    long long area = (long long)(x[1] - x[0]) * (y[2] - y[0]) - (long long)(x[2] - x[0]) * (y[1] - y[0]);
+    if (area == 0)
+        return false;
+
+    // Both windings are drawn, make them all positive so the inside is always E >= 0
+    if (area < 0)
+    {
+        std::swap(x[1], x[2]);
+        std::swap(y[1], y[2]);
+        std::swap(screenCoords[1], screenCoords[2]);
+        std::swap(triangle.varyings[1], triangle.varyings[2]);
+        std::swap(triangle.invW[1], triangle.invW[2]);
+        area = -area;
+    }
+
+    for (int i = 0; i < 3; ++i)
+    {
+        int j = (i + 1) % 3;
+        int k = (i + 2) % 3;
+
+        EdgeFunction& edge = triangle.edges[i];
+        edge.a = y[j] - y[k];
+        edge.b = x[k] - x[j];
+        edge.c = (long long)x[j] * y[k] - (long long)y[j] * x[k];
+
+        // Top-left fill rule: pixels exactly on an edge belong to the triangle only for top and left edges
+        // so pixels shared by two triangles are drawn once
+        bool topLeft = edge.a > 0 || (edge.a == 0 && edge.b > 0);
+        if (!topLeft)
+            edge.c -= 1;
+    }
+
+    triangle.invArea = 1.f / (float)area;
+    triangle.minZ = maths::min(maths::min(screenCoords[0].z, screenCoords[1].z), screenCoords[2].z);
+    triangle.maxZ = maths::max(maths::max(screenCoords[0].z, screenCoords[1].z), screenCoords[2].z);
+
+    // Pixel x samples the triangle at (x, y)
+    triangle.minX = (maths::min(maths::min(x[0], x[1]), x[2]) + SUBPIXEL_ONE - 1) >> SUBPIXEL_BITS;
+    triangle.maxX = maths::max(maths::max(x[0], x[1]), x[2]) >> SUBPIXEL_BITS;
+    triangle.minY = (maths::min(maths::min(y[0], y[1]), y[2]) + SUBPIXEL_ONE - 1) >> SUBPIXEL_BITS;
+    triangle.maxY = maths::max(maths::max(y[0], y[1]), y[2]) >> SUBPIXEL_BITS;
+
+    return true;
+}
+
+enum class DepthMode
+{
+    NONE,       // No depth test
+    TEST,       // Depth test and write
+    WRITE_ONLY, // The block is known to pass the depth test, only write
+};
+
+// Draws the pixels of [x0, x1] x [y0, y1] covered by the triangle
+// Coverage, depth test and depth write are done by the SIMD kernel for a whole row at once,
+// then only the pixels that passed are shaded
+void rasterizeBlock(Framebuffer& fb, GBuffer& gBuffer, const Uniforms& uniforms, const DrawState& state, const LightList& tileLights, RasterRowFunc rasterRow, const TriangleSetup& triangle,
+    int x0, int y0, int x1, int y1, const bool crossingEdges[3], DepthMode depthMode, PipelineCounters& counters)
+{
+    const EdgeFunction* edges = triangle.edges;
+
+    // Everything is stepped by addition from one pixel to the next
+    float3 wStepX;
+    for (int i = 0; i < 3; ++i)
+        wStepX.e[i] = edges[i].a * SUBPIXEL_ONE * triangle.invArea;
+
+    // The kernels test and write depths in the units of the depth buffer
+    float depthScale = getDepthScale(fb.depthFormat);
+
+    RasterRow row;
+    row.count = x1 - x0 + 1;
+    row.depthStep = getDepth(triangle.screenCoords, wStepX) * depthScale;
+
+    // Edges not crossing the block are positive on all its pixels, so they don't need to be tested,
+    // the others fit in 32 bits inside the block
+    for (int i = 0; i < 3; ++i)
+        row.edgeSteps[i] = crossingEdges[i] ? edges[i].a * SUBPIXEL_ONE : 0;
+
+    int coveredCount = 0;
+    int passedCount = 0;
+    for (int y = y0; y <= y1; ++y)
+    {
+        float3 w;
+        for (int i = 0; i < 3; ++i)
         {
-            float2 pixel = { (float)x, (float)y };
-            float3 w;
-            if (getVerticesWeight(w, pixel, screenCoords))
+            long long e = evaluateEdge(edges[i], x0, y);
+            row.edges[i] = crossingEdges[i] ? (int)e : 0;
+            w.e[i] = e * triangle.invArea;
+        }
+        row.depth = getDepth(triangle.screenCoords, w) * depthScale;
+
+        int rowIndex = y * fb.width + x0;
+        unsigned int coveredMask;
+        unsigned int mask = rasterRow(row, depthMode == DepthMode::TEST ? getDepthAddress(fb, rowIndex) : nullptr, coveredMask);
+        coveredCount += countPixels(coveredMask);
+        passedCount += countPixels(mask);
+
+        for (int i = 0; mask != 0; ++i, mask >>= 1)
+        {
+            if (mask & 1)
             {
-                if (uniforms.depthTest)
-                {
-                    if (depthTest(fb, pixel, getDepth(screenCoords, w)))
-                    {
-                        pixelCalculations(varyings, w, uniforms, fb, pixel, camPos);
-                    }
-                }
-                else
-                {
-                    pixelCalculations(varyings, w, uniforms, fb, pixel, camPos);
-                }
+                if (depthMode == DepthMode::WRITE_ONLY)
+                    storeDepth(fb, rowIndex + i, row.depth + (float)i * row.depthStep);
+
+                float2 pixel = { (float)(x0 + i), (float)y };
+                pixelCalculations(triangle, w + (float)i * wStepX, uniforms, state, tileLights, fb, gBuffer, pixel);
+                if (state.overdraw != nullptr)
+                    addOverdraw(*state.overdraw, rowIndex + i);
             }
         }
     }
+
+    counters.pixelsCovered += coveredCount;
+    if (depthMode != DepthMode::NONE)
+    {
+        counters.depthTestsPassed += passedCount;
+        counters.depthTestsFailed += coveredCount - passedCount;
+    }
+
+    // Deferred pixels are counted when lit, by rdrEndFrame()
+    if (!state.deferred)
+        counters.pixelsShaded += passedCount;
 }
 
-bool isBackface(const Uniforms& uniforms, const rdrVertex& vertex, float4& worldCoord, float4& worldNormal, const float3& camPos)
+void rasterizeTriangle(rdrImpl* renderer, const TriangleSetup& triangle, const TileRect& tile, const LightList& tileLights, bool useHiZ, DepthCullCounters& counters, PipelineCounters& pipelineCounters)
 {
-    float3 localCoords = { vertex.x, vertex.y, vertex.z };
-    worldCoord = uniforms.model * float4{ localCoords , 1.f };
-
-    float3 localNormalCoords = { vertex.nx, vertex.ny, vertex.nz };
-    worldNormal = uniforms.model * float4{ localNormalCoords , 0.f };
+    Framebuffer& fb = renderer->fb;
+    const Uniforms& uniforms = renderer->uniforms;
+    DepthHierarchy& hiZ = renderer->hiZ;
+
+    // Only the part of the bounding box covered by the tile belongs to this thread
+    int minX = maths::max(triangle.minX, tile.minX);
+    int maxX = maths::min(triangle.maxX, tile.maxX - 1);
+    int minY = maths::max(triangle.minY, tile.minY);
+    int maxY = maths::min(triangle.maxY, tile.maxY - 1);
+
+    // Depth plane, to bound the depth of the triangle inside each block
+    float3 wStepX;
+    float3 wStepY;
+    for (int i = 0; i < 3; ++i)
+    {
+        wStepX.e[i] = triangle.edges[i].a * SUBPIXEL_ONE * triangle.invArea;
+        wStepY.e[i] = triangle.edges[i].b * SUBPIXEL_ONE * triangle.invArea;
+    }
+    float blockDepthStepX = getDepth(triangle.screenCoords, wStepX) * (BLOCK_SIZE - 1);
+    float blockDepthStepY = getDepth(triangle.screenCoords, wStepY) * (BLOCK_SIZE - 1);
 
-    if (uniforms.backfaceCulling && !uniforms.wireframe)
+    // Whole blocks are rejected, or have some edges accepted, by looking at the edge functions on their corners
+    for (int blockY = minY & ~(BLOCK_SIZE - 1); blockY <= maxY; blockY += BLOCK_SIZE)
     {
-        if (maths::dotProduct(maths::normalize(camPos - worldCoord.xyz), maths::normalize(worldNormal.xyz)) <= 0.f)
-            return true;
+        for (int blockX = minX & ~(BLOCK_SIZE - 1); blockX <= maxX; blockX += BLOCK_SIZE)
+        {
+            bool outside = false;
+            bool crossingEdges[3];
+            float3 w;
+            for (int i = 0; i < 3; ++i)
+            {
+                const EdgeFunction& edge = triangle.edges[i];
+                long long e = evaluateEdge(edge, blockX, blockY);
+                long long stepX = (long long)edge.a * SUBPIXEL_ONE * (BLOCK_SIZE - 1);
+                long long stepY = (long long)edge.b * SUBPIXEL_ONE * (BLOCK_SIZE - 1);
+
+                long long eMin = e + (stepX < 0 ? stepX : 0) + (stepY < 0 ? stepY : 0);
+                long long eMax = e + (stepX > 0 ? stepX : 0) + (stepY > 0 ? stepY : 0);
+                if (eMax < 0)
+                {
+                    outside = true;
+                    break;
+                }
+                crossingEdges[i] = eMin < 0;
+                w.e[i] = e * triangle.invArea;
+            }
+
+            if (outside)
+                continue;
+
+            int x0 = maths::max(blockX, minX);
+            int y0 = maths::max(blockY, minY);
+            int x1 = maths::min(blockX + BLOCK_SIZE - 1, maxX);
+            int y1 = maths::min(blockY + BLOCK_SIZE - 1, maxY);
+
+            DepthMode depthMode = uniforms.depthTest ? DepthMode::TEST : DepthMode::NONE;
+            int blockIndex = (blockY / BLOCK_SIZE) * hiZ.blockCountX + blockX / BLOCK_SIZE;
+            float nearest = triangle.minZ;
+            if (useHiZ)
+            {
+                // Depth range of the triangle inside the block
+                float depth = getDepth(triangle.screenCoords, w);
+                nearest = depth + maths::min(blockDepthStepX, 0.f) + maths::min(blockDepthStepY, 0.f);
+                float farthest = depth + maths::max(blockDepthStepX, 0.f) + maths::max(blockDepthStepY, 0.f);
+                nearest = maths::max(nearest, triangle.minZ);
+                farthest = maths::min(farthest, triangle.maxZ);
+
+                counters.blocksTested++;
+                if (!(nearest < hiZ.blockMax[blockIndex]))
+                {
+                    counters.blocksRejected++;
+                    continue;
+                }
+                if (farthest < hiZ.blockMin[blockIndex])
+                {
+                    counters.blocksAccepted++;
+                    depthMode = DepthMode::WRITE_ONLY;
+                }
+            }
+
+            // The block belongs to this tile, so no other thread touches it
+            touchBlock(renderer->fastClear, fb, blockX / BLOCK_SIZE, blockY / BLOCK_SIZE);
+            rasterizeBlock(fb, renderer->gBuffer, uniforms, renderer->drawState, tileLights, renderer->backend.rasterRow, triangle, x0, y0, x1, y1, crossingEdges, depthMode, pipelineCounters);
+
+            if (useHiZ)
+            {
+                // Once every pixel of the block has been covered, its farthest depth can only be nearer
+                bool fullyCovered = !crossingEdges[0] && !crossingEdges[1] && !crossingEdges[2]
+                    && x0 == blockX && y0 == blockY
+                    && x1 == maths::min(blockX + BLOCK_SIZE, fb.width) - 1
+                    && y1 == maths::min(blockY + BLOCK_SIZE, fb.height) - 1;
+
+                if (fullyCovered)
+                    updateDepthBlock(hiZ, fb, blockX / BLOCK_SIZE, blockY / BLOCK_SIZE);
+                else
+                    hiZ.blockMin[blockIndex] = maths::min(hiZ.blockMin[blockIndex], nearest);
+            }
+        }
     }
-    return false;
 }
 
 float3 getCamPos(const mat4x4& view)
@@ -410,119 +787,947 @@ float3 getCamPos(const mat4x4& view)
 }
 
 
-void drawTriangle(rdrImpl* renderer, rdrVertex* vertices, int vertexIndex)
+// Vertex stage: transforms and lights every vertex of the draw, in parallel batches
+// Positions and normals go through the SIMD kernel as structure of arrays, only the lighting is done per vertex
+void transformVertices(rdrImpl* renderer, const rdrVertex* vertices, int vertexCount)
 {
-    Varyings varyings[3];
+    TRACE_SCOPE("Vertex Processing");
+
+    const DrawState& state = renderer->drawState;
+    std::vector<TransformedVertex>& transformedVertices = renderer->transformedVertices;
+    transformedVertices.resize(vertexCount);
+
+    TransformVerticesFunc transformBatch = renderer->backend.transformVertices;
+
+    // Vertices are not binned, they test every light against its radius
+    const LightList activeLights = { renderer->lightGrid.lights.data(), (int)renderer->lightGrid.lights.size() };
+
+    int batchCount = (vertexCount + VERTEX_BATCH_SIZE - 1) / VERTEX_BATCH_SIZE;
+    renderer->backend.threadPool.parallelFor(batchCount, [&](int batchIndex, int threadIndex)
+    {
+        TRACE_SCOPE("Vertex Batch");
+
+        VertexBatch batch;
+        int first = batchIndex * VERTEX_BATCH_SIZE;
+        batch.count = maths::min(VERTEX_BATCH_SIZE, vertexCount - first);
+
+        for (int i = 0; i < VERTEX_BATCH_SIZE; ++i)
+        {
+            // Lanes past the end are transformed too, give them something harmless
+            const rdrVertex& vertex = vertices[first + maths::min(i, batch.count - 1)];
+            batch.positions[0][i] = vertex.x;
+            batch.positions[1][i] = vertex.y;
+            batch.positions[2][i] = vertex.z;
+            batch.normals[0][i] = vertex.nx;
+            batch.normals[1][i] = vertex.ny;
+            batch.normals[2][i] = vertex.nz;
+        }
+
+        transformBatch(state.transform, batch);
 
-    int t = 0;
-    int texCount = renderer->textures.size();
-    int vCount = 0;
+        for (int i = 0; i < batch.count; ++i)
+        {
+            TransformedVertex& out = transformedVertices[first + i];
+            out.backface = state.backfaceCulling && batch.facing[i] <= 0.f;
+            if (out.backface)
+                continue;
+
+            out.clipCoords = { batch.clipCoords[0][i], batch.clipCoords[1][i], batch.clipCoords[2][i], batch.clipCoords[3][i] };
+            out.outcode = batch.outcodes[i];
+            out.guardBandOutcode = batch.guardBandOutcodes[i];
+
+            float4 worldCoord4 = { batch.worldCoords[0][i], batch.worldCoords[1][i], batch.worldCoords[2][i], batch.worldCoords[3][i] };
+            float4 worldNormal4 = { batch.worldNormals[0][i], batch.worldNormals[1][i], batch.worldNormals[2][i], 0.f };
+            vertexShader(state, renderer->uniforms.lights, activeLights, out.varyings, worldCoord4, worldNormal4);
+        }
+    });
+}
 
-    for (int i = 0; i < texCount; ++i)
+// Front end: assembles one triangle from the vertex stage output, clips it and prepares the result for the tile workers
+// Returns the number of triangles written to 'triangles', 0 when the triangle is culled
+int setupTriangles(const rdrImpl* renderer, const rdrVertex* vertices, const unsigned int corners[3], TriangleSetup* triangles, PipelineCounters& counters)
+{
+    const DrawState& state = renderer->drawState;
+
+    const TransformedVertex* transformed[3];
+    for (int i = 0; i < 3; ++i)
     {
-        vCount += renderer->textures.at(i).vertexCount;
-        if (vertexIndex <= vCount)
+        transformed[i] = &renderer->transformedVertices[corners[i]];
+        if (transformed[i]->backface)
         {
-            t = i;
-            break;
+            counters.trianglesBackfaceCulled++;
+            return 0;
         }
     }
 
-    
-    float3 camPos = {};
-    // Getting the camera position is expensive because of the inverse matrix calculation
-    // So I'm limiting how often the calculation is performed.
-    // I'm also passing the camPos to the rasterizeTriangle() function to avoid needing
-    // to perform the calculation again for specular lighting.
-    if (!renderer->uniforms.wireframe && (renderer->uniforms.backfaceCulling || renderer->uniforms.light.enabled))
-        camPos = getCamPos(renderer->uniforms.view);
-
-    float4 worldCoord4[3];
-    float4 worldNormal4[3];
-
-    float4 clipCoords[3];
+    // Triangles entirely outside one of the frustum planes are culled
+    if (transformed[0]->outcode & transformed[1]->outcode & transformed[2]->outcode)
+    {
+        counters.trianglesOutside++;
+        return 0;
+    }
+
+    ClipVertex polygons[2][MAX_CLIP_VERTICES];
+    ClipVertex* polygon = polygons[0];
     float3 rgb[3] = { {1.f, 0.f, 0.f}, {0.f, 1.f, 0.f}, {0.f, 0.f, 1.f} };
     for (int i = 0; i < 3; ++i)
     {
-        if (isBackface(renderer->uniforms, vertices[i], worldCoord4[i], worldNormal4[i], camPos))
-            return;
+        const TransformedVertex& vertex = *transformed[i];
+        polygon[i].position = vertex.clipCoords;
+        polygon[i].varyings = vertex.varyings;
+        polygon[i].varyings.uv = { vertices[corners[i]].u, vertices[corners[i]].v };
+        if (!renderer->uniforms.wireframe)
+            polygon[i].varyings.color = getBaseColor(renderer->uniforms, state, rgb[i], vertices[corners[i]]) + vertex.varyings.color;
+    }
+
+    // The others only need to be clipped against the near and far planes, and the guard band
+    int clipPlanes = transformed[0]->guardBandOutcode | transformed[1]->guardBandOutcode | transformed[2]->guardBandOutcode;
+    int vertexCount = 3;
+    for (int plane = 0; plane < CLIP_PLANE_COUNT && vertexCount >= 3; ++plane)
+    {
+        if (clipPlanes & (1 << plane))
+        {
+            ClipVertex* clipped = polygon == polygons[0] ? polygons[1] : polygons[0];
+            vertexCount = clipPolygon(polygon, vertexCount, clipped, plane, state.transform.guardBand);
+            polygon = clipped;
+        }
+    }
+
+    // clip -> NDC -> screen coords
+    // perspective divide in graphics pipeline
+    float3 screenCoords[MAX_CLIP_VERTICES];
+    for (int i = 0; i < vertexCount; ++i)
+    {
+        float3 ndcCoords = polygon[i].position.xyz / polygon[i].position.w;
+        screenCoords[i] = ndcToScreenCoords(ndcCoords, renderer->viewport);
+    }
+
+    // Bounding boxes are clamped to the screen here, so the tile workers never write outside of it
+    int screenMaxX = maths::min(renderer->viewport.width, renderer->fb.width) - 1;
+    int screenMaxY = maths::min(renderer->viewport.height, renderer->fb.height) - 1;
+
+    // The clipped polygon is convex, drawn as a triangle fan
+    int triangleCount = 0;
+    for (int i = 1; i + 1 < vertexCount; ++i)
+    {
+        TriangleSetup& triangle = triangles[triangleCount];
+        const int fan[3] = { 0, i, i + 1 };
+        for (int j = 0; j < 3; ++j)
+        {
+            triangle.screenCoords[j] = screenCoords[fan[j]];
+            triangle.varyings[j] = polygon[fan[j]].varyings;
+            triangle.invW[j] = 1.f / polygon[fan[j]].position.w;
+            triangle.varyings[j].uv.x *= triangle.invW[j];
+            triangle.varyings[j].uv.y *= triangle.invW[j];
+        }
+
+        if (!renderer->uniforms.wireframe)
+        {
+            if (!setupEdges(triangle))
+                continue;
+
+            if (state.texture != nullptr)
+            {
+                triangle.uvStepX = { 0.f, 0.f };
+                triangle.uvStepY = { 0.f, 0.f };
+                triangle.invWStepX = 0.f;
+                triangle.invWStepY = 0.f;
+                for (int j = 0; j < 3; ++j)
+                {
+                    float wStepX = triangle.edges[j].a * SUBPIXEL_ONE * triangle.invArea;
+                    float wStepY = triangle.edges[j].b * SUBPIXEL_ONE * triangle.invArea;
+                    for (int k = 0; k < 2; ++k)
+                    {
+                        triangle.uvStepX.e[k] += triangle.varyings[j].uv.e[k] * wStepX;
+                        triangle.uvStepY.e[k] += triangle.varyings[j].uv.e[k] * wStepY;
+                    }
+                    triangle.invWStepX += triangle.invW[j] * wStepX;
+                    triangle.invWStepY += triangle.invW[j] * wStepY;
+                }
+            }
+        }
         else
         {
-            vertexShader(renderer->uniforms, renderer->textures[t], rgb[i], vertices[i], varyings[i], worldCoord4[i], worldNormal4[i], camPos);
-            clipCoords[i] = renderer->uniforms.viewProj * worldCoord4[i];
+            // Lines are drawn between rounded end points
+            int coords[3][2];
+            for (int j = 0; j < 3; ++j)
+            {
+                for (int k = 0; k < 2; ++k)
+                    coords[j][k] = (int)roundf(triangle.screenCoords[j].e[k]);
+            }
+            triangle.minX = maths::min(maths::min(coords[0][0], coords[1][0]), coords[2][0]);
+            triangle.maxX = maths::max(maths::max(coords[0][0], coords[1][0]), coords[2][0]);
+            triangle.minY = maths::min(maths::min(coords[0][1], coords[1][1]), coords[2][1]);
+            triangle.maxY = maths::max(maths::max(coords[0][1], coords[1][1]), coords[2][1]);
         }
-            
+
+        triangle.minX = maths::max(triangle.minX, 0);
+        triangle.minY = maths::max(triangle.minY, 0);
+        triangle.maxX = maths::min(triangle.maxX, screenMaxX);
+        triangle.maxY = maths::min(triangle.maxY, screenMaxY);
+        if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+            continue;
+
+        triangleCount++;
     }
 
-    // clip triangles w/ vertices outside edge of screen
-    for (int i = 0; i < 3; ++i)
+    return triangleCount;
+}
+
+// Back end: draws every triangle binned in one tile, in submission order
+void rasterizeTile(rdrImpl* renderer, int tileIndex, bool useHiZ, DepthCullCounters& counters, PipelineCounters& pipelineCounters)
+{
+    TiledBackend& backend = renderer->backend;
+    const Uniforms& uniforms = renderer->uniforms;
+
+    int tileX = tileIndex % backend.tileCountX;
+    int tileY = tileIndex / backend.tileCountX;
+    TileRect tile = {
+        tileX * backend.tileSize,
+        tileY * backend.tileSize,
+        maths::min((tileX + 1) * backend.tileSize, renderer->fb.width),
+        maths::min((tileY + 1) * backend.tileSize, renderer->fb.height)
+    };
+
+    LightList tileLights = {};
+    if (renderer->drawState.pixelLighting)
     {
-        if (isOutside(clipCoords[i]))  
-            return;
+        const std::vector<int>& lights = renderer->lightGrid.tiles[tileIndex];
+        tileLights = { lights.data(), (int)lights.size() };
     }
 
-    // clip -> NDC
-    // perspective divide in graphics pipeline
-    float3 ndcCoords[3];
-    for (int i = 0; i < 3; ++i)
+    std::vector<const TriangleSetup*>& bin = backend.bins[tileIndex];
+
+    // Lines are not drawn by blocks, the whole tile is made ready for them
+    if (uniforms.wireframe && !bin.empty())
     {
-        ndcCoords[i] = clipCoords[i].xyz / clipCoords[i].w;
+        for (int blockY = tile.minY / BLOCK_SIZE; blockY <= (tile.maxY - 1) / BLOCK_SIZE; ++blockY)
+            for (int blockX = tile.minX / BLOCK_SIZE; blockX <= (tile.maxX - 1) / BLOCK_SIZE; ++blockX)
+                touchBlock(renderer->fastClear, renderer->fb, blockX, blockY);
     }
 
-    // NDC (v3) to screen coords (v2)
-    float3 screenCoords[3];
-    for (int i = 0; i < 3; ++i)
+    for (const TriangleSetup* binnedTriangle : bin)
     {
-        screenCoords[i] = ndcToScreenCoords(ndcCoords[i], renderer->viewport);
+        const TriangleSetup& triangle = *binnedTriangle;
+
+        // The tile may have been covered by triangles drawn earlier in this draw
+        if (useHiZ)
+        {
+            counters.tileTrianglesTested++;
+            if (!(triangle.minZ < renderer->hiZ.tileMax[tileIndex]))
+            {
+                counters.tileTrianglesRejected++;
+                continue;
+            }
+        }
+
+        if (uniforms.wireframe)
+        {
+            for (int i = 0; i < 3; ++i)
+            {
+                drawLine(renderer->fb, tile, triangle.screenCoords[i].xy, triangle.screenCoords[(i + 1) % 3].xy, uniforms.lineColor);
+            }
+        }
+        else
+        {
+            rasterizeTriangle(renderer, triangle, tile, tileLights, useHiZ, counters, pipelineCounters);
+        }
     }
 
-    if (renderer->uniforms.wireframe)
+    if (useHiZ && !bin.empty())
+        updateDepthTile(renderer->hiZ, tile, tileIndex);
+}
+
+void binTriangles(TiledBackend& backend, int batchCount)
+{
+    for (std::vector<const TriangleSetup*>& bin : backend.bins)
+        bin.clear();
+
+    // Bounding boxes are already clamped to the screen
+    for (int batch = 0; batch < batchCount; ++batch)
     {
-        for (int i = 0; i < 3; ++i)
+        for (const TriangleSetup& triangle : backend.batchTriangles[batch])
         {
-            drawLine(renderer->fb, screenCoords[i].xy, screenCoords[(i + 1) % 3].xy, renderer->uniforms.lineColor);
+            int minTileX = triangle.minX / backend.tileSize;
+            int minTileY = triangle.minY / backend.tileSize;
+            int maxTileX = triangle.maxX / backend.tileSize;
+            int maxTileY = triangle.maxY / backend.tileSize;
+
+            for (int y = minTileY; y <= maxTileY; ++y)
+                for (int x = minTileX; x <= maxTileX; ++x)
+                    backend.bins[y * backend.tileCountX + x].push_back(&triangle);
         }
     }
+}
+
+// Derives everything that stays constant for the whole draw from the uniforms,
+// so the vertex and pixel stages don't redo it for each vertex, triangle or pixel
+void compileDrawState(rdrImpl* renderer)
+{
+    const Uniforms& uniforms = renderer->uniforms;
+    DrawState& state = renderer->drawState;
+
+    gatherLights(renderer->lightGrid, uniforms.lights, RDR_MAX_LIGHTS);
+    bool lit = !renderer->lightGrid.lights.empty();
+
+    bool filled = !uniforms.wireframe;
+    state.backfaceCulling = filled && uniforms.backfaceCulling;
+    state.perPixel = filled && uniforms.phong;
+    state.deferred = state.perPixel && uniforms.deferred;
+    state.vertexLighting = filled && !uniforms.phong && lit;
+    state.pixelLighting = state.perPixel && !state.deferred && lit;
+    state.texture = filled && !uniforms.RGBInterpolation && uniforms.texture != 0 ? &renderer->textures[uniforms.texture - 1] : nullptr;
+    state.overdraw = filled && renderer->overdraw.counting ? &renderer->overdraw : nullptr;
+
+    VertexTransform& transform = state.transform;
+    transform.model = uniforms.model;
+    transform.viewProj = uniforms.proj * uniforms.view;
+    transform.guardBand = { 1.f + 2.f * GUARD_BAND_SIZE / renderer->viewport.width, 1.f + 2.f * GUARD_BAND_SIZE / renderer->viewport.height };
+
+    // Normals stay perpendicular to the surface under non-uniform scale with the inverse transpose
+    // Their length does not matter, they are normalized before lighting
+    mat4x4 inverseModel;
+    if (mat4::invert(uniforms.model.e, inverseModel.e))
+    {
+        for (int c = 0; c < 4; ++c)
+            for (int r = 0; r < 4; ++r)
+                transform.normalMatrix.c[c].e[r] = inverseModel.c[r].e[c];
+    }
     else
     {
-        rasterizeTriangle(renderer->fb, renderer->uniforms, screenCoords, varyings, camPos);
+        // Flattened model, its normals are meaningless anyway
+        transform.normalMatrix = uniforms.model;
+    }
+
+    // Lights are given in world space, where the lighting is done, so they don't need any transform.
+    // Only the camera position has to be extracted from the view matrix
+    transform.camPos = {};
+    if (state.backfaceCulling || (filled && lit))
+        transform.camPos = getCamPos(uniforms.view);
+}
+
+// Shared by indexed and non-indexed draws, indices is null for the latter
+void drawTriangles(rdrImpl* renderer, const rdrVertex* vertices, int vertexCount, const unsigned int* indices, int indexCount)
+{
+    compileDrawState(renderer);
+
+    TiledBackend& backend = renderer->backend;
+    backend.tileCountX = (renderer->fb.width + backend.tileSize - 1) / backend.tileSize;
+    backend.tileCountY = (renderer->fb.height + backend.tileSize - 1) / backend.tileSize;
+    backend.bins.resize(backend.tileCountX * backend.tileCountY);
+
+    // The hierarchy is only kept up to date while filled triangles are depth tested
+    DepthHierarchy& hiZ = renderer->hiZ;
+    bool useHiZ = hiZ.enabled && hiZ.valid && renderer->uniforms.depthTest && !renderer->uniforms.wireframe;
+    if (useHiZ)
+        setDepthTileGrid(hiZ, backend.tileSize, backend.tileCountX, backend.tileCountY);
+    else if (renderer->uniforms.depthTest && !renderer->uniforms.wireframe)
+        hiZ.valid = false; // Depth is written behind its back until the next rdrBeginFrame()
+
+    if (renderer->drawState.pixelLighting)
+    {
+        TRACE_SCOPE("Light Culling");
+        buildLightTiles(renderer->lightGrid, renderer->drawState.transform.viewProj, renderer->viewport, backend.tileSize, backend.tileCountX, backend.tileCountY);
+    }
+
+    // The G-buffer is only cleared on the first deferred draw of the frame
+    GBuffer& gBuffer = renderer->gBuffer;
+    if (renderer->drawState.deferred && !gBuffer.used)
+    {
+        TRACE_SCOPE("Clear G-Buffer");
+        backend.threadPool.parallelFor(backend.tileCountY, [&](int tileY, int threadIndex)
+        {
+            int firstRow = tileY * backend.tileSize;
+            clearGBufferRows(gBuffer, firstRow, maths::min(firstRow + backend.tileSize, gBuffer.height) - 1);
+        });
+        gBuffer.used = true;
+    }
+
+    // Every vertex is transformed once, then shared by the triangles using it
+    transformVertices(renderer, vertices, vertexCount);
+
+    int triangleCount = (indices ? indexCount : vertexCount) / 3;
+
+    // Assemble triangles, in parallel batches
+    const int batchSize = 1024;
+    int batchCount = (triangleCount + batchSize - 1) / batchSize;
+    if ((int)backend.batchTriangles.size() < batchCount)
+        backend.batchTriangles.resize(batchCount);
+    {
+        TRACE_SCOPE("Triangle Setup");
+        backend.threadPool.parallelFor(batchCount, [&](int batch, int threadIndex)
+        {
+            TRACE_SCOPE("Triangle Batch");
+    
+            DepthCullCounters& counters = renderer->depthCullCounters[threadIndex];
+            PipelineCounters& pipelineCounters = renderer->pipelineCounters[threadIndex];
+            std::vector<TriangleSetup>& batchTriangles = backend.batchTriangles[batch];
+            batchTriangles.clear();
+    
+            int end = maths::min((batch + 1) * batchSize, triangleCount);
+            pipelineCounters.trianglesSubmitted += end - batch * batchSize;
+            for (int i = batch * batchSize; i < end; ++i)
+            {
+                unsigned int corners[3];
+                bool validIndices = true;
+                for (int j = 0; j < 3; ++j)
+                {
+                    corners[j] = indices ? indices[i * 3 + j] : (unsigned int)(i * 3 + j);
+                    validIndices &= corners[j] < (unsigned int)vertexCount;
+                }
+                if (!validIndices)
+                    continue;
+    
+                TriangleSetup triangles[MAX_CLIP_TRIANGLES];
+                int setupCount = setupTriangles(renderer, vertices, corners, triangles, pipelineCounters);
+                for (int j = 0; j < setupCount; ++j)
+                {
+                    const TriangleSetup& triangle = triangles[j];
+    
+                    // Whole triangles behind what was drawn by the previous draws
+                    if (useHiZ)
+                    {
+                        counters.trianglesTested++;
+                        if (!(triangle.minZ < getDepthTilesMax(renderer->hiZ, triangle.minX, triangle.minY, triangle.maxX, triangle.maxY)))
+                        {
+                            counters.trianglesRejected++;
+                            continue;
+                        }
+                    }
+                    batchTriangles.push_back(triangle);
+                }
+            }
+        });
+    }
+
+    {
+        TRACE_SCOPE("Binning");
+        binTriangles(backend, batchCount);
+    }
+
+    // Rasterize triangles into colorBuffer, one tile at a time per thread
+    // Forward shading happens here too, the pixels are lit as they are rasterized
+    {
+        TRACE_SCOPE("Rasterization");
+        backend.threadPool.parallelFor((int)backend.bins.size(), [&](int tileIndex, int threadIndex)
+        {
+            TRACE_SCOPE("Rasterize Tile");
+            rasterizeTile(renderer, tileIndex, useHiZ, renderer->depthCullCounters[threadIndex], renderer->pipelineCounters[threadIndex]);
+        });
+    }
+}
+
+void rdrDrawTriangles(rdrImpl* renderer, rdrVertex* vertices, int vertexCount)
+{
+    drawTriangles(renderer, vertices, vertexCount, nullptr, 0);
+}
+
+void rdrDrawIndexed(rdrImpl* renderer, rdrVertex* vertices, int vertexCount, unsigned int* indices, int indexCount)
+{
+    drawTriangles(renderer, vertices, vertexCount, indices, indexCount);
+}
+
+void rdrClear(rdrImpl* renderer, const float* color)
+{
+    TRACE_SCOPE("Clear");
+
+    Framebuffer& fb = renderer->fb;
+    FastClear& fastClear = renderer->fastClear;
+    DepthHierarchy& hiZ = renderer->hiZ;
+
+    bool colorChanged = setClearColor(fastClear, fb, color);
+    if (fastClear.lazy)
+    {
+        for (BlockClear& block : fastClear.blocks)
+        {
+            if (block != BlockClear::CLEARED || colorChanged)
+                block = BlockClear::PENDING;
+        }
+    }
+    else
+    {
+        int chunkCount = 4 * renderer->backend.threadPool.getThreadCount();
+        renderer->backend.threadPool.parallelFor(chunkCount, [&](int chunk, int threadIndex)
+        {
+            int firstRow = fb.height * chunk / chunkCount;
+            int lastRow = fb.height * (chunk + 1) / chunkCount - 1;
+            if (firstRow <= lastRow)
+                streamClearRows(fastClear, fb, firstRow, lastRow);
+        });
+
+        for (BlockClear& block : fastClear.blocks)
+            block = BlockClear::CLEARED;
+    }
+
+    // The whole depth buffer is at the far plane, no need to read it back
+    std::fill(hiZ.blockMin.begin(), hiZ.blockMin.end(), 0.f);
+    std::fill(hiZ.blockMax.begin(), hiZ.blockMax.end(), 0.f);
+    hiZ.valid = hiZ.enabled;
+    hiZ.tileSize = 0;
+
+    renderer->gBuffer.used = false;
+}
+
+void rdrBeginFrame(rdrImpl* renderer)
+{
+    Framebuffer& fb = renderer->fb;
+    DepthHierarchy& hiZ = renderer->hiZ;
+
+    for (DepthCullCounters& counters : renderer->depthCullCounters)
+        counters = DepthCullCounters{};
+    for (PipelineCounters& counters : renderer->pipelineCounters)
+        counters = PipelineCounters{};
+
+    // Only counted while shown
+    renderer->overdraw.counting = false;
+    if (renderer->debugOutput == RDR_DEBUG_OUTPUT_OVERDRAW)
+        resetOverdraw(renderer->overdraw, fb.width, fb.height);
+
+    renderer->gBuffer.used = false;
+
+    hiZ.valid = false;
+    if (!hiZ.enabled)
+        return;
+
+    // The depth buffer may have been written since rdrClear(), so read back the blocks drawn to
+    TRACE_SCOPE("Hi-Z Build");
+    renderer->backend.threadPool.parallelFor(hiZ.blockCountY, [&](int blockY, int threadIndex)
+    {
+        buildDepthBlocks(hiZ, fb, renderer->fastClear, blockY, blockY);
+    });
+    hiZ.valid = true;
+
+    // Forces the tile level to be rebuilt on next draw
+    hiZ.tileSize = 0;
+}
+
+// Deferred shading pass: runs the lighting once for every pixel written to the G-buffer
+// Lights binned to the tile are first tested against the world space box of its pixels
+void resolveGBufferTile(rdrImpl* renderer, int tileIndex, const float3& camPos, PipelineCounters& counters)
+{
+    const Uniforms& uniforms = renderer->uniforms;
+    const GBuffer& gBuffer = renderer->gBuffer;
+    const LightGrid& lightGrid = renderer->lightGrid;
+    Framebuffer& fb = renderer->fb;
+
+    int tileX = tileIndex % lightGrid.tileCountX;
+    int tileY = tileIndex / lightGrid.tileCountX;
+    int minX = tileX * lightGrid.tileSize;
+    int minY = tileY * lightGrid.tileSize;
+    int maxX = maths::min(minX + lightGrid.tileSize, fb.width);
+    int maxY = maths::min(minY + lightGrid.tileSize, fb.height);
+
+    float3 boxMin = { FLT_MAX, FLT_MAX, FLT_MAX };
+    float3 boxMax = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    bool written = false;
+    for (int y = minY; y < maxY; ++y)
+    {
+        for (int index = y * fb.width + minX; index < y * fb.width + maxX; ++index)
+        {
+            if (!isGBufferPixelWritten(gBuffer, index))
+                continue;
+
+            written = true;
+            for (int i = 0; i < 3; ++i)
+            {
+                boxMin.e[i] = maths::min(boxMin.e[i], gBuffer.worldCoords[index].e[i]);
+                boxMax.e[i] = maths::max(boxMax.e[i], gBuffer.worldCoords[index].e[i]);
+            }
+        }
     }
+    if (!written)
+        return;
+
+    int lights[RDR_MAX_LIGHTS];
+    LightList tileLights = { lights, 0 };
+    for (int light : lightGrid.tiles[tileIndex])
+    {
+        const Light& l = uniforms.lights[light];
+        if (sphereTouchesBox({ l.position.xyz, getLightRadius(l) }, boxMin, boxMax))
+            lights[tileLights.count++] = light;
+    }
+
+    int shadedCount = 0;
+    for (int y = minY; y < maxY; ++y)
+    {
+        for (int index = y * fb.width + minX; index < y * fb.width + maxX; ++index)
+        {
+            if (!isGBufferPixelWritten(gBuffer, index))
+                continue;
+
+            shadedCount++;
+            float3 color = unpackAlbedo(gBuffer.albedo[index]);
+            if (tileLights.count > 0)
+                color += getLighting(camPos, uniforms.lights, tileLights, gBuffer.worldCoords[index], unpackNormal(gBuffer.normal[index]));
+
+            float4 shadedColor = { color, uniforms.alpha };
+            storeColor(fb, index, uniforms.alphaBlending ? alphaBlending(shadedColor, uniforms.bgColor) : shadedColor);
+        }
+    }
+    counters.pixelsShaded += shadedCount;
+}
+
+// Writes the clear values to the blocks nothing was drawn to since rdrClear()
+void clearPendingBlocks(rdrImpl* renderer)
+{
+    TRACE_SCOPE("Clear Pending Blocks");
+
+    FastClear& fastClear = renderer->fastClear;
+    renderer->backend.threadPool.parallelFor(fastClear.blockCountY, [&](int blockY, int threadIndex)
+    {
+        for (int blockX = 0; blockX < fastClear.blockCountX; ++blockX)
+        {
+            BlockClear& block = fastClear.blocks[blockY * fastClear.blockCountX + blockX];
+            if (block == BlockClear::PENDING)
+            {
+                clearBlock(fastClear, renderer->fb, blockX, blockY);
+                block = BlockClear::CLEARED;
+            }
+        }
+    });
 }
 
-void rdrDrawTriangles(rdrImpl* renderer, rdrVertex* vertices, int count)
+// Replaces the colors by the overdraw heatmap
+void writeOverdraw(rdrImpl* renderer)
 {
-    renderer->uniforms.modelViewProj = renderer->uniforms.proj * renderer->uniforms.view * renderer->uniforms.model;
-    renderer->uniforms.viewProj = renderer->uniforms.proj * renderer->uniforms.view;
+    TRACE_SCOPE("Overdraw Output");
 
-    // Transform vertex list to triangles into colorBuffer
-    for (int i = 0; i < count; i += 3)
+    FastClear& fastClear = renderer->fastClear;
+    Framebuffer& fb = renderer->fb;
+    renderer->backend.threadPool.parallelFor(fastClear.blockCountY, [&](int blockY, int threadIndex)
     {
-        drawTriangle(renderer, &vertices[i], i + 1); 
+        writeOverdrawRows(renderer->overdraw, fb, blockY * BLOCK_SIZE, maths::min((blockY + 1) * BLOCK_SIZE, fb.height) - 1);
+
+        // The color buffer no longer holds the clear color
+        for (int blockX = 0; blockX < fastClear.blockCountX; ++blockX)
+            fastClear.blocks[blockY * fastClear.blockCountX + blockX] = BlockClear::DRAWN;
+    });
+}
+
+void resolveGBuffer(rdrImpl* renderer)
+{
+    TRACE_SCOPE("Deferred Shading");
+
+    GBuffer& gBuffer = renderer->gBuffer;
+    const Uniforms& uniforms = renderer->uniforms;
+    TiledBackend& backend = renderer->backend;
+    float3 camPos = getCamPos(uniforms.view);
+
+    int tileCountX = (gBuffer.width + backend.tileSize - 1) / backend.tileSize;
+    int tileCountY = (gBuffer.height + backend.tileSize - 1) / backend.tileSize;
+    gatherLights(renderer->lightGrid, uniforms.lights, RDR_MAX_LIGHTS);
+    buildLightTiles(renderer->lightGrid, uniforms.proj * uniforms.view, renderer->viewport, backend.tileSize, tileCountX, tileCountY);
+
+    backend.threadPool.parallelFor((int)renderer->lightGrid.tiles.size(), [&](int tileIndex, int threadIndex)
+    {
+        TRACE_SCOPE("Shade Tile");
+        resolveGBufferTile(renderer, tileIndex, camPos, renderer->pipelineCounters[threadIndex]);
+    });
+}
+
+void rdrEndFrame(rdrImpl* renderer)
+{
+    clearPendingBlocks(renderer);
+
+    if (renderer->gBuffer.used)
+        resolveGBuffer(renderer);
+
+    if (renderer->debugOutput == RDR_DEBUG_OUTPUT_OVERDRAW && renderer->overdraw.counting)
+        writeOverdraw(renderer);
+
+    // Last, so the events above belong to this frame
+    endTraceFrame();
+}
+
+void rdrGetDepthCullStats(rdrImpl* renderer, rdrDepthCullStats* stats)
+{
+    *stats = {};
+    for (const DepthCullCounters& counters : renderer->depthCullCounters)
+    {
+        stats->trianglesTested += counters.trianglesTested;
+        stats->trianglesRejected += counters.trianglesRejected;
+        stats->tileTrianglesTested += counters.tileTrianglesTested;
+        stats->tileTrianglesRejected += counters.tileTrianglesRejected;
+        stats->blocksTested += counters.blocksTested;
+        stats->blocksRejected += counters.blocksRejected;
+        stats->blocksAccepted += counters.blocksAccepted;
+    }
+}
+
+void rdrGetStats(rdrImpl* renderer, rdrStats* stats)
+{
+    *stats = {};
+    for (const PipelineCounters& counters : renderer->pipelineCounters)
+    {
+        stats->trianglesSubmitted += counters.trianglesSubmitted;
+        stats->trianglesBackfaceCulled += counters.trianglesBackfaceCulled;
+        stats->trianglesOutside += counters.trianglesOutside;
+        stats->pixelsCovered += counters.pixelsCovered;
+        stats->depthTestsPassed += counters.depthTestsPassed;
+        stats->depthTestsFailed += counters.depthTestsFailed;
+        stats->pixelsShaded += counters.pixelsShaded;
     }
 }
 
+void rdrSetDebugOutput(rdrImpl* renderer, rdrDebugOutput output)
+{
+    renderer->debugOutput = output;
+
+    // Counted again from the next rdrBeginFrame()
+    renderer->overdraw.counting = false;
+    if (output != RDR_DEBUG_OUTPUT_OVERDRAW)
+        std::vector<unsigned short>().swap(renderer->overdraw.counts);
+}
+
+void rdrSetThreadCount(rdrImpl* renderer, int threadCount)
+{
+    renderer->backend.threadPool.setThreadCount(threadCount);
+    growThreadCounters(renderer);
+}
+
+void rdrSetTileSize(rdrImpl* renderer, int tileSize)
+{
+    // Tiles are made of whole raster blocks
+    tileSize = maths::max(tileSize, BLOCK_SIZE);
+    renderer->backend.tileSize = (tileSize + BLOCK_SIZE - 1) & ~(BLOCK_SIZE - 1);
+}
+
 void rdrSetImGuiContext(rdrImpl* renderer, struct ImGuiContext* context)
 {
     ImGui::SetCurrentContext(context);
 }
 
+// What the ImGui controls edit, copied from and to the renderer
+struct RendererSettings
+{
+    int threadCount;
+    int tileSize;
+    RasterKernel rasterKernel;
+
+    bool wireframe;
+    bool RGBInterpolation;
+    bool depthTest;
+    bool backfaceCulling;
+    bool phong;
+    bool deferred;
+    bool alphaBlending;
+    float alpha;
+    float4 lineColor;
+    rdrTextureFilter textureFilter;
+    rdrTextureWrap textureWrap;
+
+    bool lazyClear;
+    bool hiZ;
+    rdrDebugOutput debugOutput;
+
+    int editedLight;
+    Light lights[RDR_MAX_LIGHTS];
+};
+
+// What the ImGui controls only show, counted by the last frame
+struct RendererCounters
+{
+    rdrDepthCullStats depthCull;
+    rdrStats pipeline;
+    int enabledLights;
+};
+
+static void getSettings(rdrImpl* renderer, RendererSettings& settings)
+{
+    const Uniforms& uniforms = renderer->uniforms;
+    settings.threadCount = renderer->backend.threadPool.getThreadCount();
+    settings.tileSize = renderer->backend.tileSize;
+    settings.rasterKernel = renderer->backend.rasterKernel;
+    settings.wireframe = uniforms.wireframe;
+    settings.RGBInterpolation = uniforms.RGBInterpolation;
+    settings.depthTest = uniforms.depthTest;
+    settings.backfaceCulling = uniforms.backfaceCulling;
+    settings.phong = uniforms.phong;
+    settings.deferred = uniforms.deferred;
+    settings.alphaBlending = uniforms.alphaBlending;
+    settings.alpha = uniforms.alpha;
+    settings.lineColor = uniforms.lineColor;
+    settings.textureFilter = uniforms.textureFilter;
+    settings.textureWrap = uniforms.textureWrap;
+    settings.lazyClear = renderer->fastClear.lazy;
+    settings.hiZ = renderer->hiZ.enabled;
+    settings.debugOutput = renderer->debugOutput;
+    settings.editedLight = renderer->editedLight;
+    memcpy(settings.lights, uniforms.lights, sizeof(settings.lights));
+}
+
+static void setSettings(rdrImpl* renderer, const RendererSettings& settings)
+{
+    rdrSetThreadCount(renderer, settings.threadCount);
+    rdrSetTileSize(renderer, settings.tileSize);
+
+    TiledBackend& backend = renderer->backend;
+    if (settings.rasterKernel != backend.rasterKernel)
+    {
+        backend.rasterKernel = settings.rasterKernel;
+        backend.rasterRow = getRasterRowFunc(settings.rasterKernel, renderer->fb.depthFormat);
+        backend.transformVertices = getTransformVerticesFunc(settings.rasterKernel);
+    }
+
+    Uniforms& uniforms = renderer->uniforms;
+    uniforms.wireframe = settings.wireframe;
+    uniforms.RGBInterpolation = settings.RGBInterpolation;
+    uniforms.depthTest = settings.depthTest;
+    uniforms.backfaceCulling = settings.backfaceCulling;
+    uniforms.phong = settings.phong;
+    uniforms.deferred = settings.deferred;
+    uniforms.alphaBlending = settings.alphaBlending;
+    uniforms.alpha = settings.alpha;
+    uniforms.lineColor = settings.lineColor;
+    uniforms.textureFilter = settings.textureFilter;
+    uniforms.textureWrap = settings.textureWrap;
+
+    renderer->fastClear.lazy = settings.lazyClear;
+    if (settings.hiZ != renderer->hiZ.enabled)
+    {
+        renderer->hiZ.enabled = settings.hiZ;
+        renderer->hiZ.valid = false;
+    }
+    if (settings.debugOutput != renderer->debugOutput)
+        rdrSetDebugOutput(renderer, settings.debugOutput);
+
+    renderer->editedLight = settings.editedLight;
+    memcpy(uniforms.lights, settings.lights, sizeof(uniforms.lights));
+}
+
+static void getCounters(rdrImpl* renderer, RendererCounters& counters)
+{
+    rdrGetDepthCullStats(renderer, &counters.depthCull);
+    rdrGetStats(renderer, &counters.pipeline);
+    counters.enabledLights = (int)renderer->lightGrid.lights.size();
+}
+
+// Returns true if a setting was edited
+static bool showControls(RendererSettings& settings, const RendererCounters& counters)
+{
+    bool edited = false;
+    edited |= ImGui::SliderInt("Threads", &settings.threadCount, 1, maths::max((int)std::thread::hardware_concurrency(), 1));
+    edited |= ImGui::SliderInt("Tile Size", &settings.tileSize, BLOCK_SIZE, 256);
+
+    // Lets us compare with the slower kernels, the best one supported is picked at init
+    if (ImGui::BeginCombo("SIMD Kernel", getRasterKernelName(settings.rasterKernel)))
+    {
+        for (int i = 0; i <= (int)getBestRasterKernel(); ++i)
+        {
+            RasterKernel kernel = (RasterKernel)i;
+            if (ImGui::Selectable(getRasterKernelName(kernel), kernel == settings.rasterKernel))
+            {
+                settings.rasterKernel = kernel;
+                edited = true;
+            }
+        }
+        ImGui::EndCombo();
+    }
+
+    edited |= ImGui::ColorEdit4("lineColor", settings.lineColor.e);
+    edited |= ImGui::Checkbox("Wireframe", &settings.wireframe);
+    edited |= ImGui::Checkbox("RGB Interpole", &settings.RGBInterpolation);
+    edited |= ImGui::Checkbox("Depth Test", &settings.depthTest);
+    edited |= ImGui::Checkbox("BF Culling", &settings.backfaceCulling);
+    edited |= ImGui::Checkbox("Phong Shading", &settings.phong);
+    edited |= ImGui::Checkbox("Deferred Shading", &settings.deferred);
+    edited |= ImGui::Checkbox("Alpha Blending", &settings.alphaBlending);
+    edited |= ImGui::SliderFloat("Alpha Value", &settings.alpha, 0.f, 1.f);
+
+    const char* filterNames[] = { "Nearest", "Bilinear", "Trilinear" };
+    const char* wrapNames[] = { "Repeat", "Clamp" };
+    edited |= ImGui::Combo("Texture Filter", (int*)&settings.textureFilter, filterNames, IM_ARRAYSIZE(filterNames));
+    edited |= ImGui::Combo("Texture Wrap", (int*)&settings.textureWrap, wrapNames, IM_ARRAYSIZE(wrapNames));
+
+    edited |= ImGui::Checkbox("Lazy Clear", &settings.lazyClear);
+    edited |= ImGui::Checkbox("Hi-Z Culling", &settings.hiZ);
+    if (settings.hiZ)
+    {
+        const rdrDepthCullStats& stats = counters.depthCull;
+        ImGui::Text("Triangles rejected: %llu / %llu", stats.trianglesRejected, stats.trianglesTested);
+        ImGui::Text("Tile triangles rejected: %llu / %llu", stats.tileTrianglesRejected, stats.tileTrianglesTested);
+        ImGui::Text("Blocks rejected: %llu / %llu", stats.blocksRejected, stats.blocksTested);
+        ImGui::Text("Blocks accepted: %llu / %llu", stats.blocksAccepted, stats.blocksTested);
+    }
+
+    const rdrStats& stats = counters.pipeline;
+    ImGui::Text("Triangles: %llu submitted, %llu backface culled, %llu outside", stats.trianglesSubmitted, stats.trianglesBackfaceCulled, stats.trianglesOutside);
+    ImGui::Text("Pixels: %llu covered, %llu shaded", stats.pixelsCovered, stats.pixelsShaded);
+    ImGui::Text("Depth tests: %llu passed, %llu failed", stats.depthTestsPassed, stats.depthTestsFailed);
+
+    const char* debugOutputNames[] = { "None", "Overdraw" };
+    edited |= ImGui::Combo("Debug Output", (int*)&settings.debugOutput, debugOutputNames, IM_ARRAYSIZE(debugOutputNames));
+
+    ImGui::Text("Enabled lights: %d", counters.enabledLights);
+    edited |= ImGui::SliderInt("Light Index", &settings.editedLight, 0, RDR_MAX_LIGHTS - 1);
+    Light& light = settings.lights[settings.editedLight];
+    edited |= ImGui::Checkbox("Light Enabled", &light.enabled);
+    edited |= ImGui::Checkbox("Attenuation Enabled", &light.attnEnabled);
+    edited |= ImGui::DragFloat3("LightPos", light.position.e);
+    edited |= ImGui::DragFloat("Min Full Attn Distance ", &light.minFullAttnDistance);
+    edited |= ImGui::SliderFloat3("Attenuation Strength", light.attenuation.e, 0.f, 1.f);
+    edited |= ImGui::ColorEdit3("Ambient Color", light.ambient.e);
+    edited |= ImGui::ColorEdit3("Diffuse Color", light.diffuse.e);
+    edited |= ImGui::ColorEdit3("Specular Color", light.specular.e);
+    return edited;
+}
+
 void rdrShowImGuiControls(rdrImpl* renderer)
 {
-    ImGui::ColorEdit4("lineColor", renderer->uniforms.lineColor.e);
-    ImGui::Checkbox("Wireframe", &renderer->uniforms.wireframe);
-    ImGui::Checkbox("RGB Interpole", &renderer->uniforms.RGBInterpolation);
-    ImGui::Checkbox("Depth Test", &renderer->uniforms.depthTest);
-    ImGui::Checkbox("BF Culling", &renderer->uniforms.backfaceCulling);
-    ImGui::Checkbox("Phong Shading", &renderer->uniforms.phong);
-    ImGui::Checkbox("Alpha Blending", &renderer->uniforms.alphaBlending);
-    ImGui::SliderFloat("Alpha Value", &renderer->uniforms.alpha, 0.f, 1.f);
-
-    ImGui::Checkbox("Light Enabled", &renderer->uniforms.light.enabled);
-    ImGui::Checkbox("Attenuation Enabled", &renderer->uniforms.light.attnEnabled);
-    ImGui::DragFloat3("LightPos", renderer->uniforms.light.position.e);
-    ImGui::DragFloat("Min Full Attn Distance ", &renderer->uniforms.light.minFullAttnDistance);
-    ImGui::SliderFloat3("Attenuation Strength", renderer->uniforms.light.attenuation.e, 0.f, 1.f);
-    ImGui::ColorEdit3("Ambient Color", renderer->uniforms.light.ambient.e);
-    ImGui::ColorEdit3("Diffuse Color", renderer->uniforms.light.diffuse.e);
-    ImGui::ColorEdit3("Specular Color", renderer->uniforms.light.specular.e);
+    RendererSettings settings;
+    RendererCounters counters;
+    getSettings(renderer, settings);
+    getCounters(renderer, counters);
+    if (showControls(settings, counters))
+        setSettings(renderer, settings);
+}
+
+// The lock is only held to copy the settings and the counters, never while rendering or while ImGui draws the controls
+struct rdrImGuiControls
+{
+    std::mutex mutex;
+    RendererSettings settings;
+    RendererCounters counters;
+    bool edited = false; // The settings are newer than the renderer's
+};
+
+rdrImGuiControls* rdrCreateImGuiControls(rdrImpl* renderer)
+{
+    rdrImGuiControls* controls = new rdrImGuiControls();
+    getSettings(renderer, controls->settings);
+    getCounters(renderer, controls->counters);
+    return controls;
+}
+
+void rdrDestroyImGuiControls(rdrImGuiControls* controls)
+{
+    delete controls;
+}
+
+void rdrSyncImGuiControls(rdrImpl* renderer, rdrImGuiControls* controls)
+{
+    std::lock_guard<std::mutex> lock(controls->mutex);
+    if (controls->edited)
+        setSettings(renderer, controls->settings);
+    controls->edited = false;
+    getSettings(renderer, controls->settings);
+    getCounters(renderer, controls->counters);
+}
+
+void rdrShowImGuiControlsDeferred(rdrImGuiControls* controls)
+{
+    RendererSettings settings;
+    RendererCounters counters;
+    {
+        std::lock_guard<std::mutex> lock(controls->mutex);
+        settings = controls->settings;
+        counters = controls->counters;
+    }
+
+    if (!showControls(settings, counters))
+        return;
+
+    std::lock_guard<std::mutex> lock(controls->mutex);
+    controls->settings = settings;
+    controls->edited = true;
 }
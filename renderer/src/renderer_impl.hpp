@@ -6,6 +6,17 @@
 
 #include <common/types.hpp>
 
+#include "depth_hierarchy.hpp"
+#include "fast_clear.hpp"
+#include "framebuffer.hpp"
+#include "gbuffer.hpp"
+#include "light_culling.hpp"
+#include "overdraw.hpp"
+#include "raster_kernel.hpp"
+#include "texture.hpp"
+#include "thread_pool.hpp"
+#include "vertex_stage.hpp"
+
 struct Viewport
 {
     int x;
@@ -14,14 +25,7 @@ struct Viewport
     int height;
 };
 
-struct Framebuffer
-{
-    int width;
-    int height;
-    float4* colorBuffer;
-    float* depthBuffer;
-};
-
+// Same layout as rdrLight
 struct Light
 {
     bool enabled;
@@ -36,8 +40,6 @@ struct Light
 
 struct Uniforms
 {
-    mat4x4 modelViewProj;
-    mat4x4 viewProj;
     mat4x4 model;
     mat4x4 view;
     mat4x4 proj;
@@ -47,15 +49,18 @@ struct Uniforms
     bool depthTest;
     bool backfaceCulling;
     bool phong;
+    bool deferred; // Phong shading in a separate pass, once per visible pixel
     bool alphaBlending;
 
     float alpha;
     float4 lineColor;
     float4 bgColor;
 
-    // il faut crer un tableau de lumires
-    //Light lights[3];
-    Light light;
+    rdrTexture texture;
+    rdrTextureFilter textureFilter;
+    rdrTextureWrap textureWrap;
+
+    Light lights[RDR_MAX_LIGHTS];
 };
 
 struct Varyings
@@ -63,20 +68,168 @@ struct Varyings
     float3 color;
     float3 worldCoords;
     float3 normalWCoords;
+    float2 uv;
 };
 
-struct Texture
+// Output of the vertex stage, shared by every triangle using the vertex
+// In Gouraud mode the color only holds the lighting, the base color is added per triangle corner,
+// or per pixel for textures
+struct TransformedVertex
 {
-    float* colors;
-    int width;
-    int height;
-    int vertexCount;
+    float4 clipCoords;
+    int outcode;          // See VertexBatch
+    int guardBandOutcode;
+    Varyings varyings;
+    bool backface;
+};
+
+// Vertex as seen by the clipper, before the perspective divide
+struct ClipVertex
+{
+    float4 position;
+    Varyings varyings;
+};
+
+// Everything derived from the uniforms that stays constant for a whole draw, see compileDrawState()
+struct DrawState
+{
+    VertexTransform transform;
+
+    const Texture* texture; // Null when not textured
+    Overdraw* overdraw;     // Null when not counted
+
+    // Which parts of the pipeline are active, wireframe already taken into account
+    bool backfaceCulling;
+    bool perPixel;       // World position and normal are interpolated to each pixel (Phong)
+    bool deferred;       // Pixels go to the G-buffer, lit by rdrEndFrame()
+    bool vertexLighting; // Gouraud
+    bool pixelLighting;  // Phong, forward
+};
+
+// Counted per thread, then summed by rdrGetStats()
+struct PipelineCounters
+{
+    unsigned long long trianglesSubmitted;
+    unsigned long long trianglesBackfaceCulled;
+    unsigned long long trianglesOutside;
+    unsigned long long pixelsCovered;
+    unsigned long long depthTestsPassed;
+    unsigned long long depthTestsFailed;
+    unsigned long long pixelsShaded;
+};
+
+// Sub-pixel precision of the rasterizer, in bits
+const int SUBPIXEL_BITS = 4;
+const int SUBPIXEL_ONE = 1 << SUBPIXEL_BITS;
+
+// Triangles are rasterized by blocks of BLOCK_SIZE x BLOCK_SIZE pixels
+const int BLOCK_SIZE = 8;
+
+// Triangles are only clipped against the x and y planes once they go further than this many pixels
+// outside the viewport, everything closer is handled by clamping the bounding box
+// Large enough for clipping to be rare, small enough for the edge functions to fit in 32 bits inside a block
+const float GUARD_BAND_SIZE = 4096.f;
+
+// A triangle clipped against the 6 planes has at most 9 vertices
+const int MAX_CLIP_VERTICES = 9;
+const int MAX_CLIP_TRIANGLES = MAX_CLIP_VERTICES - 2;
+
+// Edge function E(x, y) = a * x + b * y + c, with x and y in sub-pixel units
+// E >= 0 inside the triangle, the top-left fill rule is already baked into c
+struct EdgeFunction
+{
+    int a;
+    int b;
+    long long c;
+};
+
+// Triangle transformed by the front end, ready to be rasterized by the tile workers
+struct TriangleSetup
+{
+    float3 screenCoords[3];
+    Varyings varyings[3];
+
+    // edges[i] is the edge facing vertex i, so the weight of vertex i is edges[i] / area
+    EdgeFunction edges[3];
+    float invArea;
+
+    // uv / w and 1 / w vary linearly over the screen, not uv: the varyings hold uv / w, divided per pixel by 1 / w
+    float invW[3];
+
+    // Steps of uv / w and of 1 / w from one pixel to the next, for the mip level of each pixel
+    float2 uvStepX;
+    float2 uvStepY;
+    float invWStepX;
+    float invWStepY;
+
+    float minZ;
+    float maxZ;
+
+    // Screen space bounding box (inclusive)
+    int minX;
+    int minY;
+    int maxX;
+    int maxY;
+};
+
+struct TileRect
+{
+    int minX;
+    int minY;
+    int maxX; // exclusive
+    int maxY; // exclusive
+};
+
+// Sort-middle backend state
+// Triangles are binned into screen tiles, then each tile is rasterized by only one thread,
+// so the color and depth buffers never need any lock
+struct TiledBackend
+{
+    ThreadPool threadPool;
+    RasterKernel rasterKernel = getBestRasterKernel();
+    RasterRowFunc rasterRow = getRasterRowFunc(rasterKernel, RDR_DEPTH_FORMAT_D32F);
+    TransformVerticesFunc transformVertices = getTransformVerticesFunc(rasterKernel);
+    int tileSize = 64;
+    int tileCountX = 0;
+    int tileCountY = 0;
+
+    // Front end output, one list per batch of input triangles
+    // Clipping can turn one triangle into several, so batches can't write to a shared array by index
+    std::vector<std::vector<TriangleSetup>> batchTriangles;
+
+    // Triangles for each tile, kept in submission order
+    std::vector<std::vector<const TriangleSetup*>> bins;
 };
 
 struct rdrImpl
 {
     Framebuffer fb;
     Viewport viewport;
+
+    // Indexed by texture handle - 1, destroyed textures are left empty until their slot is reused
     std::vector<Texture> textures;
+    std::vector<rdrTexture> freeTextures;
     Uniforms uniforms;
-};
\ No newline at end of file
+    DrawState drawState; // Of the current draw
+    TiledBackend backend;
+
+    // Vertex stage output, one per vertex of the current draw
+    std::vector<TransformedVertex> transformedVertices;
+
+    GBuffer gBuffer;
+
+    LightGrid lightGrid;
+    int editedLight = 0; // In the ImGui panel
+
+    DepthHierarchy hiZ;
+    std::vector<DepthCullCounters> depthCullCounters; // One per thread
+    std::vector<PipelineCounters> pipelineCounters;   // One per thread
+
+    FastClear fastClear;
+
+    rdrDebugOutput debugOutput = RDR_DEBUG_OUTPUT_NONE;
+    Overdraw overdraw;
+};
+
+// Events recorded from now on belong to the next frame of the trace
+void endTraceFrame();
@@ -0,0 +1,17 @@
+#pragma once
+
+// Shared by the SIMD kernels, which are selected at runtime with getBestRasterKernel()
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define RDR_X86 1
+#include <immintrin.h>
+#endif
+
+// MSVC lets us use any intrinsic anywhere, gcc and clang need to be told per function
+#if defined(RDR_X86) && !defined(_MSC_VER)
+#define RDR_TARGET_SSE41 __attribute__((target("sse4.1")))
+#define RDR_TARGET_AVX2  __attribute__((target("avx2")))
+#else
+#define RDR_TARGET_SSE41
+#define RDR_TARGET_AVX2
+#endif
@@ -0,0 +1,203 @@
+#include <cmath>
+
+#include <common/maths.hpp>
+
+#include "texture.hpp"
+
+static const int TILE_SIZE = 4;
+
+static int getTexelOffset(const MipLevel& level, int x, int y)
+{
+    int tile = (y >> 2) * level.tileCountX + (x >> 2);
+
+    // Bits of the Morton index inside the tile: y1 x1 y0 x0
+    int morton = (x & 1) | ((y & 1) << 1) | ((x & 2) << 1) | ((y & 2) << 2);
+    return level.offset + tile * TILE_SIZE * TILE_SIZE + morton;
+}
+
+static unsigned int packTexel(const unsigned int rgba[4])
+{
+    return rgba[0] | (rgba[1] << 8) | (rgba[2] << 16) | (rgba[3] << 24);
+}
+
+// Level sizes, each one padded to whole tiles, returns the texel count of all the levels
+static int initLevels(Texture& texture, int width, int height)
+{
+    texture.width = width;
+    texture.height = height;
+    texture.levels.clear();
+
+    int texelCount = 0;
+    for (int levelWidth = width, levelHeight = height; ; levelWidth = maths::max(levelWidth / 2, 1), levelHeight = maths::max(levelHeight / 2, 1))
+    {
+        MipLevel level;
+        level.width = levelWidth;
+        level.height = levelHeight;
+        level.tileCountX = (levelWidth + TILE_SIZE - 1) / TILE_SIZE;
+        level.offset = texelCount;
+        texelCount += level.tileCountX * ((levelHeight + TILE_SIZE - 1) / TILE_SIZE) * TILE_SIZE * TILE_SIZE;
+        texture.levels.push_back(level);
+
+        if (levelWidth == 1 && levelHeight == 1)
+            break;
+    }
+    return texelCount;
+}
+
+void initTexture(Texture& texture, const unsigned char* texels, int width, int height)
+{
+    texture.data.assign(initLevels(texture, width, height), 0);
+    unsigned int* levels = texture.data.data();
+    texture.texels = levels;
+
+    const MipLevel& base = texture.levels[0];
+    for (int y = 0; y < height; ++y)
+    {
+        for (int x = 0; x < width; ++x)
+        {
+            const unsigned char* texel = &texels[(y * width + x) * 4];
+            unsigned int rgba[4] = { texel[0], texel[1], texel[2], texel[3] };
+            levels[getTexelOffset(base, x, y)] = packTexel(rgba);
+        }
+    }
+
+    // Each level is a 2x2 box filter of the previous one, the last row or column is reused for odd sizes
+    for (size_t i = 1; i < texture.levels.size(); ++i)
+    {
+        const MipLevel& src = texture.levels[i - 1];
+        const MipLevel& dst = texture.levels[i];
+        for (int y = 0; y < dst.height; ++y)
+        {
+            for (int x = 0; x < dst.width; ++x)
+            {
+                int x0 = maths::min(x * 2, src.width - 1);
+                int y0 = maths::min(y * 2, src.height - 1);
+                int x1 = maths::min(x * 2 + 1, src.width - 1);
+                int y1 = maths::min(y * 2 + 1, src.height - 1);
+                unsigned int samples[4] = {
+                    levels[getTexelOffset(src, x0, y0)],
+                    levels[getTexelOffset(src, x1, y0)],
+                    levels[getTexelOffset(src, x0, y1)],
+                    levels[getTexelOffset(src, x1, y1)],
+                };
+
+                unsigned int rgba[4];
+                for (int c = 0; c < 4; ++c)
+                {
+                    unsigned int sum = 0;
+                    for (unsigned int sample : samples)
+                        sum += (sample >> (c * 8)) & 0xff;
+                    rgba[c] = (sum + 2) / 4;
+                }
+                levels[getTexelOffset(dst, x, y)] = packTexel(rgba);
+            }
+        }
+    }
+}
+
+bool initTextureFromLevels(Texture& texture, const unsigned int* texels, size_t size, int width, int height)
+{
+    if ((size_t)initLevels(texture, width, height) * sizeof(unsigned int) != size)
+    {
+        releaseTexture(texture);
+        return false;
+    }
+    std::vector<unsigned int>().swap(texture.data);
+    texture.texels = texels;
+    return true;
+}
+
+void releaseTexture(Texture& texture)
+{
+    texture.texels = nullptr;
+    std::vector<unsigned int>().swap(texture.data);
+    std::vector<MipLevel>().swap(texture.levels);
+    texture.width = 0;
+    texture.height = 0;
+}
+
+size_t getTextureLevelsSize(const Texture& texture)
+{
+    if (!isTextureValid(texture))
+        return 0;
+
+    // The last level is 1x1, padded to one tile
+    return ((size_t)texture.levels.back().offset + TILE_SIZE * TILE_SIZE) * sizeof(unsigned int);
+}
+
+float getTextureLod(const Texture& texture, float2 uvStepX, float2 uvStepY)
+{
+    float dx = sqrtf(uvStepX.x * uvStepX.x * texture.width * texture.width + uvStepX.y * uvStepX.y * texture.height * texture.height);
+    float dy = sqrtf(uvStepY.x * uvStepY.x * texture.width * texture.width + uvStepY.y * uvStepY.y * texture.height * texture.height);
+    float footprint = maths::max(dx, dy);
+    return footprint > 1.f ? log2f(footprint) : 0.f;
+}
+
+static int wrapCoord(int coord, int size, rdrTextureWrap wrap)
+{
+    if (wrap == RDR_TEXTURE_WRAP_CLAMP)
+        return coord < 0 ? 0 : coord >= size ? size - 1 : coord;
+
+    coord %= size;
+    return coord < 0 ? coord + size : coord;
+}
+
+static float3 unpackTexel(unsigned int texel)
+{
+    return { (texel & 0xff) / 255.f, ((texel >> 8) & 0xff) / 255.f, ((texel >> 16) & 0xff) / 255.f };
+}
+
+static float3 sampleNearest(const Texture& texture, const MipLevel& level, rdrTextureWrap wrap, float2 uv)
+{
+    int x = wrapCoord((int)floorf(uv.x * level.width), level.width, wrap);
+    int y = wrapCoord((int)floorf(uv.y * level.height), level.height, wrap);
+    return unpackTexel(texture.texels[getTexelOffset(level, x, y)]);
+}
+
+static float3 sampleBilinear(const Texture& texture, const MipLevel& level, rdrTextureWrap wrap, float2 uv)
+{
+    // Texel centers are at half coordinates
+    float fx = uv.x * level.width - 0.5f;
+    float fy = uv.y * level.height - 0.5f;
+    float floorX = floorf(fx);
+    float floorY = floorf(fy);
+    float tx = fx - floorX;
+    float ty = fy - floorY;
+
+    int x0 = wrapCoord((int)floorX, level.width, wrap);
+    int y0 = wrapCoord((int)floorY, level.height, wrap);
+    int x1 = wrapCoord((int)floorX + 1, level.width, wrap);
+    int y1 = wrapCoord((int)floorY + 1, level.height, wrap);
+
+    float3 c00 = unpackTexel(texture.texels[getTexelOffset(level, x0, y0)]);
+    float3 c10 = unpackTexel(texture.texels[getTexelOffset(level, x1, y0)]);
+    float3 c01 = unpackTexel(texture.texels[getTexelOffset(level, x0, y1)]);
+    float3 c11 = unpackTexel(texture.texels[getTexelOffset(level, x1, y1)]);
+
+    float3 top = c00 + (c10 - c00) * tx;
+    float3 bottom = c01 + (c11 - c01) * tx;
+    return top + (bottom - top) * ty;
+}
+
+float3 sampleTexture(const Texture& texture, rdrTextureFilter filter, rdrTextureWrap wrap, float2 uv, float lod)
+{
+    // Huge uvs would overflow the integer texel coordinates
+    if (!(fabsf(uv.x) < 65536.f && fabsf(uv.y) < 65536.f))
+        uv = { 0.f, 0.f };
+
+    int maxLevel = (int)texture.levels.size() - 1;
+    lod = maths::clamp(0.f, (float)maxLevel, lod);
+
+    if (filter == RDR_TEXTURE_FILTER_NEAREST)
+        return sampleNearest(texture, texture.levels[(int)(lod + 0.5f)], wrap, uv);
+
+    if (filter == RDR_TEXTURE_FILTER_BILINEAR)
+        return sampleBilinear(texture, texture.levels[(int)(lod + 0.5f)], wrap, uv);
+
+    int level = (int)lod;
+    float t = lod - (float)level;
+    float3 color = sampleBilinear(texture, texture.levels[level], wrap, uv);
+    if (t > 0.f && level < maxLevel)
+        color = color + (sampleBilinear(texture, texture.levels[level + 1], wrap, uv) - color) * t;
+    return color;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <vector>
+
+#include <rdr/renderer.h>
+
+#include <common/types.hpp>
+
+// One level of the mip chain
+// Texels are stored by tiles of 4x4, one cache line each, in Morton order inside the tile,
+// so the 2x2 footprint of a bilinear fetch almost always stays in one or two lines
+struct MipLevel
+{
+    int width;
+    int height;
+    int tileCountX;
+    int offset; // First texel of the level in Texture::texels
+};
+
+// RGBA8 texture with its full mip chain, built once at creation
+struct Texture
+{
+    const unsigned int* texels;   // RGBA, 8 bits per component, all levels, in data or in memory owned by the caller
+    std::vector<unsigned int> data;
+    std::vector<MipLevel> levels; // From the full size level down to 1x1
+    int width;
+    int height;
+};
+
+// texels are width x height RGBA8 pixels, in rows
+void initTexture(Texture& texture, const unsigned char* texels, int width, int height);
+// texels are all the levels of a texture of the same size, as built by initTexture(), used in place without copy
+// Returns false if size, in bytes, does not match
+bool initTextureFromLevels(Texture& texture, const unsigned int* texels, size_t size, int width, int height);
+void releaseTexture(Texture& texture);
+inline bool isTextureValid(const Texture& texture) { return !texture.levels.empty(); }
+
+// Size of all the levels in bytes
+size_t getTextureLevelsSize(const Texture& texture);
+
+// Level of detail of a texture mapped with the given uv derivatives, in pixels
+// Derivatives vary over a triangle seen in perspective, the level is computed for each pixel
+float getTextureLod(const Texture& texture, float2 uvStepX, float2 uvStepY);
+
+// Filtered color at uv, 0 to 1 per component
+float3 sampleTexture(const Texture& texture, rdrTextureFilter filter, rdrTextureWrap wrap, float2 uv, float lod);
@@ -0,0 +1,115 @@
+#include <string>
+
+#include <common/trace.hpp>
+
+#include "thread_pool.hpp"
+
+ThreadPool::ThreadPool()
+{
+    setThreadCount(0);
+}
+
+ThreadPool::~ThreadPool()
+{
+    stopWorkers();
+}
+
+void ThreadPool::setThreadCount(int count)
+{
+    if (count <= 0)
+        count = (int)std::thread::hardware_concurrency();
+    if (count <= 0)
+        count = 1;
+
+    if (count == getThreadCount())
+        return;
+
+    stopWorkers();
+    startWorkers(count - 1);
+}
+
+void ThreadPool::startWorkers(int count)
+{
+    // Restarted workers must not take the last dispatch for a new one
+    unsigned int currentGeneration;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = false;
+        currentGeneration = generation;
+    }
+    for (int i = 0; i < count; ++i)
+        workers.emplace_back(&ThreadPool::workerLoop, this, i + 1, currentGeneration);
+}
+
+void ThreadPool::stopWorkers()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    wakeUp.notify_all();
+
+    for (std::thread& worker : workers)
+        worker.join();
+    workers.clear();
+}
+
+void ThreadPool::runJobs(int threadIndex)
+{
+    for (int i = nextJob.fetch_add(1); i < jobCount; i = nextJob.fetch_add(1))
+        (*currentJob)(i, threadIndex);
+}
+
+void ThreadPool::workerLoop(int threadIndex, unsigned int seenGeneration)
+{
+    TRACE_THREAD_NAME(("Worker " + std::to_string(threadIndex)).c_str());
+
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wakeUp.wait(lock, [&] { return quit || generation != seenGeneration; });
+            if (quit)
+                return;
+            seenGeneration = generation;
+        }
+
+        runJobs(threadIndex);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--busyWorkers == 0)
+                allDone.notify_one();
+        }
+    }
+}
+
+void ThreadPool::parallelFor(int count, const Job& job)
+{
+    if (count <= 0)
+        return;
+
+    // Not worth waking up the workers
+    if (workers.empty() || count == 1)
+    {
+        for (int i = 0; i < count; ++i)
+            job(i, 0);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        currentJob = &job;
+        jobCount = count;
+        nextJob = 0;
+        busyWorkers = (int)workers.size();
+        ++generation;
+    }
+    wakeUp.notify_all();
+
+    runJobs(0);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    allDone.wait(lock, [&] { return busyWorkers == 0; });
+    currentJob = nullptr;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed pool of worker threads used by the tiled backend
+// The calling thread always takes part in the work, so a pool of 1 thread runs everything serially
+struct ThreadPool
+{
+    // job(jobIndex, threadIndex), threadIndex is in [0, getThreadCount())
+    using Job = std::function<void(int jobIndex, int threadIndex)>;
+
+    ThreadPool();
+    ~ThreadPool();
+
+    // 0 means one thread per hardware core
+    void setThreadCount(int count);
+    int getThreadCount() const { return (int)workers.size() + 1; }
+
+    // Runs job for every index in [0, jobCount) and returns once they are all done
+    // Jobs are picked in increasing order, but may finish in any order
+    void parallelFor(int jobCount, const Job& job);
+
+private:
+    void startWorkers(int count);
+    void stopWorkers();
+    void workerLoop(int threadIndex, unsigned int seenGeneration);
+    void runJobs(int threadIndex);
+
+    std::vector<std::thread> workers;
+
+    std::mutex mutex;
+    std::condition_variable wakeUp;
+    std::condition_variable allDone;
+
+    const Job* currentJob = nullptr;
+    int jobCount = 0;
+    std::atomic<int> nextJob{ 0 };
+    int busyWorkers = 0;
+    unsigned int generation = 0;
+    bool quit = false;
+};
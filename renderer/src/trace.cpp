@@ -0,0 +1,169 @@
+#include <rdr/renderer.h>
+
+#ifdef RDR_TRACE
+
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct TraceEvent
+{
+    const char* name;
+    unsigned long long start; // In ns
+    unsigned long long end;
+    unsigned long long frame;
+};
+
+// Written by its own thread only, the lock is for rdrTraceWrite(), so it is almost never contended
+struct ThreadTrace
+{
+    int id;
+    std::string name;
+
+    std::mutex mutex;
+    std::vector<TraceEvent> events; // Ring of RDR_TRACE_CAPACITY events
+    unsigned long long count = 0;   // Events ever recorded, the next one goes to count % RDR_TRACE_CAPACITY
+};
+
+// Kept until the end of the process, so the events of finished threads can still be written
+static std::mutex traceMutex;
+static std::vector<std::unique_ptr<ThreadTrace>> threadTraces;
+static std::atomic<unsigned long long> traceFrame{ 0 };
+
+static thread_local ThreadTrace* currentTrace = nullptr;
+
+static ThreadTrace& getThreadTrace()
+{
+    if (currentTrace == nullptr)
+    {
+        std::lock_guard<std::mutex> lock(traceMutex);
+        threadTraces.emplace_back(new ThreadTrace());
+        currentTrace = threadTraces.back().get();
+        currentTrace->id = (int)threadTraces.size();
+        currentTrace->name = "Thread " + std::to_string(currentTrace->id);
+        currentTrace->events.resize(RDR_TRACE_CAPACITY);
+    }
+    return *currentTrace;
+}
+
+void rdrTraceRecord(const char* name, unsigned long long startNs, unsigned long long endNs)
+{
+    ThreadTrace& trace = getThreadTrace();
+    std::lock_guard<std::mutex> lock(trace.mutex);
+    trace.events[trace.count % RDR_TRACE_CAPACITY] = { name, startNs, endNs, traceFrame.load(std::memory_order_relaxed) };
+    trace.count++;
+}
+
+void rdrTraceSetThreadName(const char* name)
+{
+    ThreadTrace& trace = getThreadTrace();
+    std::lock_guard<std::mutex> lock(trace.mutex);
+    trace.name = name;
+}
+
+unsigned long long rdrTraceGetFrame()
+{
+    return traceFrame.load();
+}
+
+// Called at the very end of rdrEndFrame(), after its own events
+void endTraceFrame()
+{
+    traceFrame.fetch_add(1);
+}
+
+static void writeJsonString(FILE* file, const char* text)
+{
+    fputc('"', file);
+    for (const char* c = text; *c != '\0'; ++c)
+    {
+        if (*c == '"' || *c == '\\')
+            fputc('\\', file);
+        if ((unsigned char)*c >= 0x20)
+            fputc(*c, file);
+    }
+    fputc('"', file);
+}
+
+// Chrome trace event format, timestamps are in microseconds
+bool rdrTraceWrite(const char* filename, unsigned long long firstFrame, unsigned long long lastFrame)
+{
+    FILE* file = fopen(filename, "w");
+    if (file == nullptr)
+        return false;
+
+    std::lock_guard<std::mutex> lock(traceMutex);
+
+    // Timestamps start from the first event written
+    unsigned long long origin = ~0ull;
+    std::vector<std::vector<TraceEvent>> events(threadTraces.size());
+    for (size_t i = 0; i < threadTraces.size(); ++i)
+    {
+        ThreadTrace& trace = *threadTraces[i];
+        std::lock_guard<std::mutex> threadLock(trace.mutex);
+        unsigned long long first = trace.count > RDR_TRACE_CAPACITY ? trace.count - RDR_TRACE_CAPACITY : 0;
+        for (unsigned long long j = first; j < trace.count; ++j)
+        {
+            const TraceEvent& event = trace.events[j % RDR_TRACE_CAPACITY];
+            if (event.frame < firstFrame || event.frame > lastFrame)
+                continue;
+            events[i].push_back(event);
+            origin = event.start < origin ? event.start : origin;
+        }
+    }
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+    for (size_t i = 0; i < threadTraces.size(); ++i)
+    {
+        ThreadTrace& trace = *threadTraces[i];
+        {
+            std::lock_guard<std::mutex> threadLock(trace.mutex);
+            fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":", first ? "" : ",\n", trace.id);
+            writeJsonString(file, trace.name.c_str());
+            fprintf(file, "}}");
+            first = false;
+        }
+
+        for (const TraceEvent& event : events[i])
+        {
+            fprintf(file, ",\n{\"name\":");
+            writeJsonString(file, event.name);
+            fprintf(file, ",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%llu}}",
+                trace.id, (event.start - origin) / 1000.0, (event.end - event.start) / 1000.0, event.frame);
+        }
+    }
+    fprintf(file, "\n]}\n");
+
+    bool written = !ferror(file);
+    return fclose(file) == 0 && written;
+}
+
+#else
+
+void rdrTraceRecord(const char* name, unsigned long long startNs, unsigned long long endNs)
+{
+}
+
+void rdrTraceSetThreadName(const char* name)
+{
+}
+
+unsigned long long rdrTraceGetFrame()
+{
+    return 0;
+}
+
+void endTraceFrame()
+{
+}
+
+bool rdrTraceWrite(const char* filename, unsigned long long firstFrame, unsigned long long lastFrame)
+{
+    return false;
+}
+
+#endif
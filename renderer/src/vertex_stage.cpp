@@ -0,0 +1,225 @@
+#include "vertex_stage.hpp"
+
+#include "simd.hpp"
+
+// Operations are done in the same order as operator*(mat4x4, float4), and never fused,
+// so every kernel gives the same bits as the scalar one
+
+static void transformVerticesScalar(const VertexTransform& transform, VertexBatch& batch)
+{
+    const mat4x4& m = transform.model;
+    const mat4x4& n = transform.normalMatrix;
+    const mat4x4& vp = transform.viewProj;
+    for (int i = 0; i < batch.count; ++i)
+    {
+        float px = batch.positions[0][i];
+        float py = batch.positions[1][i];
+        float pz = batch.positions[2][i];
+        float nx = batch.normals[0][i];
+        float ny = batch.normals[1][i];
+        float nz = batch.normals[2][i];
+
+        float world[4];
+        for (int r = 0; r < 4; ++r)
+        {
+            world[r] = px * m.c[0].e[r] + py * m.c[1].e[r] + pz * m.c[2].e[r] + m.c[3].e[r];
+            batch.worldCoords[r][i] = world[r];
+        }
+
+        float normal[3];
+        for (int r = 0; r < 3; ++r)
+        {
+            normal[r] = nx * n.c[0].e[r] + ny * n.c[1].e[r] + nz * n.c[2].e[r];
+            batch.worldNormals[r][i] = normal[r];
+        }
+
+        float clip[4];
+        for (int r = 0; r < 4; ++r)
+        {
+            clip[r] = world[0] * vp.c[0].e[r] + world[1] * vp.c[1].e[r] + world[2] * vp.c[2].e[r] + world[3] * vp.c[3].e[r];
+            batch.clipCoords[r][i] = clip[r];
+        }
+
+        batch.facing[i] = (transform.camPos.x - world[0]) * normal[0]
+            + (transform.camPos.y - world[1]) * normal[1]
+            + (transform.camPos.z - world[2]) * normal[2];
+
+        float gx = transform.guardBand.x * clip[3];
+        float gy = transform.guardBand.y * clip[3];
+        int zPlanes = (clip[3] + clip[2] < 0.f ? 1 << CLIP_NEAR : 0) | (clip[3] - clip[2] < 0.f ? 1 << CLIP_FAR : 0);
+        batch.outcodes[i] = zPlanes
+            | (clip[3] + clip[0] < 0.f ? 1 << CLIP_LEFT : 0)
+            | (clip[3] - clip[0] < 0.f ? 1 << CLIP_RIGHT : 0)
+            | (clip[3] + clip[1] < 0.f ? 1 << CLIP_BOTTOM : 0)
+            | (clip[3] - clip[1] < 0.f ? 1 << CLIP_TOP : 0);
+        batch.guardBandOutcodes[i] = zPlanes
+            | (gx + clip[0] < 0.f ? 1 << CLIP_LEFT : 0)
+            | (gx - clip[0] < 0.f ? 1 << CLIP_RIGHT : 0)
+            | (gy + clip[1] < 0.f ? 1 << CLIP_BOTTOM : 0)
+            | (gy - clip[1] < 0.f ? 1 << CLIP_TOP : 0);
+    }
+}
+
+#ifdef RDR_X86
+
+RDR_TARGET_SSE41 static __m128i getOutcodeBitSSE41(__m128 distance, int plane)
+{
+    return _mm_and_si128(_mm_castps_si128(_mm_cmplt_ps(distance, _mm_setzero_ps())), _mm_set1_epi32(1 << plane));
+}
+
+RDR_TARGET_SSE41 static void transformVerticesSSE41(const VertexTransform& transform, VertexBatch& batch)
+{
+    const mat4x4& m = transform.model;
+    const mat4x4& n = transform.normalMatrix;
+    const mat4x4& vp = transform.viewProj;
+    for (int i = 0; i < batch.count; i += 4)
+    {
+        __m128 px = _mm_loadu_ps(&batch.positions[0][i]);
+        __m128 py = _mm_loadu_ps(&batch.positions[1][i]);
+        __m128 pz = _mm_loadu_ps(&batch.positions[2][i]);
+        __m128 nx = _mm_loadu_ps(&batch.normals[0][i]);
+        __m128 ny = _mm_loadu_ps(&batch.normals[1][i]);
+        __m128 nz = _mm_loadu_ps(&batch.normals[2][i]);
+
+        __m128 world[4];
+        for (int r = 0; r < 4; ++r)
+        {
+            world[r] = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+                _mm_mul_ps(px, _mm_set1_ps(m.c[0].e[r])),
+                _mm_mul_ps(py, _mm_set1_ps(m.c[1].e[r]))),
+                _mm_mul_ps(pz, _mm_set1_ps(m.c[2].e[r]))),
+                _mm_set1_ps(m.c[3].e[r]));
+            _mm_storeu_ps(&batch.worldCoords[r][i], world[r]);
+        }
+
+        __m128 normal[3];
+        for (int r = 0; r < 3; ++r)
+        {
+            normal[r] = _mm_add_ps(_mm_add_ps(
+                _mm_mul_ps(nx, _mm_set1_ps(n.c[0].e[r])),
+                _mm_mul_ps(ny, _mm_set1_ps(n.c[1].e[r]))),
+                _mm_mul_ps(nz, _mm_set1_ps(n.c[2].e[r])));
+            _mm_storeu_ps(&batch.worldNormals[r][i], normal[r]);
+        }
+
+        __m128 clip[4];
+        for (int r = 0; r < 4; ++r)
+        {
+            clip[r] = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+                _mm_mul_ps(world[0], _mm_set1_ps(vp.c[0].e[r])),
+                _mm_mul_ps(world[1], _mm_set1_ps(vp.c[1].e[r]))),
+                _mm_mul_ps(world[2], _mm_set1_ps(vp.c[2].e[r]))),
+                _mm_mul_ps(world[3], _mm_set1_ps(vp.c[3].e[r])));
+            _mm_storeu_ps(&batch.clipCoords[r][i], clip[r]);
+        }
+
+        __m128 facing = _mm_add_ps(_mm_add_ps(
+            _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(transform.camPos.x), world[0]), normal[0]),
+            _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(transform.camPos.y), world[1]), normal[1])),
+            _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(transform.camPos.z), world[2]), normal[2]));
+        _mm_storeu_ps(&batch.facing[i], facing);
+
+        __m128 w = clip[3];
+        __m128 gx = _mm_mul_ps(_mm_set1_ps(transform.guardBand.x), w);
+        __m128 gy = _mm_mul_ps(_mm_set1_ps(transform.guardBand.y), w);
+        __m128i zPlanes = _mm_or_si128(getOutcodeBitSSE41(_mm_add_ps(w, clip[2]), CLIP_NEAR), getOutcodeBitSSE41(_mm_sub_ps(w, clip[2]), CLIP_FAR));
+
+        __m128i outcodes = _mm_or_si128(_mm_or_si128(zPlanes,
+            _mm_or_si128(getOutcodeBitSSE41(_mm_add_ps(w, clip[0]), CLIP_LEFT), getOutcodeBitSSE41(_mm_sub_ps(w, clip[0]), CLIP_RIGHT))),
+            _mm_or_si128(getOutcodeBitSSE41(_mm_add_ps(w, clip[1]), CLIP_BOTTOM), getOutcodeBitSSE41(_mm_sub_ps(w, clip[1]), CLIP_TOP)));
+        _mm_storeu_si128((__m128i*)&batch.outcodes[i], outcodes);
+
+        __m128i guardBandOutcodes = _mm_or_si128(_mm_or_si128(zPlanes,
+            _mm_or_si128(getOutcodeBitSSE41(_mm_add_ps(gx, clip[0]), CLIP_LEFT), getOutcodeBitSSE41(_mm_sub_ps(gx, clip[0]), CLIP_RIGHT))),
+            _mm_or_si128(getOutcodeBitSSE41(_mm_add_ps(gy, clip[1]), CLIP_BOTTOM), getOutcodeBitSSE41(_mm_sub_ps(gy, clip[1]), CLIP_TOP)));
+        _mm_storeu_si128((__m128i*)&batch.guardBandOutcodes[i], guardBandOutcodes);
+    }
+}
+
+RDR_TARGET_AVX2 static __m256i getOutcodeBitAVX2(__m256 distance, int plane)
+{
+    return _mm256_and_si256(_mm256_castps_si256(_mm256_cmp_ps(distance, _mm256_setzero_ps(), _CMP_LT_OQ)), _mm256_set1_epi32(1 << plane));
+}
+
+RDR_TARGET_AVX2 static void transformVerticesAVX2(const VertexTransform& transform, VertexBatch& batch)
+{
+    const mat4x4& m = transform.model;
+    const mat4x4& n = transform.normalMatrix;
+    const mat4x4& vp = transform.viewProj;
+    for (int i = 0; i < batch.count; i += 8)
+    {
+        __m256 px = _mm256_loadu_ps(&batch.positions[0][i]);
+        __m256 py = _mm256_loadu_ps(&batch.positions[1][i]);
+        __m256 pz = _mm256_loadu_ps(&batch.positions[2][i]);
+        __m256 nx = _mm256_loadu_ps(&batch.normals[0][i]);
+        __m256 ny = _mm256_loadu_ps(&batch.normals[1][i]);
+        __m256 nz = _mm256_loadu_ps(&batch.normals[2][i]);
+
+        __m256 world[4];
+        for (int r = 0; r < 4; ++r)
+        {
+            world[r] = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(
+                _mm256_mul_ps(px, _mm256_set1_ps(m.c[0].e[r])),
+                _mm256_mul_ps(py, _mm256_set1_ps(m.c[1].e[r]))),
+                _mm256_mul_ps(pz, _mm256_set1_ps(m.c[2].e[r]))),
+                _mm256_set1_ps(m.c[3].e[r]));
+            _mm256_storeu_ps(&batch.worldCoords[r][i], world[r]);
+        }
+
+        __m256 normal[3];
+        for (int r = 0; r < 3; ++r)
+        {
+            normal[r] = _mm256_add_ps(_mm256_add_ps(
+                _mm256_mul_ps(nx, _mm256_set1_ps(n.c[0].e[r])),
+                _mm256_mul_ps(ny, _mm256_set1_ps(n.c[1].e[r]))),
+                _mm256_mul_ps(nz, _mm256_set1_ps(n.c[2].e[r])));
+            _mm256_storeu_ps(&batch.worldNormals[r][i], normal[r]);
+        }
+
+        __m256 clip[4];
+        for (int r = 0; r < 4; ++r)
+        {
+            clip[r] = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(
+                _mm256_mul_ps(world[0], _mm256_set1_ps(vp.c[0].e[r])),
+                _mm256_mul_ps(world[1], _mm256_set1_ps(vp.c[1].e[r]))),
+                _mm256_mul_ps(world[2], _mm256_set1_ps(vp.c[2].e[r]))),
+                _mm256_mul_ps(world[3], _mm256_set1_ps(vp.c[3].e[r])));
+            _mm256_storeu_ps(&batch.clipCoords[r][i], clip[r]);
+        }
+
+        __m256 facing = _mm256_add_ps(_mm256_add_ps(
+            _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(transform.camPos.x), world[0]), normal[0]),
+            _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(transform.camPos.y), world[1]), normal[1])),
+            _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(transform.camPos.z), world[2]), normal[2]));
+        _mm256_storeu_ps(&batch.facing[i], facing);
+
+        __m256 w = clip[3];
+        __m256 gx = _mm256_mul_ps(_mm256_set1_ps(transform.guardBand.x), w);
+        __m256 gy = _mm256_mul_ps(_mm256_set1_ps(transform.guardBand.y), w);
+        __m256i zPlanes = _mm256_or_si256(getOutcodeBitAVX2(_mm256_add_ps(w, clip[2]), CLIP_NEAR), getOutcodeBitAVX2(_mm256_sub_ps(w, clip[2]), CLIP_FAR));
+
+        __m256i outcodes = _mm256_or_si256(_mm256_or_si256(zPlanes,
+            _mm256_or_si256(getOutcodeBitAVX2(_mm256_add_ps(w, clip[0]), CLIP_LEFT), getOutcodeBitAVX2(_mm256_sub_ps(w, clip[0]), CLIP_RIGHT))),
+            _mm256_or_si256(getOutcodeBitAVX2(_mm256_add_ps(w, clip[1]), CLIP_BOTTOM), getOutcodeBitAVX2(_mm256_sub_ps(w, clip[1]), CLIP_TOP)));
+        _mm256_storeu_si256((__m256i*)&batch.outcodes[i], outcodes);
+
+        __m256i guardBandOutcodes = _mm256_or_si256(_mm256_or_si256(zPlanes,
+            _mm256_or_si256(getOutcodeBitAVX2(_mm256_add_ps(gx, clip[0]), CLIP_LEFT), getOutcodeBitAVX2(_mm256_sub_ps(gx, clip[0]), CLIP_RIGHT))),
+            _mm256_or_si256(getOutcodeBitAVX2(_mm256_add_ps(gy, clip[1]), CLIP_BOTTOM), getOutcodeBitAVX2(_mm256_sub_ps(gy, clip[1]), CLIP_TOP)));
+        _mm256_storeu_si256((__m256i*)&batch.guardBandOutcodes[i], guardBandOutcodes);
+    }
+}
+
+#endif
+
+TransformVerticesFunc getTransformVerticesFunc(RasterKernel kernel)
+{
+    switch (kernel)
+    {
+#ifdef RDR_X86
+    case RasterKernel::AVX2:  return transformVerticesAVX2;
+    case RasterKernel::SSE41: return transformVerticesSSE41;
+#endif
+    default:                  return transformVerticesScalar;
+    }
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <common/types.hpp>
+
+#include "raster_kernel.hpp"
+
+// Bits of the vertex outcodes, set when the vertex is outside the plane
+enum ClipPlane
+{
+    CLIP_NEAR,
+    CLIP_FAR,
+    CLIP_LEFT,
+    CLIP_RIGHT,
+    CLIP_BOTTOM,
+    CLIP_TOP,
+    CLIP_PLANE_COUNT
+};
+
+// Vertices are transformed by batches, copied into structure of arrays so each SIMD lane handles one vertex
+// A multiple of the widest SIMD width, so kernels never need a scalar tail
+const int VERTEX_BATCH_SIZE = 256;
+
+struct VertexBatch
+{
+    int count;
+
+    // Inputs, in local space
+    float positions[3][VERTEX_BATCH_SIZE];
+    float normals[3][VERTEX_BATCH_SIZE];
+
+    // Outputs
+    float worldCoords[4][VERTEX_BATCH_SIZE];
+    float worldNormals[3][VERTEX_BATCH_SIZE];
+    float clipCoords[4][VERTEX_BATCH_SIZE];
+    float facing[VERTEX_BATCH_SIZE];           // dot(camPos - worldCoords, worldNormal), <= 0 when facing away
+    int outcodes[VERTEX_BATCH_SIZE];           // Against the view frustum
+    int guardBandOutcodes[VERTEX_BATCH_SIZE];  // Against the near and far planes, and the guard band
+};
+
+// Constant for the whole draw
+struct VertexTransform
+{
+    mat4x4 model;
+    mat4x4 normalMatrix; // Inverse transpose of the model matrix, only its 3x3 part is used
+    mat4x4 viewProj;
+    float3 camPos;
+    float2 guardBand; // Scale of the x and y planes of the guard band
+};
+
+// Fills the outputs of the first 'count' vertices of the batch
+// Results are the same whatever the kernel
+typedef void (*TransformVerticesFunc)(const VertexTransform& transform, VertexBatch& batch);
+
+TransformVerticesFunc getTransformVerticesFunc(RasterKernel kernel);
@@ -1,10 +1,15 @@
 #pragma once
 
+#if defined(_WIN32)
 #ifdef SCN_EXPORTS
 #define SCN_API __declspec(dllexport)
 #else
 #define SCN_API __declspec(dllimport)
 #endif
+#else
+// Shared libraries are built with hidden visibility, only the API is exported
+#define SCN_API __attribute__((visibility("default")))
+#endif
 
 #ifdef __cplusplus
 extern "C"
@@ -15,16 +20,73 @@ typedef struct scnImpl scnImpl;
 typedef struct rdrImpl rdrImpl;
 
 // Create/Destroy scene
+// Assets are loaded from the assets directory of the working directory at the time of the call
+// Returns at once, the asset is loaded in the background, see scnGetLoadState()
 SCN_API scnImpl* scnCreate(void);
+
+// Bundled assets, e.g. "watch_tower" (the one shown by scnCreate()) or "alien"
+SCN_API int scnGetAssetCount(void);
+SCN_API const char* scnGetAssetName(int index);
+
+// Scene showing one bundled asset, NULL if its mesh can't be loaded
+// Textures that can't be loaded are replaced by the vertex colors
+// Returns once the asset is loaded
+SCN_API scnImpl* scnCreateWithAsset(const char* assetName);
+
+// Same as scnCreateWithAsset(), but returns at once, NULL only if the asset is unknown
+// The mesh and the textures are loaded by background threads, and drawn by scnUpdate() as soon as they are ready:
+// nothing is drawn before the mesh is loaded, and the vertex colors replace the textures still loading
+SCN_API scnImpl* scnCreateAsync(const char* assetName);
+
+typedef enum scnLoadState
+{
+    SCN_LOAD_STATE_LOADING,
+    SCN_LOAD_STATE_LOADED, // Even if some textures can't be loaded
+    SCN_LOAD_STATE_FAILED, // The mesh can't be loaded
+} scnLoadState;
+
+SCN_API scnLoadState scnGetLoadState(scnImpl* scene);
+// Returns once the mesh and the images are loaded, the textures are created by the next scnUpdate()
+SCN_API scnLoadState scnWaitForLoading(scnImpl* scene);
+
+// Destroys the textures created on the renderer by scnUpdate(), call before rdrShutdown()
 SCN_API void scnDestroy(scnImpl* scene);
 
 // Update scene and renders it
 SCN_API void scnUpdate(scnImpl* scene, float deltaTime, rdrImpl* renderer);
 
+// Camera of the next scnUpdate() calls, same matrices as rdrSetProjection() and rdrSetView()
+// Objects out of its view are not drawn. Nothing is culled until the camera is set
+SCN_API void scnSetCamera(scnImpl* scene, const float* projectionMatrix, const float* viewMatrix);
+
+// The asset is drawn size x size times, side by side and behind each other, 1 by default
+SCN_API void scnSetGridSize(scnImpl* scene, int size);
+
+// Each sub-mesh of each copy of the asset is an object, culled on its own through a bounding volume hierarchy
+// Counted by the last scnUpdate()
+typedef struct scnCullStats
+{
+    int objects;
+    int visibleObjects;
+    int culledObjects;
+    int bvhNodesTested;
+} scnCullStats;
+
+SCN_API void scnGetCullStats(scnImpl* scene, scnCullStats* stats);
+
 struct ImGuiContext;
 SCN_API void scnSetImGuiContext(scnImpl* scene, struct ImGuiContext* context);
 SCN_API void scnShowImGuiControls(scnImpl* scene);
 
+// Same controls for a scene updated by another thread, see rdrCreateImGuiControls()
+typedef struct scnImGuiControls scnImGuiControls;
+SCN_API scnImGuiControls* scnCreateImGuiControls(scnImpl* scene);
+SCN_API void scnDestroyImGuiControls(scnImGuiControls* controls);
+// Call from the thread updating the scene, between frames
+SCN_API void scnSyncImGuiControls(scnImpl* scene, scnImGuiControls* controls);
+// Call from the ImGui thread, the edits are applied by the next scnSyncImGuiControls()
+SCN_API void scnShowImGuiControlsDeferred(scnImGuiControls* controls);
+
 #ifdef __cplusplus
 }
 #endif
\ No newline at end of file
@@ -0,0 +1,178 @@
+#include <algorithm>
+
+#include <common/maths.hpp>
+
+#include "bvh.hpp"
+
+static Aabb mergeAabb(const Aabb& a, const Aabb& b)
+{
+    return {
+        { maths::min(a.min.x, b.min.x), maths::min(a.min.y, b.min.y), maths::min(a.min.z, b.min.z) },
+        { maths::max(a.max.x, b.max.x), maths::max(a.max.y, b.max.y), maths::max(a.max.z, b.max.z) },
+    };
+}
+
+// Arvo: each matrix term adds its smallest and largest product with the box extent
+Aabb transformAabb(const Aabb& box, const mat4x4& matrix)
+{
+    Aabb result;
+    for (int row = 0; row < 3; ++row)
+    {
+        result.min.e[row] = matrix.c[3].e[row];
+        result.max.e[row] = matrix.c[3].e[row];
+        for (int column = 0; column < 3; ++column)
+        {
+            float a = matrix.c[column].e[row] * box.min.e[column];
+            float b = matrix.c[column].e[row] * box.max.e[column];
+            result.min.e[row] += maths::min(a, b);
+            result.max.e[row] += maths::max(a, b);
+        }
+    }
+    return result;
+}
+
+Frustum getFrustum(const mat4x4& projection, const mat4x4& view)
+{
+    mat4x4 viewProjection = projection * view;
+    float4 rows[4];
+    for (int row = 0; row < 4; ++row)
+        rows[row] = { viewProjection.c[0].e[row], viewProjection.c[1].e[row], viewProjection.c[2].e[row], viewProjection.c[3].e[row] };
+
+    // -w <= x <= w, and the same for y and z
+    Frustum frustum;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        for (int i = 0; i < 4; ++i)
+        {
+            frustum.planes[axis * 2 + 0].e[i] = rows[3].e[i] + rows[axis].e[i];
+            frustum.planes[axis * 2 + 1].e[i] = rows[3].e[i] - rows[axis].e[i];
+        }
+    }
+    return frustum;
+}
+
+static int buildNode(Bvh& bvh, const std::vector<Aabb>& boxes, int node, int first, int count)
+{
+    Aabb bounds = boxes[bvh.boxIndices[first]];
+    for (int i = first + 1; i < first + count; ++i)
+        bounds = mergeAabb(bounds, boxes[bvh.boxIndices[i]]);
+    bvh.nodes[node].bounds = bounds;
+
+    if (count <= BVH_LEAF_SIZE)
+    {
+        bvh.nodes[node].first = first;
+        bvh.nodes[node].count = count;
+        return node;
+    }
+
+    float3 size = bounds.max - bounds.min;
+    int axis = size.x > size.y ? (size.x > size.z ? 0 : 2) : (size.y > size.z ? 1 : 2);
+    int* begin = &bvh.boxIndices[first];
+    std::nth_element(begin, begin + count / 2, begin + count, [&](int a, int b)
+    {
+        return boxes[a].min.e[axis] + boxes[a].max.e[axis] < boxes[b].min.e[axis] + boxes[b].max.e[axis];
+    });
+
+    int child = (int)bvh.nodes.size();
+    bvh.nodes.resize(bvh.nodes.size() + 2);
+    bvh.nodes[node].first = child;
+    bvh.nodes[node].count = 0;
+    buildNode(bvh, boxes, child, first, count / 2);
+    buildNode(bvh, boxes, child + 1, first + count / 2, count - count / 2);
+    return node;
+}
+
+void Bvh::build(const std::vector<Aabb>& boxes)
+{
+    nodes.clear();
+    boxIndices.resize(boxes.size());
+    for (size_t i = 0; i < boxes.size(); ++i)
+        boxIndices[i] = (int)i;
+    if (boxes.empty())
+        return;
+
+    nodes.reserve(boxes.size() / BVH_LEAF_SIZE * 2 + 1);
+    nodes.resize(1);
+    buildNode(*this, boxes, 0, 0, (int)boxes.size());
+}
+
+void Bvh::refit(const std::vector<Aabb>& boxes)
+{
+    for (int i = (int)nodes.size() - 1; i >= 0; --i)
+    {
+        BvhNode& node = nodes[i];
+        if (node.count == 0)
+        {
+            node.bounds = mergeAabb(nodes[node.first].bounds, nodes[node.first + 1].bounds);
+            continue;
+        }
+
+        node.bounds = boxes[boxIndices[node.first]];
+        for (int j = node.first + 1; j < node.first + node.count; ++j)
+            node.bounds = mergeAabb(node.bounds, boxes[boxIndices[j]]);
+    }
+}
+
+int Bvh::cull(const Frustum& frustum, std::vector<bool>& visible) const
+{
+    if (nodes.empty())
+        return 0;
+
+    // Nodes to visit, with the planes their parent was not entirely inside of
+    struct Entry
+    {
+        int node;
+        unsigned int planeMask;
+    };
+    Entry stack[64];
+    int stackSize = 0;
+    stack[stackSize++] = { 0, (1u << 6) - 1 };
+
+    int nodesTested = 0;
+    while (stackSize > 0)
+    {
+        Entry entry = stack[--stackSize];
+        const BvhNode& node = nodes[entry.node];
+
+        unsigned int planeMask = entry.planeMask;
+        if (planeMask != 0)
+        {
+            ++nodesTested;
+            bool outside = false;
+            for (int i = 0; i < 6 && !outside; ++i)
+            {
+                if ((planeMask & (1u << i)) == 0)
+                    continue;
+
+                // Corners of the box the furthest along the normal, and against it
+                const float4& plane = frustum.planes[i];
+                float3 positive, negative;
+                for (int axis = 0; axis < 3; ++axis)
+                {
+                    bool sign = plane.e[axis] >= 0.f;
+                    positive.e[axis] = sign ? node.bounds.max.e[axis] : node.bounds.min.e[axis];
+                    negative.e[axis] = sign ? node.bounds.min.e[axis] : node.bounds.max.e[axis];
+                }
+
+                if (maths::dotProduct(plane.xyz, positive) + plane.w < 0.f)
+                    outside = true;
+                else if (maths::dotProduct(plane.xyz, negative) + plane.w >= 0.f)
+                    planeMask &= ~(1u << i);
+            }
+            if (outside)
+                continue;
+        }
+
+        if (node.count > 0)
+        {
+            for (int i = node.first; i < node.first + node.count; ++i)
+                visible[boxIndices[i]] = true;
+        }
+        else
+        {
+            stack[stackSize++] = { node.first, planeMask };
+            stack[stackSize++] = { node.first + 1, planeMask };
+        }
+    }
+    return nodesTested;
+}
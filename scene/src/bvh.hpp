@@ -0,0 +1,49 @@
+#pragma once
+
+#include <vector>
+
+#include <common/types.hpp>
+
+// Leaves hold at most this many boxes
+#define BVH_LEAF_SIZE 4
+
+struct Aabb
+{
+    float3 min;
+    float3 max;
+};
+
+// Box bounding box after the transform
+Aabb transformAabb(const Aabb& box, const mat4x4& matrix);
+
+// Planes of the view frustum, normals pointing inside, extracted from projection * view (Gribb, Hartmann)
+// Planes are in world space, the clip space depth range is [-w, w] like mat4::perspective()
+struct Frustum
+{
+    float4 planes[6]; // Left, right, bottom, top, near, far
+};
+
+Frustum getFrustum(const mat4x4& projection, const mat4x4& view);
+
+struct BvhNode
+{
+    Aabb bounds;
+    int first; // Inner nodes: first child, the second one follows; leaves: first box in Bvh::boxIndices
+    int count; // Boxes of a leaf, 0 for inner nodes
+};
+
+// Bounding volume hierarchy over a list of boxes, built once for that list, then refitted when the boxes move
+struct Bvh
+{
+    std::vector<BvhNode> nodes; // Root first, children after their parent
+    std::vector<int> boxIndices; // Grouped by leaf
+
+    // Nodes are split at the median of the box centers along their longest axis
+    void build(const std::vector<Aabb>& boxes);
+    // Bounds are recomputed from the moved boxes, the tree is kept
+    void refit(const std::vector<Aabb>& boxes);
+
+    // Sets visible[i] for each box i inside or intersecting frustum, subtrees entirely inside one plane skip its test
+    // Returns the number of nodes tested
+    int cull(const Frustum& frustum, std::vector<bool>& visible) const;
+};
@@ -0,0 +1,79 @@
+#include <common/trace.hpp>
+
+#include "job_queue.hpp"
+
+JobQueue::~JobQueue()
+{
+    stop();
+}
+
+void JobQueue::start(int threadCount, const char* threadName)
+{
+    if (threadCount <= 0)
+        threadCount = (int)std::thread::hardware_concurrency();
+    if (threadCount <= 0)
+        threadCount = 1;
+
+    stop();
+    name = threadName;
+    quit = false;
+    for (int i = 0; i < threadCount; ++i)
+        workers.emplace_back(&JobQueue::workerLoop, this, i);
+}
+
+void JobQueue::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+        jobs.clear();
+    }
+    wakeUp.notify_all();
+
+    for (std::thread& worker : workers)
+        worker.join();
+    workers.clear();
+    allDone.notify_all();
+}
+
+void JobQueue::push(Job job)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(std::move(job));
+    }
+    wakeUp.notify_one();
+}
+
+void JobQueue::wait()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    allDone.wait(lock, [&] { return jobs.empty() && busyWorkers == 0; });
+}
+
+void JobQueue::workerLoop(int threadIndex)
+{
+    TRACE_THREAD_NAME((name + " " + std::to_string(threadIndex)).c_str());
+
+    for (;;)
+    {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wakeUp.wait(lock, [&] { return quit || !jobs.empty(); });
+            if (quit)
+                return;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+            ++busyWorkers;
+        }
+
+        job();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--busyWorkers == 0 && jobs.empty())
+                allDone.notify_all();
+        }
+    }
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Background threads running the queued jobs, in the order they were queued, used to load the assets
+// Unlike the renderer ThreadPool, the caller never waits for the jobs unless it asks to
+struct JobQueue
+{
+    using Job = std::function<void()>;
+
+    JobQueue() = default;
+    JobQueue(const JobQueue&) = delete;
+    JobQueue& operator=(const JobQueue&) = delete;
+    ~JobQueue();
+
+    // 0 means one thread per hardware core, threads are named name N in the traces
+    void start(int threadCount, const char* name);
+    // Jobs still queued are dropped, waits for the running ones
+    void stop();
+
+    void push(Job job);
+    // Returns once every job queued so far is done
+    void wait();
+
+private:
+    void workerLoop(int threadIndex);
+
+    std::vector<std::thread> workers;
+    std::string name;
+
+    std::mutex mutex;
+    std::condition_variable wakeUp;
+    std::condition_variable allDone;
+
+    std::deque<Job> jobs;
+    int busyWorkers = 0;
+    bool quit = false;
+};
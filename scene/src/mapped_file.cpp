@@ -0,0 +1,140 @@
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <sys/stat.h>
+#else
+#include <cstdlib>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "mapped_file.hpp"
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : data(other.data), size(other.size)
+{
+    other.data = nullptr;
+    other.size = 0;
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+    if (this != &other)
+    {
+        close();
+        data = other.data;
+        size = other.size;
+        other.data = nullptr;
+        other.size = 0;
+    }
+    return *this;
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool getFileStamp(const char* filename, unsigned long long& size, long long& time)
+{
+#ifdef _WIN32
+    struct _stat64 status;
+    if (_stat64(filename, &status) != 0)
+        return false;
+#else
+    struct stat status;
+    if (stat(filename, &status) != 0)
+        return false;
+#endif
+    size = (unsigned long long)status.st_size;
+    time = (long long)status.st_mtime;
+    return true;
+}
+
+std::string getFullPath(const char* filename)
+{
+#ifdef _WIN32
+    char path[_MAX_PATH];
+    return _fullpath(path, filename, sizeof(path)) != nullptr ? path : "";
+#else
+    char* path = realpath(filename, nullptr);
+    if (path == nullptr)
+        return "";
+    std::string fullPath = path;
+    free(path);
+    return fullPath;
+#endif
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const char* filename)
+{
+    close();
+
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER fileSize;
+    HANDLE mapping = nullptr;
+    if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0)
+        mapping = CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (mapping == nullptr)
+        return false;
+
+    // The view keeps the mapping alive
+    data = static_cast<unsigned char*>(MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0));
+    CloseHandle(mapping);
+    if (data == nullptr)
+        return false;
+
+    size = (size_t)fileSize.QuadPart;
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (data != nullptr)
+        UnmapViewOfFile(data);
+    data = nullptr;
+    size = 0;
+}
+
+#else
+
+bool MappedFile::open(const char* filename)
+{
+    close();
+
+    int file = ::open(filename, O_RDONLY);
+    if (file < 0)
+        return false;
+
+    // The mapping stays valid once the file is closed
+    struct stat status;
+    void* mapping = MAP_FAILED;
+    if (fstat(file, &status) == 0 && status.st_size > 0)
+        mapping = mmap(nullptr, (size_t)status.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+    ::close(file);
+    if (mapping == MAP_FAILED)
+        return false;
+
+    data = static_cast<unsigned char*>(mapping);
+    size = (size_t)status.st_size;
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (data != nullptr)
+        munmap(data, size);
+    data = nullptr;
+    size = 0;
+}
+
+#endif
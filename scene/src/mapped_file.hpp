@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Whole file mapped in memory, its pages are only read from the disk when first touched
+// The mapping is copy-on-write: the data can be modified, but the changes never reach the file
+struct MappedFile
+{
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    // The mapping is handed over, pointers to the data stay valid
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+    ~MappedFile();
+
+    // Returns false if the file can't be opened or is empty
+    bool open(const char* filename);
+    void close();
+
+    bool isOpen() const { return data != nullptr; }
+    unsigned char* getData() const { return data; }
+    size_t getSize() const { return size; }
+
+private:
+    unsigned char* data = nullptr;
+    size_t size = 0;
+};
+
+// Size and modification time in seconds, to check whether a file derived from it is outdated
+bool getFileStamp(const char* filename, unsigned long long& size, long long& time);
+
+// Absolute path of an existing file, so it can still be found once the working directory changed; empty on error
+std::string getFullPath(const char* filename);
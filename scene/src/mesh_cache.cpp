@@ -0,0 +1,180 @@
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "mesh_cache.hpp"
+
+// Values are written as they are in memory, so files are only shared between little endian hosts
+struct MeshFileHeader
+{
+    char magic[8];
+    unsigned int version;
+    unsigned int vertexSize; // sizeof(rdrVertex)
+    unsigned long long sourceSize;
+    long long sourceTime;
+    float scale;
+    int vertexCount;
+    int indexCount;
+    int subMeshCount;
+    int materialCount;
+    float boundsMin[3];
+    float boundsMax[3];
+    MeshOptimizationStats optimization;
+    unsigned long long vertexOffset; // From the start of the file, aligned to 16 bytes
+    unsigned long long indexOffset;
+    unsigned long long subMeshOffset;
+    unsigned long long materialOffset;
+};
+
+static const char meshMagic[8] = { 'S', 'C', 'N', 'M', 'E', 'S', 'H', 0 };
+
+static bool isRangeInFile(unsigned long long offset, unsigned long long count, size_t elementSize, size_t fileSize)
+{
+    return offset <= fileSize && count <= (fileSize - offset) / elementSize;
+}
+
+void useMeshData(Mesh& mesh)
+{
+    mesh.vertices = mesh.vertexData.data();
+    mesh.vertexCount = (int)mesh.vertexData.size();
+    mesh.indices = mesh.indexData.data();
+    mesh.indexCount = (int)mesh.indexData.size();
+}
+
+bool loadMeshCache(Mesh& mesh, const char* cacheFile, const char* sourceFile, float scale)
+{
+    unsigned long long sourceSize;
+    long long sourceTime;
+    if (!getFileStamp(sourceFile, sourceSize, sourceTime) || !mesh.file.open(cacheFile))
+        return false;
+
+    const unsigned char* data = mesh.file.getData();
+    size_t size = mesh.file.getSize();
+    MeshFileHeader header;
+    bool valid = size >= sizeof(header);
+    if (valid)
+    {
+        memcpy(&header, data, sizeof(header));
+        valid = memcmp(header.magic, meshMagic, sizeof(meshMagic)) == 0
+            && header.version == MESH_CACHE_VERSION
+            && header.vertexSize == sizeof(rdrVertex)
+            && header.sourceSize == sourceSize && header.sourceTime == sourceTime
+            && header.scale == scale
+            && header.vertexCount >= 0 && header.indexCount >= 0 && header.subMeshCount >= 0 && header.materialCount >= 0
+            && header.vertexOffset % 16 == 0 && header.indexOffset % 4 == 0
+            && isRangeInFile(header.vertexOffset, header.vertexCount, sizeof(rdrVertex), size)
+            && isRangeInFile(header.indexOffset, header.indexCount, sizeof(unsigned int), size)
+            && isRangeInFile(header.subMeshOffset, header.subMeshCount, sizeof(MeshSubMesh), size)
+            && isRangeInFile(header.materialOffset, header.materialCount, sizeof(MeshMaterial), size);
+    }
+
+    // Sub-meshes out of the buffers, or indices past their vertices, would be drawn out of bounds
+    // The indices are only checked here, the renderer trusts them
+    if (valid)
+    {
+        mesh.subMeshes.resize(header.subMeshCount);
+        memcpy(mesh.subMeshes.data(), data + header.subMeshOffset, header.subMeshCount * sizeof(MeshSubMesh));
+        const unsigned int* indices = reinterpret_cast<const unsigned int*>(data + header.indexOffset);
+        for (const MeshSubMesh& subMesh : mesh.subMeshes)
+        {
+            valid &= subMesh.firstVertex >= 0 && subMesh.vertexCount >= 0 && subMesh.vertexCount <= header.vertexCount - subMesh.firstVertex
+                && subMesh.firstIndex >= 0 && subMesh.indexCount >= 0 && subMesh.indexCount <= header.indexCount - subMesh.firstIndex
+                && subMesh.material < header.materialCount;
+            if (!valid)
+                break;
+
+            for (int i = subMesh.firstIndex; i < subMesh.firstIndex + subMesh.indexCount; ++i)
+                valid &= indices[i] < (unsigned int)subMesh.vertexCount;
+        }
+    }
+
+    if (!valid)
+    {
+        printf("Mesh cache %s is outdated or invalid, it is rebuilt\n", cacheFile);
+        mesh.file.close();
+        mesh.subMeshes.clear();
+        return false;
+    }
+
+    mesh.vertices = reinterpret_cast<rdrVertex*>(mesh.file.getData() + header.vertexOffset);
+    mesh.vertexCount = header.vertexCount;
+    mesh.indices = reinterpret_cast<unsigned int*>(mesh.file.getData() + header.indexOffset);
+    mesh.indexCount = header.indexCount;
+
+    mesh.materials.resize(header.materialCount);
+    memcpy(mesh.materials.data(), data + header.materialOffset, header.materialCount * sizeof(MeshMaterial));
+    for (MeshMaterial& material : mesh.materials)
+    {
+        material.name[sizeof(material.name) - 1] = '\0';
+        material.diffuseTexture[sizeof(material.diffuseTexture) - 1] = '\0';
+    }
+
+    mesh.boundsMin = { header.boundsMin[0], header.boundsMin[1], header.boundsMin[2] };
+    mesh.boundsMax = { header.boundsMax[0], header.boundsMax[1], header.boundsMax[2] };
+    mesh.optimization = header.optimization;
+    return true;
+}
+
+static unsigned long long alignOffset(unsigned long long offset)
+{
+    return (offset + 15) & ~15ull;
+}
+
+// Blocks are written in order, the gap from the end of the previous one is filled with zeros
+static bool writeAt(FILE* file, unsigned long long& position, unsigned long long offset, const void* data, size_t size)
+{
+    static const unsigned char padding[16] = {};
+    size_t paddingSize = (size_t)(offset - position);
+    if (fwrite(padding, 1, paddingSize, file) != paddingSize || fwrite(data, 1, size, file) != size)
+        return false;
+    position = offset + size;
+    return true;
+}
+
+// Written to a temporary file first, so an interrupted write never leaves a valid looking cache
+bool writeMeshCache(const Mesh& mesh, const char* cacheFile, const char* sourceFile, float scale)
+{
+    MeshFileHeader header = {};
+    memcpy(header.magic, meshMagic, sizeof(meshMagic));
+    header.version = MESH_CACHE_VERSION;
+    header.vertexSize = sizeof(rdrVertex);
+    if (!getFileStamp(sourceFile, header.sourceSize, header.sourceTime))
+        return false;
+    header.scale = scale;
+    header.vertexCount = mesh.vertexCount;
+    header.indexCount = mesh.indexCount;
+    header.subMeshCount = (int)mesh.subMeshes.size();
+    header.materialCount = (int)mesh.materials.size();
+    for (int i = 0; i < 3; ++i)
+    {
+        header.boundsMin[i] = mesh.boundsMin.e[i];
+        header.boundsMax[i] = mesh.boundsMax.e[i];
+    }
+    header.optimization = mesh.optimization;
+    header.vertexOffset = alignOffset(sizeof(header));
+    header.indexOffset = alignOffset(header.vertexOffset + (unsigned long long)mesh.vertexCount * sizeof(rdrVertex));
+    header.subMeshOffset = alignOffset(header.indexOffset + (unsigned long long)mesh.indexCount * sizeof(unsigned int));
+    header.materialOffset = alignOffset(header.subMeshOffset + mesh.subMeshes.size() * sizeof(MeshSubMesh));
+
+    std::string tempFile = std::string(cacheFile) + ".tmp";
+    FILE* file = fopen(tempFile.c_str(), "wb");
+    if (file == nullptr)
+        return false;
+
+    unsigned long long position = 0;
+    bool written = writeAt(file, position, 0, &header, sizeof(header))
+        && writeAt(file, position, header.vertexOffset, mesh.vertices, mesh.vertexCount * sizeof(rdrVertex))
+        && writeAt(file, position, header.indexOffset, mesh.indices, mesh.indexCount * sizeof(unsigned int))
+        && writeAt(file, position, header.subMeshOffset, mesh.subMeshes.data(), mesh.subMeshes.size() * sizeof(MeshSubMesh))
+        && writeAt(file, position, header.materialOffset, mesh.materials.data(), mesh.materials.size() * sizeof(MeshMaterial));
+    written = fclose(file) == 0 && written;
+
+    // rename() does not replace an existing file on Windows
+    remove(cacheFile);
+    if (!written || rename(tempFile.c_str(), cacheFile) != 0)
+    {
+        remove(tempFile.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <vector>
+
+#include <rdr/renderer.h>
+
+#include <common/types.hpp>
+
+#include "mapped_file.hpp"
+
+// Binary copy of a loaded OBJ, written next to it on the first run, then memory mapped instead of parsing the text again
+// The vertices and indices are stored as they are drawn, so the renderer reads them straight from the mapped pages
+// Bump the version whenever the layout or the loading of the OBJ changes, older files are then rebuilt
+#define MESH_CACHE_VERSION 3
+#define MESH_CACHE_EXTENSION ".mesh"
+
+struct MeshSubMesh
+{
+    int firstVertex;
+    int vertexCount;
+    int firstIndex;  // Indices are relative to firstVertex
+    int indexCount;
+    int material;    // Of the first face, -1 without material
+};
+
+struct MeshMaterial
+{
+    char name[64];
+    float diffuse[3];
+    char diffuseTexture[128]; // As written in the MTL file, empty without texture
+};
+
+// Measured by optimizeMesh() when the cache is built, see mesh_optimizer.hpp
+struct MeshOptimizationStats
+{
+    float acmrBefore;
+    float acmrAfter;
+    float overdrawBefore;
+    float overdrawAfter;
+};
+
+// Vertices and indices point either to the mapped cache file, or to the vectors when the mesh comes from the OBJ
+struct Mesh
+{
+    rdrVertex* vertices = nullptr;
+    int vertexCount = 0;
+    unsigned int* indices = nullptr;
+    int indexCount = 0;
+
+    std::vector<MeshSubMesh> subMeshes;
+    std::vector<MeshMaterial> materials;
+    float3 boundsMin = {}; // Of the scaled vertices
+    float3 boundsMax = {};
+    MeshOptimizationStats optimization = {};
+
+    MappedFile file;
+    std::vector<rdrVertex> vertexData;
+    std::vector<unsigned int> indexData;
+};
+
+// Points the buffers to the vectors, once they are filled
+void useMeshData(Mesh& mesh);
+
+// The cache is only valid for the source file it was built from, with the same size and modification time, and the same scale
+// Returns false if it is missing, outdated or invalid; mesh is then left empty
+bool loadMeshCache(Mesh& mesh, const char* cacheFile, const char* sourceFile, float scale);
+bool writeMeshCache(const Mesh& mesh, const char* cacheFile, const char* sourceFile, float scale);
@@ -0,0 +1,488 @@
+#include <algorithm>
+#include <cfloat>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include <common/maths.hpp>
+#include <common/trace.hpp>
+
+#include "mesh_optimizer.hpp"
+
+// A new cluster may start once the vertex cache misses since the last one are this close to those of its whole Tipsify cluster
+static const float CLUSTER_ACMR_THRESHOLD = 1.f;
+
+// Resolution of each view of the overdraw estimate
+static const int OVERDRAW_GRID_SIZE = 256;
+
+// FIFO cache of vertex indices, an entry is evicted MESH_VERTEX_CACHE_SIZE misses after it was loaded
+struct VertexCache
+{
+    std::vector<unsigned int> loadTimes;
+    unsigned int time = MESH_VERTEX_CACHE_SIZE + 1;
+
+    explicit VertexCache(int vertexCount) : loadTimes(vertexCount, 0) {}
+
+    bool isCached(unsigned int vertex) const { return time - loadTimes[vertex] <= MESH_VERTEX_CACHE_SIZE; }
+
+    // Returns 1 on miss
+    int fetch(unsigned int vertex)
+    {
+        if (isCached(vertex))
+            return 0;
+        loadTimes[vertex] = time++;
+        return 1;
+    }
+
+    int fetchTriangle(const unsigned int* triangle) { return fetch(triangle[0]) + fetch(triangle[1]) + fetch(triangle[2]); }
+
+    void flush() { time += MESH_VERTEX_CACHE_SIZE + 1; }
+};
+
+static float3 getPosition(const rdrVertex& vertex)
+{
+    return { vertex.x, vertex.y, vertex.z };
+}
+
+static float3 crossProduct(float3 a, float3 b)
+{
+    return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+}
+
+// Vertices of a sub-mesh with the same bytes become one, in the order they are first found
+static void weldVertices(std::vector<rdrVertex>& vertices, std::vector<unsigned int>& indices)
+{
+    size_t tableSize = 16;
+    while (tableSize < vertices.size() * 2)
+        tableSize *= 2;
+    std::vector<unsigned int> table(tableSize, UINT_MAX);
+
+    std::vector<unsigned int> remap(vertices.size());
+    std::vector<rdrVertex> welded;
+    welded.reserve(vertices.size());
+    for (size_t i = 0; i < vertices.size(); ++i)
+    {
+        const unsigned int* words = reinterpret_cast<const unsigned int*>(&vertices[i]);
+        unsigned int hash = 0;
+        for (size_t j = 0; j < sizeof(rdrVertex) / sizeof(unsigned int); ++j)
+            hash = (hash ^ words[j]) * 0x9e3779b1u;
+        hash ^= hash >> 16;
+
+        for (size_t slot = hash & (tableSize - 1); ; slot = (slot + 1) & (tableSize - 1))
+        {
+            unsigned int vertex = table[slot];
+            if (vertex == UINT_MAX)
+            {
+                vertex = (unsigned int)welded.size();
+                table[slot] = vertex;
+                welded.push_back(vertices[i]);
+            }
+            else if (memcmp(&welded[vertex], &vertices[i], sizeof(rdrVertex)) != 0)
+            {
+                continue;
+            }
+            remap[i] = vertex;
+            break;
+        }
+    }
+
+    for (unsigned int& index : indices)
+        index = remap[index];
+    vertices.swap(welded);
+}
+
+// Tipsify: fans triangles around a vertex, then moves to the vertex of the last fans that will stay in the cache the longest
+// Returns the triangles where the fanning had to restart from a vertex that is not in the cache, the first being 0
+static std::vector<int> orderForVertexCache(std::vector<unsigned int>& indices, int vertexCount)
+{
+    int triangleCount = (int)indices.size() / 3;
+
+    // Triangles using each vertex
+    std::vector<int> liveTriangles(vertexCount, 0);
+    for (unsigned int index : indices)
+        ++liveTriangles[index];
+    std::vector<int> firstTriangle(vertexCount + 1, 0);
+    for (int i = 0; i < vertexCount; ++i)
+        firstTriangle[i + 1] = firstTriangle[i] + liveTriangles[i];
+    std::vector<int> vertexTriangles(indices.size());
+    std::vector<int> fill(firstTriangle.begin(), firstTriangle.end() - 1);
+    for (size_t i = 0; i < indices.size(); ++i)
+        vertexTriangles[fill[indices[i]]++] = (int)(i / 3);
+
+    std::vector<unsigned int> ordered;
+    ordered.reserve(indices.size());
+    std::vector<int> restarts;
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<unsigned int> deadEnds; // Vertices of the last fans, most recent on top
+    std::vector<unsigned int> candidates;
+    VertexCache cache(vertexCount);
+    int scanVertex = 0;
+    bool restarted = true;
+
+    int fanVertex = triangleCount > 0 ? (int)indices[0] : -1;
+    while (fanVertex >= 0)
+    {
+        candidates.clear();
+        for (int i = firstTriangle[fanVertex]; i < firstTriangle[fanVertex + 1]; ++i)
+        {
+            int triangle = vertexTriangles[i];
+            if (emitted[triangle])
+                continue;
+            emitted[triangle] = true;
+
+            if (restarted)
+                restarts.push_back((int)ordered.size() / 3);
+            restarted = false;
+
+            for (int j = 0; j < 3; ++j)
+            {
+                unsigned int vertex = indices[triangle * 3 + j];
+                ordered.push_back(vertex);
+                deadEnds.push_back(vertex);
+                candidates.push_back(vertex);
+                --liveTriangles[vertex];
+                cache.fetch(vertex);
+            }
+        }
+
+        // The oldest candidate that stays in the cache until all its triangles are fanned, else any one still used
+        fanVertex = -1;
+        int bestPriority = -1;
+        for (unsigned int vertex : candidates)
+        {
+            if (liveTriangles[vertex] == 0)
+                continue;
+
+            int age = (int)(cache.time - cache.loadTimes[vertex]);
+            int priority = age + 2 * liveTriangles[vertex] <= MESH_VERTEX_CACHE_SIZE ? age : 0;
+            if (priority > bestPriority)
+            {
+                bestPriority = priority;
+                fanVertex = (int)vertex;
+            }
+        }
+        if (fanVertex >= 0)
+            continue;
+
+        restarted = true;
+        while (!deadEnds.empty() && fanVertex < 0)
+        {
+            unsigned int vertex = deadEnds.back();
+            deadEnds.pop_back();
+            if (liveTriangles[vertex] > 0)
+                fanVertex = (int)vertex;
+        }
+        while (fanVertex < 0 && scanVertex < vertexCount)
+        {
+            if (liveTriangles[scanVertex] > 0)
+                fanVertex = scanVertex;
+            ++scanVertex;
+        }
+    }
+
+    indices.swap(ordered);
+    return restarts;
+}
+
+// Splits the restarts of Tipsify into smaller clusters, each starting with an empty cache,
+// where that costs little more vertex transforms than the whole cluster
+static std::vector<int> splitClusters(const std::vector<unsigned int>& indices, int vertexCount, const std::vector<int>& restarts)
+{
+    int triangleCount = (int)indices.size() / 3;
+    VertexCache cache(vertexCount);
+    std::vector<int> clusters;
+    for (size_t i = 0; i < restarts.size(); ++i)
+    {
+        int first = restarts[i];
+        int end = i + 1 < restarts.size() ? restarts[i + 1] : triangleCount;
+
+        cache.flush();
+        int misses = 0;
+        for (int triangle = first; triangle < end; ++triangle)
+            misses += cache.fetchTriangle(&indices[triangle * 3]);
+        float acmr = (float)misses / (end - first);
+
+        cache.flush();
+        clusters.push_back(first);
+        int clusterFirst = first;
+        int clusterMisses = 0;
+        for (int triangle = first; triangle < end - 1; ++triangle)
+        {
+            clusterMisses += cache.fetchTriangle(&indices[triangle * 3]);
+            if (clusterMisses <= CLUSTER_ACMR_THRESHOLD * acmr * (triangle + 1 - clusterFirst))
+            {
+                cache.flush();
+                clusterFirst = triangle + 1;
+                clusterMisses = 0;
+                clusters.push_back(clusterFirst);
+            }
+        }
+    }
+    return clusters;
+}
+
+// Clusters on the outside of the sub-mesh, facing away from its center, are drawn first, since they hide the others from most views
+static void sortClusters(std::vector<unsigned int>& indices, const std::vector<rdrVertex>& vertices, const std::vector<int>& clusters)
+{
+    int triangleCount = (int)indices.size() / 3;
+    std::vector<float3> centers(clusters.size(), float3{});
+    std::vector<float3> normals(clusters.size(), float3{});
+    std::vector<float> areas(clusters.size(), 0.f);
+    float3 meshCenter = {};
+    float meshArea = 0.f;
+    for (size_t i = 0; i < clusters.size(); ++i)
+    {
+        int end = i + 1 < clusters.size() ? clusters[i + 1] : triangleCount;
+        for (int triangle = clusters[i]; triangle < end; ++triangle)
+        {
+            float3 p0 = getPosition(vertices[indices[triangle * 3 + 0]]);
+            float3 p1 = getPosition(vertices[indices[triangle * 3 + 1]]);
+            float3 p2 = getPosition(vertices[indices[triangle * 3 + 2]]);
+
+            // The cross product is twice the area, along the normal
+            float3 normal = crossProduct(p1 - p0, p2 - p0);
+            float area = maths::magnitude(normal);
+            centers[i] += (p0 + p1 + p2) * (area / 3.f);
+            normals[i] += normal;
+            areas[i] += area;
+        }
+        meshCenter += centers[i];
+        meshArea += areas[i];
+    }
+    if (meshArea > 0.f)
+        meshCenter = meshCenter / meshArea;
+
+    std::vector<float> keys(clusters.size(), 0.f);
+    for (size_t i = 0; i < clusters.size(); ++i)
+    {
+        float normalLength = maths::magnitude(normals[i]);
+        if (areas[i] > 0.f && normalLength > 0.f)
+            keys[i] = maths::dotProduct(centers[i] / areas[i] - meshCenter, normals[i] / normalLength);
+    }
+
+    std::vector<int> order(clusters.size());
+    for (size_t i = 0; i < order.size(); ++i)
+        order[i] = (int)i;
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return keys[a] > keys[b]; });
+
+    std::vector<unsigned int> sorted;
+    sorted.reserve(indices.size());
+    for (int cluster : order)
+    {
+        int end = cluster + 1 < (int)clusters.size() ? clusters[cluster + 1] : triangleCount;
+        sorted.insert(sorted.end(), indices.begin() + clusters[cluster] * 3, indices.begin() + end * 3);
+    }
+    indices.swap(sorted);
+}
+
+// Vertices are numbered in the order the triangles first use them, unused ones are dropped
+static void orderForVertexFetch(std::vector<rdrVertex>& vertices, std::vector<unsigned int>& indices)
+{
+    std::vector<unsigned int> remap(vertices.size(), UINT_MAX);
+    std::vector<rdrVertex> ordered;
+    ordered.reserve(vertices.size());
+    for (unsigned int& index : indices)
+    {
+        if (remap[index] == UINT_MAX)
+        {
+            remap[index] = (unsigned int)ordered.size();
+            ordered.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+    vertices.swap(ordered);
+}
+
+static int getCacheMisses(const unsigned int* indices, int indexCount, int vertexCount)
+{
+    VertexCache cache(vertexCount);
+    int misses = 0;
+    for (int i = 0; i + 2 < indexCount; i += 3)
+        misses += cache.fetchTriangle(&indices[i]);
+    return misses;
+}
+
+float getMeshAcmr(const Mesh& mesh)
+{
+    int misses = 0;
+    int triangles = 0;
+    for (const MeshSubMesh& subMesh : mesh.subMeshes)
+    {
+        misses += getCacheMisses(mesh.indices + subMesh.firstIndex, subMesh.indexCount, subMesh.vertexCount);
+        triangles += subMesh.indexCount / 3;
+    }
+    return triangles > 0 ? (float)misses / triangles : 0.f;
+}
+
+// Depth of the views of the overdraw estimate, for each axis the front faces as seen from its positive side,
+// and the back faces as seen from its negative side
+struct OverdrawViews
+{
+    float3 boundsMin;
+    float3 boundsMax;
+    std::vector<float> depthBuffers[3][2];
+
+    OverdrawViews(const float3& boundsMin, const float3& boundsMax) : boundsMin(boundsMin), boundsMax(boundsMax)
+    {
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            depthBuffers[axis][0].assign(OVERDRAW_GRID_SIZE * OVERDRAW_GRID_SIZE, -FLT_MAX);
+            depthBuffers[axis][1].assign(OVERDRAW_GRID_SIZE * OVERDRAW_GRID_SIZE, FLT_MAX);
+        }
+    }
+};
+
+// Draws the triangles projected along axis; returns the number of pixels that passed the depth test
+static long long drawOverdrawView(OverdrawViews& views, int axis, const rdrVertex* vertices, const unsigned int* indices, int indexCount)
+{
+    // Pixel axes, so that the triangles facing the positive side of axis wind counterclockwise
+    int axisU = (axis + 1) % 3;
+    int axisV = (axis + 2) % 3;
+    const float3& boundsMin = views.boundsMin;
+    float extent = maths::max(views.boundsMax.e[axisU] - boundsMin.e[axisU], views.boundsMax.e[axisV] - boundsMin.e[axisV]);
+    float scale = extent > 0.f ? (OVERDRAW_GRID_SIZE - 1) / extent : 0.f;
+
+    long long pixelsDrawn = 0;
+    for (int i = 0; i + 2 < indexCount; i += 3)
+    {
+        float u[3], v[3], depth[3];
+        for (int j = 0; j < 3; ++j)
+        {
+            const float* position = &vertices[indices[i + j]].x;
+            u[j] = (position[axisU] - boundsMin.e[axisU]) * scale;
+            v[j] = (position[axisV] - boundsMin.e[axisV]) * scale;
+            depth[j] = position[axis];
+        }
+
+        float area = (u[1] - u[0]) * (v[2] - v[0]) - (u[2] - u[0]) * (v[1] - v[0]);
+        if (area == 0.f)
+            continue;
+        bool front = area > 0.f;
+        std::vector<float>& depthBuffer = views.depthBuffers[axis][front ? 0 : 1];
+
+        int minX = maths::max((int)floorf(std::min({ u[0], u[1], u[2] })), 0);
+        int maxX = maths::min((int)ceilf(std::max({ u[0], u[1], u[2] })), OVERDRAW_GRID_SIZE - 1);
+        int minY = maths::max((int)floorf(std::min({ v[0], v[1], v[2] })), 0);
+        int maxY = maths::min((int)ceilf(std::max({ v[0], v[1], v[2] })), OVERDRAW_GRID_SIZE - 1);
+        for (int y = minY; y <= maxY; ++y)
+        {
+            for (int x = minX; x <= maxX; ++x)
+            {
+                // Barycentric weights at the pixel center, all of the sign of area inside the triangle
+                float px = x + 0.5f;
+                float py = y + 0.5f;
+                float w0 = ((u[2] - u[1]) * (py - v[1]) - (v[2] - v[1]) * (px - u[1])) / area;
+                float w1 = ((u[0] - u[2]) * (py - v[2]) - (v[0] - v[2]) * (px - u[2])) / area;
+                float w2 = 1.f - w0 - w1;
+                if (w0 < 0.f || w1 < 0.f || w2 < 0.f)
+                    continue;
+
+                float z = w0 * depth[0] + w1 * depth[1] + w2 * depth[2];
+                float& stored = depthBuffer[y * OVERDRAW_GRID_SIZE + x];
+                if (front ? z > stored : z < stored)
+                {
+                    stored = z;
+                    ++pixelsDrawn;
+                }
+            }
+        }
+    }
+    return pixelsDrawn;
+}
+
+static long long drawOverdraw(OverdrawViews& views, const rdrVertex* vertices, const unsigned int* indices, int indexCount)
+{
+    long long pixelsDrawn = 0;
+    for (int axis = 0; axis < 3; ++axis)
+        pixelsDrawn += drawOverdrawView(views, axis, vertices, indices, indexCount);
+    return pixelsDrawn;
+}
+
+float getMeshOverdraw(const Mesh& mesh)
+{
+    OverdrawViews views(mesh.boundsMin, mesh.boundsMax);
+    long long pixelsDrawn = 0;
+    for (const MeshSubMesh& subMesh : mesh.subMeshes)
+        pixelsDrawn += drawOverdraw(views, mesh.vertices + subMesh.firstVertex, mesh.indices + subMesh.firstIndex, subMesh.indexCount);
+
+    long long pixelsCovered = 0;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        for (float depth : views.depthBuffers[axis][0])
+            pixelsCovered += depth != -FLT_MAX;
+        for (float depth : views.depthBuffers[axis][1])
+            pixelsCovered += depth != FLT_MAX;
+    }
+    return pixelsCovered > 0 ? (float)pixelsDrawn / pixelsCovered : 1.f;
+}
+
+// The depth left by a sub-mesh does not depend on the order of its triangles, so the pixels each order draws over
+// the sub-meshes before it add up to those drawn for the whole mesh
+static long long getPixelsDrawn(const OverdrawViews& views, const std::vector<rdrVertex>& vertices, const std::vector<unsigned int>& indices)
+{
+    OverdrawViews drawn = views;
+    return drawOverdraw(drawn, vertices.data(), indices.data(), (int)indices.size());
+}
+
+void optimizeMesh(Mesh& mesh)
+{
+    TRACE_SCOPE("Optimize Mesh");
+
+    mesh.optimization.acmrBefore = getMeshAcmr(mesh);
+    mesh.optimization.overdrawBefore = getMeshOverdraw(mesh);
+
+    // Sub-meshes are drawn in order, each one is measured over the depth of those before it
+    OverdrawViews views(mesh.boundsMin, mesh.boundsMax);
+    std::vector<rdrVertex> vertexData;
+    std::vector<unsigned int> indexData;
+    vertexData.reserve(mesh.vertexData.size());
+    indexData.reserve(mesh.indexData.size());
+    for (MeshSubMesh& subMesh : mesh.subMeshes)
+    {
+        std::vector<rdrVertex> inputVertices(mesh.vertexData.begin() + subMesh.firstVertex, mesh.vertexData.begin() + subMesh.firstVertex + subMesh.vertexCount);
+        std::vector<unsigned int> inputIndices(mesh.indexData.begin() + subMesh.firstIndex, mesh.indexData.begin() + subMesh.firstIndex + subMesh.indexCount);
+        std::vector<rdrVertex> vertices = inputVertices;
+        std::vector<unsigned int> indices = inputIndices;
+
+        weldVertices(vertices, indices);
+        std::vector<int> restarts = orderForVertexCache(indices, (int)vertices.size());
+
+        // Sorting the clusters costs some vertex cache misses, it is only kept if it helps
+        std::vector<unsigned int> sorted = indices;
+        sortClusters(sorted, vertices, splitClusters(sorted, (int)vertices.size(), restarts));
+        long long pixelsDrawn = getPixelsDrawn(views, vertices, indices);
+        long long sortedPixelsDrawn = getPixelsDrawn(views, vertices, sorted);
+        if (sortedPixelsDrawn < pixelsDrawn)
+        {
+            indices.swap(sorted);
+            pixelsDrawn = sortedPixelsDrawn;
+        }
+
+        // Sub-meshes already well ordered may lose on either measure, they then keep the input order,
+        // so that neither the cache miss ratio nor the overdraw of the whole mesh can get worse
+        if (getCacheMisses(indices.data(), (int)indices.size(), (int)vertices.size()) > getCacheMisses(inputIndices.data(), (int)inputIndices.size(), (int)inputVertices.size())
+            || pixelsDrawn > getPixelsDrawn(views, inputVertices, inputIndices))
+        {
+            vertices.swap(inputVertices);
+            indices.swap(inputIndices);
+        }
+
+        drawOverdraw(views, vertices.data(), indices.data(), (int)indices.size());
+        orderForVertexFetch(vertices, indices);
+
+        subMesh.firstVertex = (int)vertexData.size();
+        subMesh.vertexCount = (int)vertices.size();
+        subMesh.firstIndex = (int)indexData.size();
+        subMesh.indexCount = (int)indices.size();
+        vertexData.insert(vertexData.end(), vertices.begin(), vertices.end());
+        indexData.insert(indexData.end(), indices.begin(), indices.end());
+    }
+
+    mesh.vertexData.swap(vertexData);
+    mesh.indexData.swap(indexData);
+    useMeshData(mesh);
+
+    mesh.optimization.acmrAfter = getMeshAcmr(mesh);
+    mesh.optimization.overdrawAfter = getMeshOverdraw(mesh);
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "mesh_cache.hpp"
+
+// Simulated FIFO cache of transformed vertices, the size of small hardware caches
+#define MESH_VERTEX_CACHE_SIZE 16
+
+// Reorders each sub-mesh of a mesh loaded from an OBJ, which is then drawn the same, except for the order of its triangles:
+// - identical vertices are welded
+// - triangles are ordered for the vertex cache with Tipsify (Sander, Nehab, Barczak 2007)
+// - the clusters of that order are sorted front to back from the outside of the sub-mesh, to reduce overdraw from any view
+// - vertices are renumbered in the order they are first used, so they are fetched sequentially
+// Sub-meshes keep their input order when the new one raises either their cache misses or the pixels they draw
+// The cache miss ratio and the overdraw before and after, of the order that was kept, are stored in mesh.optimization
+void optimizeMesh(Mesh& mesh);
+
+// Average cache miss ratio, vertices transformed per triangle with MESH_VERTEX_CACHE_SIZE vertices, from 0.5 to 3
+float getMeshAcmr(const Mesh& mesh);
+// Pixels drawn per pixel covered, at least 1, averaged over orthographic views from both sides of the 3 axes
+// Sub-meshes are rasterized in order at a low resolution, with depth test and back face culling
+float getMeshOverdraw(const Mesh& mesh);
@@ -0,0 +1,868 @@
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <tiny_obj_loader.h>
+
+#include <common/maths.hpp>
+#include <common/trace.hpp>
+
+#include "obj_loader.hpp"
+
+// Lines are parsed in chunks of about this size
+static const size_t OBJ_CHUNK_SIZE = 256 * 1024;
+
+static const int INVALID_INDEX = INT_MIN;
+
+// Indices are 0 based, -1 when the attribute is missing
+struct ObjCorner
+{
+    int position;
+    int texcoord;
+    int normal;
+};
+
+// Line changing how the faces that follow it are grouped
+struct ObjEvent
+{
+    enum Type
+    {
+        NEW_SHAPE,        // 'o' or 'g'
+        USE_MATERIAL,     // 'usemtl'
+        MATERIAL_LIBRARY, // 'mtllib'
+    };
+
+    Type type;
+    int face;         // Faces of the chunk before the line
+    std::string name; // Of the material or the library
+};
+
+// Corner with indices relative to the end of the attributes, stored relative to the first attribute of the chunk until the merge
+struct ObjRelativeCorner
+{
+    size_t corner;
+    bool position;
+    bool texcoord;
+    bool normal;
+};
+
+struct ObjChunk
+{
+    const char* begin;
+    const char* end;
+
+    std::vector<float> positions; // xyz
+    std::vector<float> texcoords; // uv
+    std::vector<float> normals;   // xyz
+    std::vector<ObjCorner> corners;
+    std::vector<int> faceSizes;
+    std::vector<ObjEvent> events;
+    std::vector<ObjRelativeCorner> relativeCorners;
+
+    // Filled once every chunk is parsed
+    int firstPosition;
+    int firstTexcoord;
+    int firstNormal;
+    std::vector<ObjCorner> triangles;   // 3 corners each
+    std::vector<int> faceFirstTriangle; // One more than faces
+    int invalidFaces;
+};
+
+// Range of triangles of one chunk
+struct ObjShapeRange
+{
+    int chunk;
+    int firstTriangle;
+    int endTriangle;
+};
+
+struct ObjShape
+{
+    int material;
+    int triangleCount;
+    std::vector<ObjShapeRange> ranges;
+
+    // Deduplicated
+    std::vector<ObjCorner> vertices;
+    std::vector<unsigned int> indices;
+};
+
+// Runs job(0) to job(count - 1) on every core
+static void parallelFor(int count, const std::function<void(int)>& job)
+{
+    int threadCount = std::max(1, std::min((int)std::thread::hardware_concurrency(), count));
+    std::atomic<int> nextJob(0);
+    auto runJobs = [&]()
+    {
+        for (int i = nextJob.fetch_add(1); i < count; i = nextJob.fetch_add(1))
+            job(i);
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 1; i < threadCount; ++i)
+        threads.emplace_back(runJobs);
+    runJobs();
+    for (std::thread& thread : threads)
+        thread.join();
+}
+
+static bool isSpace(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+static bool isDigit(char c)
+{
+    return (unsigned int)(c - '0') < 10u;
+}
+
+static const char* skipSpaces(const char* text, const char* end)
+{
+    while (text < end && isSpace(*text))
+        text++;
+    return text;
+}
+
+// Same algorithm as tinyobj, so both give the same floats for the same text
+static bool parseDouble(const char* text, const char* end, double& result)
+{
+    if (text >= end)
+        return false;
+
+    double mantissa = 0.0;
+    int exponent = 0;
+    bool negative = false;
+    const char* c = text;
+
+    bool leadingDot = false;
+    if (*c == '+' || *c == '-')
+    {
+        negative = *c == '-';
+        c++;
+        leadingDot = c < end && *c == '.';
+    }
+    else if (*c == '.')
+    {
+        leadingDot = true;
+    }
+    else if (!isDigit(*c))
+    {
+        return false;
+    }
+
+    if (!leadingDot)
+    {
+        int read = 0;
+        for (; c < end && isDigit(*c); ++c, ++read)
+            mantissa = mantissa * 10 + (*c - '0');
+        if (read == 0)
+            return false;
+    }
+
+    if (c < end && *c == '.')
+    {
+        static const double powers[] = { 1.0, 0.1, 0.01, 0.001, 0.0001, 0.00001, 0.000001, 0.0000001 };
+        const int powerCount = sizeof(powers) / sizeof(powers[0]);
+
+        c++;
+        for (int read = 1; c < end && isDigit(*c); ++c, ++read)
+            mantissa += (*c - '0') * (read < powerCount ? powers[read] : std::pow(10.0, -read));
+    }
+
+    if (c < end && (*c == 'e' || *c == 'E'))
+    {
+        c++;
+        bool negativeExponent = false;
+        if (c < end && (*c == '+' || *c == '-'))
+        {
+            negativeExponent = *c == '-';
+            c++;
+        }
+        else if (c >= end || !isDigit(*c))
+        {
+            return false;
+        }
+
+        int read = 0;
+        for (; c < end && isDigit(*c); ++c, ++read)
+            exponent = exponent * 10 + (*c - '0');
+        if (read == 0)
+            return false;
+        if (negativeExponent)
+            exponent = -exponent;
+    }
+
+    result = (negative ? -1 : 1) * (exponent ? std::ldexp(mantissa * std::pow(5.0, exponent), exponent) : mantissa);
+    return true;
+}
+
+// Reads the next word of the line, defaultValue if it is not a number
+static const char* parseFloat(const char* text, const char* end, float& value, float defaultValue)
+{
+    text = skipSpaces(text, end);
+    const char* wordEnd = text;
+    while (wordEnd < end && !isSpace(*wordEnd))
+        wordEnd++;
+
+    double result = defaultValue;
+    parseDouble(text, wordEnd, result);
+    value = (float)result;
+    return wordEnd;
+}
+
+static const char* parseInt(const char* text, const char* end, int& value)
+{
+    bool negative = text < end && *text == '-';
+    if (text < end && (*text == '-' || *text == '+'))
+        text++;
+
+    long long result = 0;
+    for (; text < end && isDigit(*text); ++text)
+        result = std::min(result * 10 + (*text - '0'), (long long)INT_MAX);
+    value = (int)(negative ? -result : result);
+    return text;
+}
+
+// OBJ indices start at 1, negative ones count back from the last attribute read
+// Returns the index relative to the first attribute of the chunk, relative is set when it still needs the chunk offset
+static int toChunkIndex(int index, int chunkCount, bool& relative)
+{
+    relative = index < 0;
+    if (index > 0)
+        return index - 1;
+    if (index < 0)
+        return chunkCount + index;
+    return INVALID_INDEX;
+}
+
+// One corner of a face: v, v/vt, v//vn or v/vt/vn
+static const char* parseCorner(const char* text, const char* end, ObjChunk& chunk)
+{
+    int position = 0;
+    int texcoord = 0;
+    int normal = 0;
+    bool hasTexcoord = false;
+    bool hasNormal = false;
+
+    text = parseInt(text, end, position);
+    if (text < end && *text == '/')
+    {
+        text++;
+        if (text < end && *text != '/')
+        {
+            hasTexcoord = true;
+            text = parseInt(text, end, texcoord);
+        }
+        if (text < end && *text == '/')
+        {
+            hasNormal = true;
+            text = parseInt(text + 1, end, normal);
+        }
+    }
+
+    ObjRelativeCorner relative = { chunk.corners.size(), false, false, false };
+    ObjCorner corner;
+    corner.position = toChunkIndex(position, (int)chunk.positions.size() / 3, relative.position);
+    corner.texcoord = hasTexcoord ? toChunkIndex(texcoord, (int)chunk.texcoords.size() / 2, relative.texcoord) : -1;
+    corner.normal = hasNormal ? toChunkIndex(normal, (int)chunk.normals.size() / 3, relative.normal) : -1;
+
+    chunk.corners.push_back(corner);
+    if (relative.position || relative.texcoord || relative.normal)
+        chunk.relativeCorners.push_back(relative);
+
+    // Anything else up to the next space is ignored
+    while (text < end && !isSpace(*text))
+        text++;
+    return text;
+}
+
+static bool startsWith(const char* text, const char* end, const char* keyword)
+{
+    size_t length = strlen(keyword);
+    return (size_t)(end - text) > length && memcmp(text, keyword, length) == 0 && isSpace(text[length]);
+}
+
+static std::string trim(const char* text, const char* end)
+{
+    text = skipSpaces(text, end);
+    while (end > text && isSpace(end[-1]))
+        end--;
+    return std::string(text, end);
+}
+
+static void parseChunk(ObjChunk& chunk)
+{
+    // Sized for the usual mix of lines, about 30 bytes each
+    size_t lineEstimate = (chunk.end - chunk.begin) / 30;
+    chunk.positions.reserve(lineEstimate);
+    chunk.corners.reserve(lineEstimate);
+    chunk.faceSizes.reserve(lineEstimate / 4);
+
+    for (const char* line = chunk.begin; line < chunk.end;)
+    {
+        const char* lineEnd = static_cast<const char*>(memchr(line, '\n', chunk.end - line));
+        lineEnd = lineEnd ? lineEnd : chunk.end;
+        const char* next = lineEnd + 1;
+        if (lineEnd > line && lineEnd[-1] == '\r')
+            lineEnd--;
+
+        const char* text = skipSpaces(line, lineEnd);
+        line = next;
+        if (text == lineEnd || *text == '#')
+            continue;
+
+        if (startsWith(text, lineEnd, "v"))
+        {
+            float x, y, z;
+            text = parseFloat(text + 2, lineEnd, x, 0.f);
+            text = parseFloat(text, lineEnd, y, 0.f);
+            parseFloat(text, lineEnd, z, 0.f);
+            chunk.positions.insert(chunk.positions.end(), { x, y, z });
+        }
+        else if (startsWith(text, lineEnd, "vt"))
+        {
+            float u, v;
+            text = parseFloat(text + 3, lineEnd, u, 0.f);
+            parseFloat(text, lineEnd, v, 0.f);
+            chunk.texcoords.insert(chunk.texcoords.end(), { u, v });
+        }
+        else if (startsWith(text, lineEnd, "vn"))
+        {
+            float x, y, z;
+            text = parseFloat(text + 3, lineEnd, x, 0.f);
+            text = parseFloat(text, lineEnd, y, 0.f);
+            parseFloat(text, lineEnd, z, 0.f);
+            chunk.normals.insert(chunk.normals.end(), { x, y, z });
+        }
+        else if (startsWith(text, lineEnd, "f"))
+        {
+            size_t firstCorner = chunk.corners.size();
+            for (text = skipSpaces(text + 2, lineEnd); text < lineEnd; text = skipSpaces(text, lineEnd))
+                text = parseCorner(text, lineEnd, chunk);
+            chunk.faceSizes.push_back((int)(chunk.corners.size() - firstCorner));
+        }
+        else if (startsWith(text, lineEnd, "o") || startsWith(text, lineEnd, "g"))
+        {
+            chunk.events.push_back({ ObjEvent::NEW_SHAPE, (int)chunk.faceSizes.size(), std::string() });
+        }
+        else if (lineEnd - text >= 6 && memcmp(text, "usemtl", 6) == 0)
+        {
+            // Only the first word is the name
+            const char* name = skipSpaces(text + 6, lineEnd);
+            const char* nameEnd = name;
+            while (nameEnd < lineEnd && !isSpace(*nameEnd))
+                nameEnd++;
+            chunk.events.push_back({ ObjEvent::USE_MATERIAL, (int)chunk.faceSizes.size(), std::string(name, nameEnd) });
+        }
+        else if (startsWith(text, lineEnd, "mtllib"))
+        {
+            chunk.events.push_back({ ObjEvent::MATERIAL_LIBRARY, (int)chunk.faceSizes.size(), trim(text + 7, lineEnd) });
+        }
+        // Other lines (smoothing groups, lines, points...) are not drawn
+    }
+}
+
+// Resolves the indices relative to the chunk, and checks them against the whole file
+static void resolveIndices(ObjChunk& chunk, int positionCount, int texcoordCount, int normalCount)
+{
+    for (const ObjRelativeCorner& relative : chunk.relativeCorners)
+    {
+        ObjCorner& corner = chunk.corners[relative.corner];
+        if (relative.position)
+            corner.position += chunk.firstPosition;
+        if (relative.texcoord)
+            corner.texcoord += chunk.firstTexcoord;
+        if (relative.normal)
+            corner.normal += chunk.firstNormal;
+    }
+
+    for (ObjCorner& corner : chunk.corners)
+    {
+        if (corner.position < 0 || corner.position >= positionCount)
+            corner.position = INVALID_INDEX;
+        if (corner.texcoord < -1 || corner.texcoord >= texcoordCount)
+            corner.position = INVALID_INDEX;
+        if (corner.normal < -1 || corner.normal >= normalCount)
+            corner.position = INVALID_INDEX;
+    }
+}
+
+// code from https://wrf.ecse.rpi.edu//Research/Short_Notes/pnpoly.html
+static bool isInPolygon(int count, const float* x, const float* y, float testX, float testY)
+{
+    bool inside = false;
+    for (int i = 0, j = count - 1; i < count; j = i++)
+    {
+        if ((y[i] > testY) != (y[j] > testY) && testX < (x[j] - x[i]) * (testY - y[i]) / (y[j] - y[i]) + x[i])
+            inside = !inside;
+    }
+    return inside;
+}
+
+// Ear clipping in the plane the polygon is the most facing, the same steps as tinyobj so both give the same triangles
+static void triangulateFace(const ObjCorner* face, int cornerCount, const std::vector<float>& positions, std::vector<ObjCorner>& triangles)
+{
+    if (cornerCount == 3)
+    {
+        triangles.insert(triangles.end(), face, face + 3);
+        return;
+    }
+
+    auto position = [&](const ObjCorner& corner, int axis) { return positions[corner.position * 3 + axis]; };
+
+    int axes[2] = { 1, 2 };
+    for (int k = 0; k < cornerCount; ++k)
+    {
+        const ObjCorner& c0 = face[k];
+        const ObjCorner& c1 = face[(k + 1) % cornerCount];
+        const ObjCorner& c2 = face[(k + 2) % cornerCount];
+        float e0x = position(c1, 0) - position(c0, 0);
+        float e0y = position(c1, 1) - position(c0, 1);
+        float e0z = position(c1, 2) - position(c0, 2);
+        float e1x = position(c2, 0) - position(c1, 0);
+        float e1y = position(c2, 1) - position(c1, 1);
+        float e1z = position(c2, 2) - position(c1, 2);
+        float cx = std::fabs(e0y * e1z - e0z * e1y);
+        float cy = std::fabs(e0z * e1x - e0x * e1z);
+        float cz = std::fabs(e0x * e1y - e0y * e1x);
+        const float epsilon = std::numeric_limits<float>::epsilon();
+        if (cx > epsilon || cy > epsilon || cz > epsilon)
+        {
+            if (!(cx > cy && cx > cz))
+            {
+                axes[0] = 0;
+                if (cz > cx && cz > cy)
+                    axes[1] = 1;
+            }
+            break;
+        }
+    }
+
+    float area = 0.f;
+    for (int k = 0; k < cornerCount; ++k)
+    {
+        const ObjCorner& c0 = face[k];
+        const ObjCorner& c1 = face[(k + 1) % cornerCount];
+        area += (position(c0, axes[0]) * position(c1, axes[1]) - position(c0, axes[1]) * position(c1, axes[0])) * 0.5f;
+    }
+
+    std::vector<ObjCorner> remaining(face, face + cornerCount);
+    int guess = 0;
+    int remainingIterations = cornerCount;
+    int previousCount = cornerCount;
+    while (remaining.size() > 3 && remainingIterations > 0)
+    {
+        int count = (int)remaining.size();
+        if (guess >= count)
+            guess -= count;
+
+        // Gives up when a whole turn finds no ear
+        if (previousCount != count)
+        {
+            previousCount = count;
+            remainingIterations = count;
+        }
+        else
+        {
+            remainingIterations--;
+        }
+
+        ObjCorner ear[3];
+        float x[3];
+        float y[3];
+        for (int k = 0; k < 3; ++k)
+        {
+            ear[k] = remaining[(guess + k) % count];
+            x[k] = position(ear[k], axes[0]);
+            y[k] = position(ear[k], axes[1]);
+        }
+
+        // Reflex corner
+        float cross = (x[1] - x[0]) * (y[2] - y[1]) - (y[1] - y[0]) * (x[2] - x[1]);
+        if (cross * area < 0.f)
+        {
+            guess++;
+            continue;
+        }
+
+        bool overlap = false;
+        for (int other = 3; other < count && !overlap; ++other)
+        {
+            const ObjCorner& corner = remaining[(guess + other) % count];
+            overlap = isInPolygon(3, x, y, position(corner, axes[0]), position(corner, axes[1]));
+        }
+        if (overlap)
+        {
+            guess++;
+            continue;
+        }
+
+        triangles.insert(triangles.end(), ear, ear + 3);
+        remaining.erase(remaining.begin() + (guess + 1) % count);
+    }
+
+    if (remaining.size() == 3)
+        triangles.insert(triangles.end(), remaining.begin(), remaining.end());
+}
+
+static void triangulateChunk(ObjChunk& chunk, const std::vector<float>& positions)
+{
+    chunk.triangles.reserve(chunk.corners.size() * 3 / 2);
+    chunk.faceFirstTriangle.reserve(chunk.faceSizes.size() + 1);
+    chunk.invalidFaces = 0;
+
+    size_t firstCorner = 0;
+    for (int cornerCount : chunk.faceSizes)
+    {
+        chunk.faceFirstTriangle.push_back((int)(chunk.triangles.size() / 3));
+
+        const ObjCorner* face = &chunk.corners[firstCorner];
+        firstCorner += cornerCount;
+
+        bool valid = cornerCount >= 3;
+        for (int i = 0; i < cornerCount && valid; ++i)
+            valid = face[i].position != INVALID_INDEX;
+        if (valid)
+            triangulateFace(face, cornerCount, positions, chunk.triangles);
+        else
+            chunk.invalidFaces++;
+    }
+    chunk.faceFirstTriangle.push_back((int)(chunk.triangles.size() / 3));
+}
+
+// The MTL files are looked for next to the OBJ
+// Names may contain spaces, so the whole line is tried first, then each word as a separate file
+static void loadMaterialLibrary(const std::string& directory, const std::string& line, std::vector<tinyobj::material_t>& materials, std::map<std::string, int>& materialIds)
+{
+    std::vector<std::string> names = { line };
+    for (size_t start = 0; start < line.size();)
+    {
+        size_t space = line.find(' ', start);
+        space = space == std::string::npos ? line.size() : space;
+        if (space > start && !(start == 0 && space == line.size()))
+            names.push_back(line.substr(start, space - start));
+        start = space + 1;
+    }
+
+    for (const std::string& name : names)
+    {
+        std::ifstream stream(directory + name);
+        if (!stream)
+            continue;
+
+        std::string warn;
+        std::string err;
+        tinyobj::LoadMtl(&materialIds, &materials, &stream, &warn, &err);
+        if (!warn.empty())
+            printf("MTL warning: %s", warn.c_str());
+        return;
+    }
+    printf("Material library %s not found\n", line.c_str());
+}
+
+// Events and faces in file order, tinyobj starts a new shape on 'o' and 'g' but not on 'usemtl'
+static void buildShapes(std::vector<ObjChunk>& chunks, const std::string& directory, std::vector<ObjShape>& shapes, std::vector<tinyobj::material_t>& materials)
+{
+    std::map<std::string, int> materialIds;
+    int material = -1;
+
+    ObjShape shape = { -1, 0 };
+    for (int chunkIndex = 0; chunkIndex < (int)chunks.size(); ++chunkIndex)
+    {
+        const ObjChunk& chunk = chunks[chunkIndex];
+        int firstFace = 0;
+        for (size_t event = 0; event <= chunk.events.size(); ++event)
+        {
+            // Faces up to the event, or to the end of the chunk
+            int endFace = event < chunk.events.size() ? chunk.events[event].face : (int)chunk.faceSizes.size();
+            int firstTriangle = chunk.faceFirstTriangle[firstFace];
+            int endTriangle = chunk.faceFirstTriangle[endFace];
+            if (endTriangle > firstTriangle)
+            {
+                if (shape.triangleCount == 0)
+                    shape.material = material;
+                shape.ranges.push_back({ chunkIndex, firstTriangle, endTriangle });
+                shape.triangleCount += endTriangle - firstTriangle;
+            }
+            firstFace = endFace;
+            if (event == chunk.events.size())
+                break;
+
+            const ObjEvent& e = chunk.events[event];
+            switch (e.type)
+            {
+            case ObjEvent::NEW_SHAPE:
+                if (shape.triangleCount > 0)
+                    shapes.push_back(std::move(shape));
+                shape = { -1, 0 };
+                break;
+
+            case ObjEvent::USE_MATERIAL:
+            {
+                auto found = materialIds.find(e.name);
+                material = found != materialIds.end() ? found->second : -1;
+                break;
+            }
+
+            case ObjEvent::MATERIAL_LIBRARY:
+                loadMaterialLibrary(directory, e.name, materials, materialIds);
+                break;
+            }
+        }
+    }
+    if (shape.triangleCount > 0)
+        shapes.push_back(std::move(shape));
+}
+
+static unsigned int hashCorner(const ObjCorner& corner)
+{
+    unsigned int hash = (unsigned int)corner.position * 0x9e3779b1u;
+    hash = (hash ^ (hash >> 15)) + (unsigned int)corner.texcoord * 0x85ebca77u;
+    hash = (hash ^ (hash >> 13)) + (unsigned int)corner.normal * 0xc2b2ae3du;
+    return hash ^ (hash >> 16);
+}
+
+// A vertex is one unique combination of the three indices, numbered in the order they are first used
+static void deduplicateShape(const std::vector<ObjChunk>& chunks, ObjShape& shape)
+{
+    size_t cornerCount = (size_t)shape.triangleCount * 3;
+    shape.indices.resize(cornerCount);
+    shape.vertices.reserve(cornerCount / 2);
+
+    // Open addressing, at most half full
+    size_t tableSize = 16;
+    while (tableSize < cornerCount * 2)
+        tableSize *= 2;
+    std::vector<unsigned int> table(tableSize, UINT_MAX);
+
+    size_t index = 0;
+    for (const ObjShapeRange& range : shape.ranges)
+    {
+        const ObjChunk& chunk = chunks[range.chunk];
+        for (int i = range.firstTriangle * 3; i < range.endTriangle * 3; ++i)
+        {
+            const ObjCorner& corner = chunk.triangles[i];
+            size_t slot = hashCorner(corner) & (tableSize - 1);
+            for (;; slot = (slot + 1) & (tableSize - 1))
+            {
+                unsigned int vertex = table[slot];
+                if (vertex == UINT_MAX)
+                {
+                    vertex = (unsigned int)shape.vertices.size();
+                    table[slot] = vertex;
+                    shape.vertices.push_back(corner);
+                }
+                else
+                {
+                    const ObjCorner& other = shape.vertices[vertex];
+                    if (other.position != corner.position || other.texcoord != corner.texcoord || other.normal != corner.normal)
+                        continue;
+                }
+                shape.indices[index++] = vertex;
+                break;
+            }
+        }
+    }
+}
+
+static void writeVertices(const ObjShape& shape, const std::vector<float>& positions, const std::vector<float>& texcoords, const std::vector<float>& normals, float scale, rdrVertex* vertices)
+{
+    bool missingNormals = false;
+    for (size_t i = 0; i < shape.vertices.size(); ++i)
+    {
+        const ObjCorner& corner = shape.vertices[i];
+        const float* position = &positions[corner.position * 3];
+        float3 normal = corner.normal >= 0 ? float3{ normals[corner.normal * 3], normals[corner.normal * 3 + 1], normals[corner.normal * 3 + 2] } : float3{};
+        float2 uv = corner.texcoord >= 0 ? float2{ texcoords[corner.texcoord * 2], texcoords[corner.texcoord * 2 + 1] } : float2{};
+        vertices[i] = rdrVertex{ position[0] * scale, position[1] * scale, position[2] * scale, normal.x, normal.y, normal.z, 0.f, 0.f, 0.f, 1.f, uv.x, uv.y };
+        missingNormals |= corner.normal < 0;
+    }
+    if (!missingNormals)
+        return;
+
+    // Sum of the normals of the faces around, weighted by their area
+    for (size_t i = 0; i < shape.indices.size(); i += 3)
+    {
+        rdrVertex* corners[3] = { &vertices[shape.indices[i]], &vertices[shape.indices[i + 1]], &vertices[shape.indices[i + 2]] };
+        float3 p0 = { corners[0]->x, corners[0]->y, corners[0]->z };
+        float3 e0 = float3{ corners[1]->x, corners[1]->y, corners[1]->z } - p0;
+        float3 e1 = float3{ corners[2]->x, corners[2]->y, corners[2]->z } - p0;
+        float3 faceNormal = { e0.y * e1.z - e0.z * e1.y, e0.z * e1.x - e0.x * e1.z, e0.x * e1.y - e0.y * e1.x };
+        for (int k = 0; k < 3; ++k)
+        {
+            if (shape.vertices[shape.indices[i + k]].normal >= 0)
+                continue;
+            corners[k]->nx += faceNormal.x;
+            corners[k]->ny += faceNormal.y;
+            corners[k]->nz += faceNormal.z;
+        }
+    }
+
+    for (size_t i = 0; i < shape.vertices.size(); ++i)
+    {
+        if (shape.vertices[i].normal >= 0)
+            continue;
+        rdrVertex& vertex = vertices[i];
+        float3 normal = { vertex.nx, vertex.ny, vertex.nz };
+        float length = maths::magnitude(normal);
+        if (length > 0.f)
+        {
+            vertex.nx = normal.x / length;
+            vertex.ny = normal.y / length;
+            vertex.nz = normal.z / length;
+        }
+    }
+}
+
+// Concatenates the attributes of the chunks, each chunk copies its own part
+template<typename GetAttributes>
+static std::vector<float> mergeAttributes(std::vector<ObjChunk>& chunks, const std::vector<size_t>& offsets, GetAttributes getAttributes)
+{
+    std::vector<float> merged(offsets.back());
+    parallelFor((int)chunks.size(), [&](int i)
+    {
+        std::vector<float>& attributes = getAttributes(chunks[i]);
+        std::copy(attributes.begin(), attributes.end(), merged.begin() + offsets[i]);
+        std::vector<float>().swap(attributes);
+    });
+    return merged;
+}
+
+bool loadObj(Mesh& mesh, const char* filename, float scale)
+{
+    TRACE_SCOPE("Load OBJ");
+
+    MappedFile file;
+    if (!file.open(filename))
+    {
+        printf("Cannot open %s\n", filename);
+        return false;
+    }
+
+    // Cut at the first line break after each chunk size
+    std::vector<ObjChunk> chunks;
+    const char* data = reinterpret_cast<const char*>(file.getData());
+    const char* dataEnd = data + file.getSize();
+    for (const char* begin = data; begin < dataEnd;)
+    {
+        const char* end = begin + std::min(OBJ_CHUNK_SIZE, (size_t)(dataEnd - begin));
+        const char* lineEnd = end < dataEnd ? static_cast<const char*>(memchr(end, '\n', dataEnd - end)) : nullptr;
+        end = lineEnd ? lineEnd + 1 : dataEnd;
+
+        chunks.emplace_back();
+        chunks.back().begin = begin;
+        chunks.back().end = end;
+        begin = end;
+    }
+
+    {
+        TRACE_SCOPE("Parse OBJ Chunks");
+        parallelFor((int)chunks.size(), [&](int i) { parseChunk(chunks[i]); });
+    }
+
+    // Attributes of each chunk start after those of the previous ones
+    std::vector<size_t> positionOffsets = { 0 };
+    std::vector<size_t> texcoordOffsets = { 0 };
+    std::vector<size_t> normalOffsets = { 0 };
+    for (ObjChunk& chunk : chunks)
+    {
+        chunk.firstPosition = (int)(positionOffsets.back() / 3);
+        chunk.firstTexcoord = (int)(texcoordOffsets.back() / 2);
+        chunk.firstNormal = (int)(normalOffsets.back() / 3);
+        positionOffsets.push_back(positionOffsets.back() + chunk.positions.size());
+        texcoordOffsets.push_back(texcoordOffsets.back() + chunk.texcoords.size());
+        normalOffsets.push_back(normalOffsets.back() + chunk.normals.size());
+    }
+
+    std::vector<float> positions = mergeAttributes(chunks, positionOffsets, [](ObjChunk& chunk) -> std::vector<float>& { return chunk.positions; });
+    std::vector<float> texcoords = mergeAttributes(chunks, texcoordOffsets, [](ObjChunk& chunk) -> std::vector<float>& { return chunk.texcoords; });
+    std::vector<float> normals = mergeAttributes(chunks, normalOffsets, [](ObjChunk& chunk) -> std::vector<float>& { return chunk.normals; });
+
+    {
+        TRACE_SCOPE("Triangulate OBJ Chunks");
+        parallelFor((int)chunks.size(), [&](int i)
+        {
+            resolveIndices(chunks[i], (int)positions.size() / 3, (int)texcoords.size() / 2, (int)normals.size() / 3);
+            triangulateChunk(chunks[i], positions);
+        });
+    }
+
+    int invalidFaces = 0;
+    for (const ObjChunk& chunk : chunks)
+        invalidFaces += chunk.invalidFaces;
+    if (invalidFaces > 0)
+        printf("OBJ warning: %d faces with invalid indices skipped in %s\n", invalidFaces, filename);
+
+    std::string path = filename;
+    size_t separator = path.find_last_of("/\\");
+    std::string directory = separator == std::string::npos ? "" : path.substr(0, separator + 1);
+
+    std::vector<ObjShape> shapes;
+    std::vector<tinyobj::material_t> materials;
+    buildShapes(chunks, directory, shapes, materials);
+
+    for (const tinyobj::material_t& material : materials)
+    {
+        MeshMaterial meshMaterial = {};
+        strncpy(meshMaterial.name, material.name.c_str(), sizeof(meshMaterial.name) - 1);
+        for (int i = 0; i < 3; ++i)
+            meshMaterial.diffuse[i] = material.diffuse[i];
+        strncpy(meshMaterial.diffuseTexture, material.diffuse_texname.c_str(), sizeof(meshMaterial.diffuseTexture) - 1);
+        mesh.materials.push_back(meshMaterial);
+    }
+
+    {
+        TRACE_SCOPE("Deduplicate OBJ Vertices");
+        parallelFor((int)shapes.size(), [&](int i) { deduplicateShape(chunks, shapes[i]); });
+    }
+
+    // Each shape is a sub-mesh, its indices are relative to its first vertex, so it can be drawn on its own
+    int vertexCount = 0;
+    int indexCount = 0;
+    for (const ObjShape& shape : shapes)
+    {
+        MeshSubMesh subMesh;
+        subMesh.firstVertex = vertexCount;
+        subMesh.vertexCount = (int)shape.vertices.size();
+        subMesh.firstIndex = indexCount;
+        subMesh.indexCount = (int)shape.indices.size();
+        subMesh.material = shape.material;
+        mesh.subMeshes.push_back(subMesh);
+
+        vertexCount += subMesh.vertexCount;
+        indexCount += subMesh.indexCount;
+    }
+
+    mesh.vertexData.resize(vertexCount);
+    mesh.indexData.resize(indexCount);
+    parallelFor((int)shapes.size(), [&](int i)
+    {
+        const MeshSubMesh& subMesh = mesh.subMeshes[i];
+        writeVertices(shapes[i], positions, texcoords, normals, scale, &mesh.vertexData[subMesh.firstVertex]);
+        std::copy(shapes[i].indices.begin(), shapes[i].indices.end(), mesh.indexData.begin() + subMesh.firstIndex);
+    });
+
+    if (!mesh.vertexData.empty())
+    {
+        mesh.boundsMin = { mesh.vertexData[0].x, mesh.vertexData[0].y, mesh.vertexData[0].z };
+        mesh.boundsMax = mesh.boundsMin;
+    }
+    for (const rdrVertex& vertex : mesh.vertexData)
+    {
+        mesh.boundsMin = { maths::min(mesh.boundsMin.x, vertex.x), maths::min(mesh.boundsMin.y, vertex.y), maths::min(mesh.boundsMin.z, vertex.z) };
+        mesh.boundsMax = { maths::max(mesh.boundsMax.x, vertex.x), maths::max(mesh.boundsMax.y, vertex.y), maths::max(mesh.boundsMax.z, vertex.z) };
+    }
+
+    useMeshData(mesh);
+    return true;
+}
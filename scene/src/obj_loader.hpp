@@ -0,0 +1,11 @@
+#pragma once
+
+#include "mesh_cache.hpp"
+
+// Loads an OBJ and the MTL files it refers to into the vectors of mesh, positions are multiplied by scale
+// The file is cut at line boundaries and the chunks are parsed on every core, then merged in file order
+// Each object or group becomes a sub-mesh, polygons are triangulated by ear clipping like tinyobj does
+// Vertices shared by several faces are only stored once per sub-mesh, and referenced by the indices
+// Missing texture coordinates are set to 0, missing normals are averaged from the faces sharing the vertex
+// Faces with invalid indices are skipped; returns false if the file can't be read
+bool loadObj(Mesh& mesh, const char* filename, float scale);
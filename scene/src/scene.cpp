@@ -1,18 +1,56 @@
 
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
 #include <iostream>
+#include <mutex>
+#include <string>
 
 #include <imgui.h>
 
-#include <tiny_obj_loader.h>
-
 #include <common/maths.hpp>
+#include <common/trace.hpp>
 #include <common/utils.hpp>
 
+#include "mesh_optimizer.hpp"
+#include "obj_loader.hpp"
 #include "scene_impl.hpp"
 
 scnImpl* scnCreate()
 {
-    return new scnImpl();
+    return scnCreateAsync("watch_tower");
+}
+
+scnImpl* scnCreateWithAsset(const char* assetName)
+{
+    scnImpl* scene = scnCreateAsync(assetName);
+    if (scene != nullptr && scene->waitForLoading() == SCN_LOAD_STATE_FAILED)
+    {
+        delete scene;
+        return nullptr;
+    }
+    return scene;
+}
+
+scnImpl* scnCreateAsync(const char* assetName)
+{
+    scnImpl* scene = new scnImpl();
+    if (!scene->loadAsset(assetName))
+    {
+        delete scene;
+        return nullptr;
+    }
+    return scene;
+}
+
+scnLoadState scnGetLoadState(scnImpl* scene)
+{
+    return scene->getLoadState();
+}
+
+scnLoadState scnWaitForLoading(scnImpl* scene)
+{
+    return scene->waitForLoading();
 }
 
 void scnDestroy(scnImpl* scene)
@@ -25,6 +63,25 @@ void scnUpdate(scnImpl* scene, float deltaTime, rdrImpl* renderer)
     scene->update(deltaTime, renderer);
 }
 
+void scnSetCamera(scnImpl* scene, const float* projectionMatrix, const float* viewMatrix)
+{
+    mat4x4 projection;
+    mat4x4 view;
+    memcpy(projection.e, projectionMatrix, sizeof(projection.e));
+    memcpy(view.e, viewMatrix, sizeof(view.e));
+    scene->setCamera(projection, view);
+}
+
+void scnSetGridSize(scnImpl* scene, int size)
+{
+    scene->setGridSize(size);
+}
+
+void scnGetCullStats(scnImpl* scene, scnCullStats* stats)
+{
+    *stats = scene->getCullStats();
+}
+
 void scnSetImGuiContext(scnImpl* scene, struct ImGuiContext* context)
 {
     ImGui::SetCurrentContext(context);
@@ -35,166 +92,382 @@ void scnShowImGuiControls(scnImpl* scene)
     scene->showImGuiControls();
 }
 
-bool loadObj(std::vector<rdrVertex>& vertices, const char* filename, float scale, std::vector<Image>& images)
+// The lock is only held to copy the settings and the counters, never while updating or while ImGui draws the controls
+struct scnImGuiControls
 {
-    tinyobj::attrib_t attrib;
-    std::vector<tinyobj::shape_t> shapes;
-    std::vector<tinyobj::material_t> materials;
-    std::string warn;
-    std::string err;
+    std::mutex mutex;
+    SceneSettings settings;
+    SceneCounters counters;
+    bool edited = false; // The settings are newer than the scene's
+};
 
-    bool ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, filename);
-    if (!warn.empty())
-        printf("tinyObj warning: %s\n", warn.c_str());
+scnImGuiControls* scnCreateImGuiControls(scnImpl* scene)
+{
+    scnImGuiControls* controls = new scnImGuiControls();
+    controls->settings = scene->getSettings();
+    controls->counters = scene->getCounters();
+    return controls;
+}
 
-    if (!err.empty())
-        printf("tinyObj error: %s\n", err.c_str());
+void scnDestroyImGuiControls(scnImGuiControls* controls)
+{
+    delete controls;
+}
 
-    //if (images.size() != shapes.size())
-    //{
-    //    std::cerr << "Images vector size " << images.size() << " is not equal to number of shapes in .obj " << shapes.size() << std::endl;
-    //    exit(1);
-    //}
-        
+void scnSyncImGuiControls(scnImpl* scene, scnImGuiControls* controls)
+{
+    std::lock_guard<std::mutex> lock(controls->mutex);
+    if (controls->edited)
+        scene->setSettings(controls->settings);
+    controls->edited = false;
+    controls->settings = scene->getSettings();
+    controls->counters = scene->getCounters();
+}
 
-    //if (ret)
-    //    return false;
+void scnShowImGuiControlsDeferred(scnImGuiControls* controls)
+{
+    SceneSettings settings;
+    SceneCounters counters;
+    {
+        std::lock_guard<std::mutex> lock(controls->mutex);
+        settings = controls->settings;
+        counters = controls->counters;
+    }
 
-    for (size_t s = 0; s < shapes.size(); s++)
+    if (!scnImpl::showImGuiControls(settings, counters))
+        return;
+
+    std::lock_guard<std::mutex> lock(controls->mutex);
+    controls->settings = settings;
+    controls->edited = true;
+}
+
+// Models bundled in the assets directory, with the scale that fits them in the default view
+// Each shape of the OBJ is drawn with the texture of the same index, or the first one
+struct AssetDesc
+{
+    const char* name;
+    const char* objFile;
+    float scale;
+    std::vector<const char*> textureFiles;
+};
+
+static const AssetDesc assets[] = {
+    { "watch_tower", "assets/watch_tower/wooden watch tower2.obj", 0.2f, {
+        "assets/watch_tower/textures/Wood_Tower_Col.jpg",
+    } },
+    { "alien", "assets/alien/alien.obj", 0.15f, {
+        "assets/alien/textures/Alien-Animal-Base-Diffuse.jpg",
+        "assets/alien/textures/Alien-Animal_eye.jpg",
+    } },
+    { "stormtrooper", "assets/stormtrooper/0.obj", 1.f, {
+        "assets/stormtrooper/textures/t_imperial_stormtrooper_male_01_helmet_cs.tga",
+        "assets/stormtrooper/textures/t_imperial_stormtrooper_male_01_helmet_cs.tga",
+        "assets/stormtrooper/textures/t_imperial_stormtrooper_male_01_upperbody_cs.tga",
+        "assets/stormtrooper/textures/t_imperial_stormtrooper_male_01_upperbody_cs.tga",
+        "assets/stormtrooper/textures/t_imperial_stormtrooper_male_01_upperbody_cs.tga",
+        "assets/stormtrooper/textures/t_imperial_stormtrooper_male_01_helmet_cs.tga",
+        "assets/stormtrooper/textures/t_imperial_stormtrooper_male_01_lowerbody_cs.tga",
+        "assets/stormtrooper/textures/t_imperial_stormtrooper_male_01_upperbody_cs.tga",
+        "assets/stormtrooper/textures/t_imperial_stormtrooper_male_01_lowerbody_cs.tga",
+    } },
+    { "vehicule", "assets/vehicule/0.obj", 0.5f, {
+        "assets/vehicule/textures/b_d.tga",
+        "assets/vehicule/textures/w_d.tga",
+        "assets/vehicule/textures/w_d.tga",
+        "assets/vehicule/textures/w_d.tga",
+        "assets/vehicule/textures/w_d.tga",
+        "assets/vehicule/textures/w_d.tga",
+        "assets/vehicule/textures/a_d.tga",
+        "assets/vehicule/textures/b_d.tga",
+        "assets/vehicule/textures/a_d.tga",
+    } },
+    { "eyeball", "assets/eyeball/eyeball.obj", 1.f, {
+        "assets/eyeball/textures/Eye_D.jpg",
+    } },
+    { "cat", "assets/cat/cat.obj", 0.1f, {
+        "assets/cat/textures/Cat_diffuse.jpg",
+    } },
+    { "calculator", "assets/calculator/calculadora.obj", 0.25f, {
+        "assets/calculator/textures/Calculadora_Color.png",
+    } },
+    { "cottage", "assets/cottage/cottage_obj.obj", 0.15f, {} },
+    { "handgun", "assets/handgun/Handgun_obj.obj", 0.1f, {} },
+};
+
+static const int assetCount = sizeof(assets) / sizeof(assets[0]);
+
+int scnGetAssetCount()
+{
+    return assetCount;
+}
+
+const char* scnGetAssetName(int index)
+{
+    return index >= 0 && index < assetCount ? assets[index].name : nullptr;
+}
+
+bool scnImpl::loadAsset(const char* name)
+{
+    TRACE_SCOPE("Asset Loading");
+
+    for (const AssetDesc& asset : assets)
     {
-        size_t index_offset = 0;
-        for (size_t f = 0; f < shapes[s].mesh.num_face_vertices.size(); f++)
+        if (strcmp(asset.name, name) != 0)
+            continue;
+
+        // Paths are resolved now, the working directory may change while loading
+        std::vector<std::string> imageFiles;
+        for (const char* file : asset.textureFiles)
         {
-            int fv = shapes[s].mesh.num_face_vertices[f];
-            for (size_t v = 0; v < fv; v++)
-            {
-                tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + v];
-                tinyobj::real_t vx = attrib.vertices[3 * idx.vertex_index + 0];
-                tinyobj::real_t vy = attrib.vertices[3 * idx.vertex_index + 1];
-                tinyobj::real_t vz = attrib.vertices[3 * idx.vertex_index + 2];
-                tinyobj::real_t nx = attrib.normals[3 * idx.normal_index + 0];
-                tinyobj::real_t ny = attrib.normals[3 * idx.normal_index + 1];
-                tinyobj::real_t nz = attrib.normals[3 * idx.normal_index + 2];
-                tinyobj::real_t tx = attrib.texcoords[2 * idx.texcoord_index + 0];
-                tinyobj::real_t ty = attrib.texcoords[2 * idx.texcoord_index + 1];
-
-                //tinyobj::real_t r = attrib.colors[3 * idx.vertex_index + 0];
-                //tinyobj::real_t g = attrib.colors[3 * idx.vertex_index + 1];
-                //tinyobj::real_t b = attrib.colors[3 * idx.vertex_index + 2];
-
-                vertices.push_back(rdrVertex{ vx * scale, vy * scale, vz * scale, nx, ny, nz, 0.f, 0.f, 0.f, 1.f, tx, ty });
-            }
-            index_offset += fv;
+            std::string fullPath = getFullPath(file);
+            if (fullPath.empty())
+                fullPath = file;
+
+            auto found = std::find(imageFiles.begin(), imageFiles.end(), fullPath);
+            imageIndices.push_back((int)(found - imageFiles.begin()));
+            if (found == imageFiles.end())
+                imageFiles.push_back(fullPath);
+        }
 
-            // per-face material
-            shapes[s].mesh.material_ids[f];
+        images = std::vector<Image>(imageFiles.size());
+        textures.assign(images.size(), 0);
+        pendingImages = (int)images.size();
+        pendingTextures = (int)images.size();
+
+        std::string objFile = getFullPath(asset.objFile);
+        if (objFile.empty())
+            objFile = asset.objFile;
+
+        // The mesh first, nothing is drawn without it
+        loader.start(std::min((int)std::thread::hardware_concurrency(), 1 + (int)images.size()), "Loader");
+        float objScale = asset.scale;
+        loader.push([this, objFile, objScale] { loadMesh(objFile, objScale); });
+        for (size_t i = 0; i < images.size(); ++i)
+        {
+            Image& image = images[i];
+            image.file = imageFiles[i];
+            loader.push([this, &image] { loadImage(image); });
         }
-        std::vector<float>::iterator it;
-        it = images.at(s).shape.begin() + 1;
-        images.at(s).shape.insert(it, (float)shapes[s].mesh.num_face_vertices.size());
+        return true;
     }
 
-    return true;
-}
-
-bool loadImage(std::vector<Image>& images, int& width, int& height)
-{
-    const char* files[1] = {
-        //"assets/vehicule/textures/b_d.tga",
-        //"assets/vehicule/textures/w_d.tga",
-        //"assets/vehicule/textures/w_d.tga",
-        //"assets/vehicule/textures/w_d.tga",
-        //"assets/vehicule/textures/w_d.tga",
-        //"assets/vehicule/textures/w_d.tga",
-        //"assets/vehicule/textures/a_d.tga",
-        //"assets/vehicule/textures/b_d.tga",
-        //"assets/vehicule/textures/a_d.tga",
-        //"assets/stormtrooper/textures/t_imperial_stormtrooper_male_01_helmet_cs.tga",
-        //"assets/stormtrooper/textures/t_imperial_stormtrooper_male_01_helmet_cs.tga",
-        //"assets/stormtrooper/textures/t_imperial_stormtrooper_male_01_upperbody_cs.tga",
-        //"assets/stormtrooper/textures/t_imperial_stormtrooper_male_01_upperbody_cs.tga",
-        //"assets/stormtrooper/textures/t_imperial_stormtrooper_male_01_upperbody_cs.tga",
-        //"assets/stormtrooper/textures/t_imperial_stormtrooper_male_01_helmet_cs.tga",
-        
-        //"assets/stormtrooper/textures/t_imperial_stormtrooper_male_01_lowerbody_cs.tga",
-        
-        //"assets/stormtrooper/textures/t_imperial_stormtrooper_male_01_upperbody_cs.tga",
-        
-        //"assets/stormtrooper/textures/t_imperial_stormtrooper_male_01_lowerbody_cs.tga",
-        //"assets/eyeball/textures/Eye_D.jpg",
-        //"assets/alien/textures/Alien-Animal-Base-Diffuse.jpg",
-        //"assets/alien/textures/Alien-Animal_eye.jpg",
-        //"assets/cottage/textures/cottage_diffuse.png",
-        //"assets/santa_hat/textures/color.jpg",
-        "assets/watch_tower/textures/Wood_Tower_Col.jpg",
-        //"assets/calculator/textures/Calculadora_Color.png",
-        //"assets/cat/textures/Cat_diffuse.jpg",
-    };
+    std::cout << "Unknown asset " << name << std::endl;
+    return false;
+}
 
-    unsigned char* data = nullptr;
-    int size = sizeof(files) / sizeof(files[0]);
+void scnImpl::loadMesh(const std::string& objFile, float objScale)
+{
+    TRACE_SCOPE("Load Mesh");
+
+    if (cancelled)
+        return;
 
-    for (int i = 0; i < size; ++i)
+    std::string cacheFile = objFile + MESH_CACHE_EXTENSION;
+    bool loaded = loadMeshCache(mesh, cacheFile.c_str(), objFile.c_str(), objScale);
+    if (!loaded)
     {
-        data = utils::loadImage(files[i], width, height);
-        if (data != nullptr)
+        loaded = loadObj(mesh, objFile.c_str(), objScale);
+        if (!loaded)
         {
-            std::vector<float> shape = std::vector<float>(data, data + width * height * 4);
-            std::vector<float>::iterator it;
-            it = shape.begin();
-            shape.insert(it, (float)shape.size());
-            images.push_back(Image{ shape, width, height, 0 });
+            std::cout << "Error loading " << objFile << std::endl;
         }
+        else
+        {
+            optimizeMesh(mesh);
+            const MeshOptimizationStats& stats = mesh.optimization;
+            printf("Mesh %s optimized: ACMR %.3f -> %.3f, overdraw %.3f -> %.3f\n", objFile.c_str(),
+                stats.acmrBefore, stats.acmrAfter, stats.overdrawBefore, stats.overdrawAfter);
+
+            // The mesh parsed from the OBJ is drawn this time, the cache is used from the next run
+            if (!writeMeshCache(mesh, cacheFile.c_str(), objFile.c_str(), objScale))
+                std::cout << "Cannot write the mesh cache " << cacheFile << std::endl;
+        }
+    }
+
+    // Published with the mesh
+    for (const MeshSubMesh& subMesh : mesh.subMeshes)
+    {
+        Aabb bounds = {};
+        const rdrVertex* vertices = mesh.vertices + subMesh.firstVertex;
+        for (int i = 0; i < subMesh.vertexCount; ++i)
+        {
+            float3 position = { vertices[i].x, vertices[i].y, vertices[i].z };
+            if (i == 0)
+                bounds = { position, position };
+            bounds.min = { maths::min(bounds.min.x, position.x), maths::min(bounds.min.y, position.y), maths::min(bounds.min.z, position.z) };
+            bounds.max = { maths::max(bounds.max.x, position.x), maths::max(bounds.max.y, position.y), maths::max(bounds.max.z, position.z) };
+        }
+        subMeshBounds.push_back(bounds);
+    }
+
+    meshState.store(loaded ? SCN_LOAD_STATE_LOADED : SCN_LOAD_STATE_FAILED, std::memory_order_release);
+}
+
+// Images that can't be loaded are left empty, their sub-meshes are drawn with the vertex colors
+// Images with an up to date texture cache are mapped instead of decoded
+void scnImpl::loadImage(Image& image)
+{
+    TRACE_SCOPE("Load Image");
+
+    if (cancelled)
+        return;
+
+    std::string cacheFile = image.file + TEXTURE_CACHE_EXTENSION;
+    if (!loadTextureCache(image.cache, cacheFile.c_str(), image.file.c_str()))
+    {
+        unsigned char* data = utils::loadImage(image.file, image.width, image.height);
+        if (data != nullptr)
+            image.texels.assign(data, data + image.width * image.height * 4);
+        else
+            std::cout << "Error loading image " << image.file << std::endl;
+        free(data);
     }
-    
-    free(data);
-    return (data != nullptr);
+
+    image.loaded.store(true, std::memory_order_release);
+    pendingImages.fetch_sub(1, std::memory_order_release);
 }
 
+scnLoadState scnImpl::getLoadState() const
+{
+    scnLoadState state = meshState.load(std::memory_order_acquire);
+    if (state == SCN_LOAD_STATE_LOADED && pendingImages.load(std::memory_order_acquire) > 0)
+        return SCN_LOAD_STATE_LOADING;
+    return state;
+}
 
+scnLoadState scnImpl::waitForLoading()
+{
+    loader.wait();
+    return getLoadState();
+}
 
-scnImpl::scnImpl()
+scnImpl::~scnImpl()
 {
+    // Jobs still running write to the members, the texture caches being written are finished
+    cancelled = true;
+    loader.wait();
 
-    int width;
-    int height;
+    // Cached textures point to the mapped files of the images
+    for (rdrTexture texture : textures)
+        rdrDestroyTexture(textureRenderer, texture);
+}
 
-    // HERE: Load the scene
-    bool loadedImages = loadImage(images, width, height);
+// Cached images are used in place by the renderer
+// The others are copied, and their texture data is written to the cache by the loading threads, for the next run
+static rdrTexture createTexture(rdrImpl* renderer, Image& image, JobQueue& loader)
+{
+    if (image.cache.data != nullptr)
+    {
+        rdrTexture texture = rdrCreateTextureFromData(renderer, image.cache.data, image.cache.size, image.cache.width, image.cache.height);
+        if (texture == 0)
+            std::cout << "Invalid texture cache for " << image.file << std::endl;
+        return texture;
+    }
 
-    if (!loadedImages)
+    rdrTexture texture = rdrCreateTexture(renderer, image.texels.data(), image.width, image.height);
+    std::vector<unsigned char>().swap(image.texels);
+    if (texture == 0)
+        return 0;
+
+    std::vector<unsigned char> data(rdrGetTextureData(renderer, texture, nullptr));
+    rdrGetTextureData(renderer, texture, data.data());
+    std::string sourceFile = image.file;
+    int width = image.width;
+    int height = image.height;
+    loader.push([data = std::move(data), sourceFile, width, height]
     {
-        std::cout << "Error loading images" << std::endl;
-        exit(1);
+        TRACE_SCOPE("Write Texture Cache");
+        std::string cacheFile = sourceFile + TEXTURE_CACHE_EXTENSION;
+        if (!writeTextureCache(data.data(), data.size(), width, height, cacheFile.c_str(), sourceFile.c_str()))
+            std::cout << "Cannot write the texture cache " << cacheFile << std::endl;
+    });
+    return texture;
+}
+
+// The renderer is only called from the render thread, textures are created there once their image is published
+void scnImpl::createTextures(rdrImpl* renderer)
+{
+    TRACE_SCOPE("Create Textures");
+
+    textureRenderer = renderer;
+    for (size_t i = 0; i < images.size(); ++i)
+    {
+        Image& image = images[i];
+        if (image.textureCreated || !image.loaded.load(std::memory_order_acquire))
+            continue;
+
+        textures[i] = createTexture(renderer, image, loader);
+        image.textureCreated = true;
+        --pendingTextures;
     }
+}
+
+// Copies are laid out in mesh space, before the root transform
+void scnImpl::buildSceneGraph()
+{
+    nodes.clear();
+    objects.clear();
+    nodes.push_back({ -1, mat4::identity(), mat4::identity() });
 
-    //loadObj(vertices, "assets/eyeball/eyeball.obj", 1.f, images);
-    //loadObj(vertices, "assets/alien/alien.obj", 0.15f, images);
-    //loadObj(vertices, "assets/cottage/cottage_obj.obj", 0.15f);
-    //loadObj(vertices, "assets/santa_hat/santa_hat(DEFAULT).obj", 0.3f, images);
-    loadObj(vertices, "assets/watch_tower/wooden watch tower2.obj", 0.2f, images);
-    //loadObj(vertices, "assets/calculator/calculadora.obj", 0.25f, images);
-    //loadObj(vertices, "assets/cat/cat.obj", 0.1f, images);
-    //loadObj(vertices, "assets/stormtrooper/0.obj", 1.f, images);
-    //loadObj(vertices, "assets/vehicule/0.obj", 0.5f, images);
-
-    /*
-    vertices = {
-        //       pos                  normal                  color              uv
-        {-0.5f,-0.5f, 0.0f,      0.0f, 0.0f, 0.0f,      1.0f, 0.0f, 0.0f,     0.0f, 0.0f },
-        { 0.5f,-0.5f, 0.0f,      0.0f, 0.0f, 0.0f,      0.0f, 1.0f, 0.0f,     0.0f, 0.0f },
-        { 0.0f, 0.5f, 0.0f,      0.0f, 0.0f, 0.0f,      0.0f, 0.0f, 1.0f,     0.0f, 0.0f },
-    };*/
-    
+    float3 size = mesh.boundsMax - mesh.boundsMin;
+    for (int z = 0; z < gridSize; ++z)
+    {
+        for (int x = 0; x < gridSize; ++x)
+        {
+            float3 offset = { (x - (gridSize - 1) * 0.5f) * size.x * 1.25f, 0.f, z * size.z * -1.25f };
+            nodes.push_back({ 0, mat4::translate(offset), mat4::identity() });
+
+            int node = (int)nodes.size() - 1;
+            for (size_t i = 0; i < mesh.subMeshes.size(); ++i)
+                objects.push_back({ node, (int)i, imageIndices.empty() ? -1 : imageIndices[i < imageIndices.size() ? i : 0] });
+        }
+    }
+
+    // The tree must match the new objects before anything refits or culls it
+    objectBounds.resize(objects.size());
+    visibleObjects.resize(objects.size());
+    updateBounds();
+    bvh.build(objectBounds);
 }
 
-scnImpl::~scnImpl()
+void scnImpl::updateBounds()
 {
-    // HERE: Unload the scene
+    for (SceneNode& node : nodes)
+        node.world = node.parent < 0 ? node.local : nodes[node.parent].world * node.local;
+    for (size_t i = 0; i < objects.size(); ++i)
+        objectBounds[i] = transformAabb(subMeshBounds[objects[i].subMesh], nodes[objects[i].node].world);
+}
+
+// The whole graph may move each frame, so the transforms and the bounds are updated and the BVH refitted before culling
+void scnImpl::cullObjects()
+{
+    TRACE_SCOPE("Scene Culling");
+
+    updateBounds();
+
+    cullStats = {};
+    cullStats.objects = (int)objects.size();
+    if (bvh.nodes.empty() || !hasCamera)
+    {
+        visibleObjects.assign(objects.size(), true);
+    }
+    else
+    {
+        bvh.refit(objectBounds);
+        visibleObjects.assign(objects.size(), false);
+        cullStats.bvhNodesTested = bvh.cull(frustum, visibleObjects);
+    }
+
+    for (bool visible : visibleObjects)
+        cullStats.visibleObjects += visible;
+    cullStats.culledObjects = cullStats.objects - cullStats.visibleObjects;
 }
 
 void scnImpl::update(float deltaTime, rdrImpl* renderer)
 {
+    TRACE_SCOPE("Scene Update");
+
     // HERE: Update (if needed) and display the scene
 
     // returns the translation matrix
@@ -204,22 +477,99 @@ void scnImpl::update(float deltaTime, rdrImpl* renderer)
 
     //matrix = matrix * mat4::rotateY((float)(time * 2.0));
 
-    rdrSetModel(renderer, model.e);
+    if (pendingTextures > 0)
+        createTextures(renderer);
 
-    if (!texturesSet)
+    // Nothing to draw until the mesh is loaded, textures still loading are replaced by the vertex colors
+    if (meshState.load(std::memory_order_acquire) == SCN_LOAD_STATE_LOADED)
     {
-        for (Image image : images)
-            rdrSetTexture(renderer, image.shape.data(), image.width, image.height);
-        texturesSet = true;
-    }
+        if (objects.empty())
+            buildSceneGraph();
+        nodes[0].local = model;
+        cullObjects();
+
+        // In the order of the objects, whatever the camera
+        int modelNode = -1;
+        for (size_t i = 0; i < objects.size(); ++i)
+        {
+            if (!visibleObjects[i])
+                continue;
+
+            const SceneObject& object = objects[i];
+            if (object.node != modelNode)
+            {
+                modelNode = object.node;
+                rdrSetModel(renderer, nodes[modelNode].world.e);
+            }
 
-    rdrDrawTriangles(renderer, vertices.data(), (int)vertices.size());
-    
+            const MeshSubMesh& subMesh = mesh.subMeshes[object.subMesh];
+            rdrBindTexture(renderer, object.image < 0 ? 0 : textures[object.image]);
+            rdrDrawIndexed(renderer, mesh.vertices + subMesh.firstVertex, subMesh.vertexCount, mesh.indices + subMesh.firstIndex, subMesh.indexCount);
+        }
+    }
 
     time += deltaTime;
 }
 
+void scnImpl::setCamera(const mat4x4& projection, const mat4x4& view)
+{
+    frustum = getFrustum(projection, view);
+    hasCamera = true;
+}
+
+void scnImpl::setGridSize(int size)
+{
+    size = maths::max(size, 1);
+    if (size == gridSize)
+        return;
+
+    // Rebuilt by the next update, the old tree indexes objects that no longer exist
+    gridSize = size;
+    objects.clear();
+    bvh = Bvh();
+}
+
+void scnImpl::setSettings(const SceneSettings& settings)
+{
+    scale = settings.scale;
+    setGridSize(settings.gridSize);
+}
+
+SceneCounters scnImpl::getCounters() const
+{
+    SceneCounters counters = {};
+    counters.state = getLoadState();
+    counters.pendingImages = pendingImages.load();
+    counters.imageCount = (int)images.size();
+    if (counters.state == SCN_LOAD_STATE_LOADED)
+        counters.optimization = mesh.optimization;
+    counters.cull = cullStats;
+    return counters;
+}
+
 void scnImpl::showImGuiControls()
 {
-    ImGui::SliderFloat("scale", &scale, 0.f, 10.f);
+    SceneSettings settings = getSettings();
+    if (showImGuiControls(settings, getCounters()))
+        setSettings(settings);
+}
+
+bool scnImpl::showImGuiControls(SceneSettings& settings, const SceneCounters& counters)
+{
+    if (counters.state == SCN_LOAD_STATE_LOADING)
+        ImGui::Text("Loading, %d of %d images left", counters.pendingImages, counters.imageCount);
+    else if (counters.state == SCN_LOAD_STATE_FAILED)
+        ImGui::Text("The mesh can't be loaded");
+    else
+    {
+        const MeshOptimizationStats& stats = counters.optimization;
+        const scnCullStats& cullStats = counters.cull;
+        ImGui::Text("ACMR %.3f, %.3f before optimization", stats.acmrAfter, stats.acmrBefore);
+        ImGui::Text("Overdraw %.3f, %.3f before optimization", stats.overdrawAfter, stats.overdrawBefore);
+        ImGui::Text("Objects: %d visible, %d culled, %d BVH nodes tested", cullStats.visibleObjects, cullStats.culledObjects, cullStats.bvhNodesTested);
+    }
+
+    bool edited = ImGui::SliderFloat("scale", &settings.scale, 0.f, 10.f);
+    edited |= ImGui::SliderInt("grid size", &settings.gridSize, 1, 64);
+    return edited;
 }
@@ -1,32 +1,124 @@
 
+#include <atomic>
+#include <string>
 #include <vector>
 
 #include <rdr/renderer.h>
 #include <scn/scene.h>
 
+#include "bvh.hpp"
+#include "job_queue.hpp"
+#include "mesh_cache.hpp"
+#include "texture_cache.hpp"
+
 struct rdrImpl;
 
+// Filled by a loading thread, then published to the render thread by setting loaded
 struct Image
 {
-    std::vector<float> shape;
-    int width;
-    int height;
-    int vertexCount;
+    std::string file; // Full path, the scene may be updated from another working directory
+    std::vector<unsigned char> texels; // RGBA, 8 bits per component, empty if the file can't be loaded or if it is cached
+    int width = 0;
+    int height = 0;
+    TextureCache cache;
+    std::atomic<bool> loaded{ false };
+    bool textureCreated = false; // Only used by the render thread
+};
+
+// Node of the scene graph, its world transform is the one of its parent times its local one
+struct SceneNode
+{
+    int parent; // -1 for the root, parents come before their children
+    mat4x4 local;
+    mat4x4 world;
+};
+
+// Sub-mesh drawn with the transform of a node, culled on its own
+struct SceneObject
+{
+    int node;
+    int subMesh;
+    int image; // -1 without texture
+};
+
+// What the ImGui controls edit, copied from and to the scene
+struct SceneSettings
+{
+    float scale;
+    int gridSize;
+};
+
+// What the ImGui controls only show
+struct SceneCounters
+{
+    scnLoadState state;
+    int pendingImages;
+    int imageCount;
+    MeshOptimizationStats optimization; // Once loaded
+    scnCullStats cull;
 };
 
 struct scnImpl
 {
-    scnImpl();
     ~scnImpl();
+
+    // See scnGetAssetName(), returns false if the asset is unknown
+    // The mesh and the images are loaded in the background, see getLoadState()
+    bool loadAsset(const char* name);
+
+    scnLoadState getLoadState() const;
+    scnLoadState waitForLoading();
+
+    // Draws what is loaded so far, only the objects in the view of the camera if it is set
     void update(float deltaTime, rdrImpl* renderer);
 
+    void setCamera(const mat4x4& projection, const mat4x4& view);
+    void setGridSize(int size);
+    scnCullStats getCullStats() const { return cullStats; }
+
+    SceneSettings getSettings() const { return { scale, gridSize }; }
+    void setSettings(const SceneSettings& settings);
+    SceneCounters getCounters() const;
+
     void showImGuiControls();
+    // Returns true if a setting was edited
+    static bool showImGuiControls(SceneSettings& settings, const SceneCounters& counters);
 
 private:
+    void loadMesh(const std::string& objFile, float objScale);
+    void loadImage(Image& image);
+    void createTextures(rdrImpl* renderer);
+    void buildSceneGraph();
+    void updateBounds();
+    void cullObjects();
+
     double time = 0.0;
-    std::vector<rdrVertex> vertices;
+    Mesh mesh;
+    std::vector<Aabb> subMeshBounds; // Loaded with the mesh
+    std::atomic<scnLoadState> meshState{ SCN_LOAD_STATE_LOADING }; // Mesh is only read once loaded
+    std::atomic<int> pendingImages{ 0 };
+    std::atomic<bool> cancelled{ false }; // Loading jobs not started yet when the scene is destroyed do nothing
     float scale = 1.f;
 
-    std::vector<Image> images;
-    bool texturesSet = false;
-};
\ No newline at end of file
+    std::vector<Image> images; // Each file is only loaded once
+    std::vector<int> imageIndices; // Sub-mesh i is drawn with images[imageIndices[i]], or with the first one past the end
+    std::vector<rdrTexture> textures; // Same order as images, 0 until the image is loaded
+    int pendingTextures = 0;
+    rdrImpl* textureRenderer = nullptr; // Owner of the textures
+
+    // Node 0 is the root, animated, its children are the copies of the asset on a grid of gridSize x gridSize
+    // Built once the mesh is loaded
+    std::vector<SceneNode> nodes;
+    std::vector<SceneObject> objects;
+    std::vector<Aabb> objectBounds; // World space, same order as objects
+    std::vector<bool> visibleObjects;
+    Bvh bvh;
+    int gridSize = 1;
+
+    bool hasCamera = false;
+    Frustum frustum;
+    scnCullStats cullStats = {};
+
+    // Declared last so it is stopped first, the jobs refer to the members above
+    JobQueue loader;
+};
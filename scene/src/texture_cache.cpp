@@ -0,0 +1,97 @@
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include <rdr/renderer.h>
+
+#include "texture_cache.hpp"
+
+// Values are written as they are in memory, so files are only shared between little endian hosts
+struct TextureFileHeader
+{
+    char magic[8];
+    unsigned int version;
+    unsigned int dataVersion; // RDR_TEXTURE_DATA_VERSION
+    unsigned long long sourceSize;
+    long long sourceTime;
+    int width;
+    int height;
+    unsigned long long dataOffset; // From the start of the file, aligned to 16 bytes
+    unsigned long long dataSize;
+};
+
+static const char textureMagic[8] = { 'S', 'C', 'N', 'T', 'E', 'X', 0, 0 };
+
+static const unsigned long long dataOffset = (sizeof(TextureFileHeader) + 15) & ~15ull;
+
+bool loadTextureCache(TextureCache& cache, const char* cacheFile, const char* sourceFile)
+{
+    unsigned long long sourceSize;
+    long long sourceTime;
+    if (!getFileStamp(sourceFile, sourceSize, sourceTime) || !cache.file.open(cacheFile))
+        return false;
+
+    size_t size = cache.file.getSize();
+    TextureFileHeader header;
+    bool valid = size >= sizeof(header);
+    if (valid)
+    {
+        memcpy(&header, cache.file.getData(), sizeof(header));
+        valid = memcmp(header.magic, textureMagic, sizeof(textureMagic)) == 0
+            && header.version == TEXTURE_CACHE_VERSION
+            && header.dataVersion == RDR_TEXTURE_DATA_VERSION
+            && header.sourceSize == sourceSize && header.sourceTime == sourceTime
+            && header.width > 0 && header.height > 0
+            && header.dataOffset % 16 == 0
+            && header.dataOffset <= size && header.dataSize <= size - header.dataOffset;
+    }
+
+    if (!valid)
+    {
+        printf("Texture cache %s is outdated or invalid, it is rebuilt\n", cacheFile);
+        cache.file.close();
+        return false;
+    }
+
+    cache.data = cache.file.getData() + header.dataOffset;
+    cache.size = (size_t)header.dataSize;
+    cache.width = header.width;
+    cache.height = header.height;
+    return true;
+}
+
+// Written to a temporary file first, so an interrupted write never leaves a valid looking cache
+bool writeTextureCache(const void* data, size_t size, int width, int height, const char* cacheFile, const char* sourceFile)
+{
+    TextureFileHeader header = {};
+    memcpy(header.magic, textureMagic, sizeof(textureMagic));
+    header.version = TEXTURE_CACHE_VERSION;
+    header.dataVersion = RDR_TEXTURE_DATA_VERSION;
+    if (!getFileStamp(sourceFile, header.sourceSize, header.sourceTime))
+        return false;
+    header.width = width;
+    header.height = height;
+    header.dataOffset = dataOffset;
+    header.dataSize = size;
+
+    std::string tempFile = std::string(cacheFile) + ".tmp";
+    FILE* file = fopen(tempFile.c_str(), "wb");
+    if (file == nullptr)
+        return false;
+
+    static const unsigned char padding[16] = {};
+    size_t paddingSize = (size_t)(dataOffset - sizeof(header));
+    bool written = fwrite(&header, 1, sizeof(header), file) == sizeof(header)
+        && fwrite(padding, 1, paddingSize, file) == paddingSize
+        && fwrite(data, 1, size, file) == size;
+    written = fclose(file) == 0 && written;
+
+    // rename() does not replace an existing file on Windows
+    remove(cacheFile);
+    if (!written || rename(tempFile.c_str(), cacheFile) != 0)
+    {
+        remove(tempFile.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+
+#include "mapped_file.hpp"
+
+// Texture data of the renderer (texels in its layout, with all their mip levels), written next to the image on the first run,
+// then memory mapped and handed to the renderer in place, instead of decoding the image and building the mips again
+// Files are rebuilt when the image changes, or when the version of the file or of the renderer texture data changes
+#define TEXTURE_CACHE_VERSION 1
+#define TEXTURE_CACHE_EXTENSION ".tex"
+
+struct TextureCache
+{
+    MappedFile file;
+    const void* data = nullptr; // In the mapped file, see rdrCreateTextureFromData()
+    size_t size = 0;
+    int width = 0;
+    int height = 0;
+};
+
+// Returns false if the cache is missing, outdated or invalid; cache is then left empty
+bool loadTextureCache(TextureCache& cache, const char* cacheFile, const char* sourceFile);
+// data and size are returned by rdrGetTextureData()
+bool writeTextureCache(const void* data, size_t size, int width, int height, const char* cacheFile, const char* sourceFile);
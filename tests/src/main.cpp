@@ -0,0 +1,283 @@
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#define chdir _chdir
+#else
+#include <unistd.h>
+#endif
+
+#include <rdr/renderer.h>
+#include <scn/scene.h>
+
+#include <common/maths.hpp>
+#include <common/camera.hpp>
+
+// Regression tests of the scene and renderer libraries, run from the repository root with: build/bin/tests app
+// Build with make CXXFLAGS="-O1 -g -fsanitize=address -D_GLIBCXX_SANITIZE_VECTOR" LDFLAGS=-fsanitize=address
+// to also catch the accesses past the end of the vectors
+static int failures = 0;
+
+#define CHECK(condition) \
+    do { if (!(condition)) { fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); ++failures; } } while (0)
+
+static const int WIDTH = 320;
+static const int HEIGHT = 180;
+
+struct TestFramebuffer
+{
+    std::vector<float4> color = std::vector<float4>(WIDTH * HEIGHT);
+    std::vector<float> depth = std::vector<float>(WIDTH * HEIGHT);
+
+    rdrFramebufferDesc getDesc()
+    {
+        rdrFramebufferDesc desc = {};
+        desc.colorBuffer = color.data();
+        desc.depthBuffer = depth.data();
+        desc.width = WIDTH;
+        desc.height = HEIGHT;
+        desc.colorFormat = RDR_COLOR_FORMAT_RGBA32F;
+        desc.depthFormat = RDR_DEPTH_FORMAT_D32F;
+        return desc;
+    }
+
+    void bind(rdrImpl* renderer)
+    {
+        rdrFramebufferDesc desc = getDesc();
+        rdrSetFramebuffer(renderer, &desc);
+    }
+
+    bool operator==(const TestFramebuffer& other) const
+    {
+        return memcmp(color.data(), other.color.data(), color.size() * sizeof(float4)) == 0
+            && memcmp(depth.data(), other.depth.data(), depth.size() * sizeof(float)) == 0;
+    }
+};
+
+static void renderFrame(rdrImpl* renderer, scnImpl* scene, Camera& camera, const float4& clearColor, float deltaTime)
+{
+    mat4x4 projection = camera.getProjection();
+    mat4x4 view = camera.getViewMatrix();
+
+    rdrClear(renderer, clearColor.e);
+    rdrBeginFrame(renderer);
+    rdrSetProjection(renderer, projection.e);
+    rdrSetView(renderer, view.e);
+    scnSetCamera(scene, projection.e, view.e);
+    scnUpdate(scene, deltaTime, renderer);
+    rdrEndFrame(renderer);
+}
+
+// The grid copies are culled with a BVH built for them, it must follow the grid when it shrinks or grows
+static void testGridResize(rdrImpl* renderer, scnImpl* scene)
+{
+    Camera camera(WIDTH, HEIGHT);
+    scnCullStats stats;
+
+    scnSetGridSize(scene, 1);
+    renderFrame(renderer, scene, camera, { 0.f, 0.f, 0.f, 1.f }, 1.f / 60.f);
+    scnGetCullStats(scene, &stats);
+    int subMeshCount = stats.objects;
+    CHECK(subMeshCount > 0);
+
+    const int gridSizes[] = { 8, 2, 1, 5, 3 };
+    for (int gridSize : gridSizes)
+    {
+        scnSetGridSize(scene, gridSize);
+        renderFrame(renderer, scene, camera, { 0.f, 0.f, 0.f, 1.f }, 1.f / 60.f);
+        renderFrame(renderer, scene, camera, { 0.f, 0.f, 0.f, 1.f }, 1.f / 60.f);
+        scnGetCullStats(scene, &stats);
+        CHECK(stats.objects == gridSize * gridSize * subMeshCount);
+        CHECK(stats.visibleObjects + stats.culledObjects == stats.objects);
+        CHECK(stats.visibleObjects > 0);
+    }
+}
+
+// Cycling through a ring of framebuffers gives the same frames as a single one, while the clear of each buffer
+// still skips the blocks it left at the clear color
+static void testFramebufferRing(rdrImpl* renderer, scnImpl* scene, TestFramebuffer& mainFramebuffer)
+{
+    const int FRAME_COUNT = 8;
+    const int RING_SIZE = 3;
+    Camera camera(WIDTH, HEIGHT);
+    scnSetGridSize(scene, 1);
+
+    // The scene is not animated, the camera turns and the clear color changes halfway
+    std::vector<TestFramebuffer> expected(FRAME_COUNT);
+    TestFramebuffer single;
+    single.bind(renderer);
+    for (int frame = 0; frame < FRAME_COUNT; ++frame)
+    {
+        camera.setTransform({ 0.175f, 0.474f, 1.773f }, 0.f, frame * 0.05f);
+        float4 clearColor = frame < FRAME_COUNT / 2 ? float4{ 0.f, 0.f, 0.f, 1.f } : float4{ 0.1f, 0.2f, 0.4f, 1.f };
+        renderFrame(renderer, scene, camera, clearColor, 0.f);
+        expected[frame] = single;
+    }
+
+    std::vector<TestFramebuffer> ring(RING_SIZE);
+    for (int frame = 0; frame < FRAME_COUNT; ++frame)
+    {
+        TestFramebuffer& framebuffer = ring[frame % RING_SIZE];
+        framebuffer.bind(renderer);
+        camera.setTransform({ 0.175f, 0.474f, 1.773f }, 0.f, frame * 0.05f);
+        float4 clearColor = frame < FRAME_COUNT / 2 ? float4{ 0.f, 0.f, 0.f, 1.f } : float4{ 0.1f, 0.2f, 0.4f, 1.f };
+        renderFrame(renderer, scene, camera, clearColor, 0.f);
+        CHECK(framebuffer == expected[frame]);
+    }
+
+    // Nothing drawn: the whole buffers are cleared by the end of the frame, then left as they are by the next clears
+    float4 clearColor = { 1.f, 0.f, 0.f, 1.f };
+    for (int frame = 0; frame < RING_SIZE * 2; ++frame)
+    {
+        TestFramebuffer& framebuffer = ring[frame % RING_SIZE];
+        framebuffer.bind(renderer);
+        if (frame == RING_SIZE)
+            framebuffer.color[0] = { 0.f, 1.f, 0.f, 1.f };
+        rdrClear(renderer, clearColor.e);
+        rdrBeginFrame(renderer);
+        rdrEndFrame(renderer);
+    }
+    CHECK(ring[0].color[0].g == 1.f);
+    CHECK(ring[1].color[0].r == 1.f);
+
+    // Another clear color is written again
+    ring[0].bind(renderer);
+    clearColor = { 0.f, 0.f, 1.f, 1.f };
+    rdrClear(renderer, clearColor.e);
+    rdrBeginFrame(renderer);
+    rdrEndFrame(renderer);
+    CHECK(ring[0].color[0].b == 1.f && ring[0].color[0].g == 0.f);
+
+    mainFramebuffer.bind(renderer);
+}
+
+// A texture seen in perspective follows the surface: the middle of a slanted quad is where its middle projects,
+// not halfway between its projected edges
+static void testPerspectiveTexturing()
+{
+    TestFramebuffer framebuffer;
+    rdrFramebufferDesc desc = framebuffer.getDesc();
+    rdrImpl* renderer = rdrInitEx(&desc);
+    rdrSetRenderOption(renderer, RDR_OPTION_BACKFACE_CULLING, false);
+
+    // Left column white, right column black, 90 degrees field of view
+    const unsigned char texels[] =
+    {
+        255, 255, 255, 255,   0, 0, 0, 255,
+        255, 255, 255, 255,   0, 0, 0, 255,
+    };
+    rdrTexture texture = rdrCreateTexture(renderer, texels, 2, 2);
+    CHECK(texture != 0);
+    rdrBindTexture(renderer, texture);
+    rdrSetTextureSampling(renderer, RDR_TEXTURE_FILTER_NEAREST, RDR_TEXTURE_WRAP_CLAMP);
+
+    mat4x4 projection = mat4::perspective(maths::toRadians(90.f), (float)WIDTH / HEIGHT, 0.1f, 10.f);
+    mat4x4 identity = mat4::identity();
+
+    // The left edge is at x = -1, z = -1.5 and the right one at x = 1, z = -4.5: they project to pixels 100 and 180,
+    // the middle x = 0, z = -3 to pixel 160, and affine texture coordinates would put it at pixel 140
+    rdrVertex vertices[6] =
+    {
+        { -1.f, -0.5f, -1.5f,  0.f, 0.f, 1.f,  1.f, 1.f, 1.f, 1.f,  0.f, 0.f },
+        {  1.f, -0.5f, -4.5f,  0.f, 0.f, 1.f,  1.f, 1.f, 1.f, 1.f,  1.f, 0.f },
+        {  1.f,  0.5f, -4.5f,  0.f, 0.f, 1.f,  1.f, 1.f, 1.f, 1.f,  1.f, 1.f },
+        { -1.f, -0.5f, -1.5f,  0.f, 0.f, 1.f,  1.f, 1.f, 1.f, 1.f,  0.f, 0.f },
+        {  1.f,  0.5f, -4.5f,  0.f, 0.f, 1.f,  1.f, 1.f, 1.f, 1.f,  1.f, 1.f },
+        { -1.f,  0.5f, -1.5f,  0.f, 0.f, 1.f,  1.f, 1.f, 1.f, 1.f,  0.f, 1.f },
+    };
+
+    float clearColor[4] = { 0.f, 0.f, 1.f, 1.f };
+    rdrClear(renderer, clearColor);
+    rdrBeginFrame(renderer);
+    rdrSetProjection(renderer, projection.e);
+    rdrSetView(renderer, identity.e);
+    rdrSetModel(renderer, identity.e);
+    rdrDrawTriangles(renderer, vertices, 6);
+    rdrEndFrame(renderer);
+
+    const float4* row = &framebuffer.color[HEIGHT / 2 * WIDTH];
+    CHECK(row[104].r == 1.f && row[104].b == 1.f);
+    CHECK(row[150].r == 1.f && row[150].b == 1.f);
+    CHECK(row[156].r == 1.f && row[156].b == 1.f);
+    CHECK(row[164].r == 0.f && row[164].b == 0.f);
+    CHECK(row[176].r == 0.f && row[176].b == 0.f);
+    CHECK(row[90].r == 0.f && row[90].b == 1.f);
+
+    rdrDestroyTexture(renderer, texture);
+    rdrShutdown(renderer);
+}
+
+// The deferred pixels are shaded by rdrEndFrame() with the threads of that moment, more than the draw was given
+static void testDeferredThreadCount()
+{
+    TestFramebuffer framebuffer;
+    rdrFramebufferDesc desc = framebuffer.getDesc();
+    rdrImpl* renderer = rdrInitEx(&desc);
+    rdrSetThreadCount(renderer, 1);
+    rdrSetRenderOption(renderer, RDR_OPTION_DEFERRED, true);
+    rdrSetRenderOption(renderer, RDR_OPTION_BACKFACE_CULLING, false);
+
+    mat4x4 projection = mat4::perspective(maths::toRadians(90.f), (float)WIDTH / HEIGHT, 0.1f, 10.f);
+    mat4x4 identity = mat4::identity();
+    rdrVertex vertices[3] =
+    {
+        { -4.f, -4.f, -2.f,  0.f, 0.f, 1.f,  1.f, 0.f, 0.f, 1.f,  0.f, 0.f },
+        {  4.f, -4.f, -2.f,  0.f, 0.f, 1.f,  1.f, 0.f, 0.f, 1.f,  0.f, 0.f },
+        {  0.f,  4.f, -2.f,  0.f, 0.f, 1.f,  1.f, 0.f, 0.f, 1.f,  0.f, 0.f },
+    };
+
+    float clearColor[4] = { 0.f, 0.f, 0.f, 1.f };
+    rdrClear(renderer, clearColor);
+    rdrBeginFrame(renderer);
+    rdrSetProjection(renderer, projection.e);
+    rdrSetView(renderer, identity.e);
+    rdrSetModel(renderer, identity.e);
+    rdrDrawTriangles(renderer, vertices, 3);
+    rdrSetThreadCount(renderer, 8);
+    rdrEndFrame(renderer);
+
+    rdrStats stats;
+    rdrGetStats(renderer, &stats);
+    CHECK(stats.depthTestsPassed > 0);
+    CHECK(stats.pixelsShaded == stats.depthTestsPassed);
+    CHECK(framebuffer.color[HEIGHT / 2 * WIDTH + WIDTH / 2].r > 0.f);
+
+    rdrShutdown(renderer);
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc > 1 && chdir(argv[1]) != 0)
+    {
+        fprintf(stderr, "Cannot change directory to %s\n", argv[1]);
+        return 1;
+    }
+
+    TestFramebuffer framebuffer;
+    rdrFramebufferDesc framebufferDesc = framebuffer.getDesc();
+    rdrImpl* renderer = rdrInitEx(&framebufferDesc);
+
+    scnImpl* scene = scnCreateWithAsset("watch_tower");
+    if (scene == nullptr)
+    {
+        fprintf(stderr, "Cannot load the scene\n");
+        rdrShutdown(renderer);
+        return 1;
+    }
+
+    testGridResize(renderer, scene);
+    testFramebufferRing(renderer, scene, framebuffer);
+    testPerspectiveTexturing();
+    testDeferredThreadCount();
+
+    scnDestroy(scene);
+    rdrShutdown(renderer);
+
+    if (failures > 0)
+        fprintf(stderr, "%d checks failed\n", failures);
+    else
+        printf("All tests passed\n");
+    return failures > 0 ? 1 : 0;
+}